@@ -26,7 +26,9 @@
 #include <linux/init.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/sched.h>
 #include <linux/seq_file.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <trace/events/power.h>
@@ -78,6 +80,14 @@
  *
  * The clock operations must lock internally to protect against
  * read-modify-write on registers that are shared by multiple clocks
+ *
+ * clk_get_rate does not take any clock lock. Each clock caches its rate,
+ * computed from the cached rate of its parent, and keeps a list of its
+ * current children. Whenever a rate, divider or parent may have changed,
+ * the cache of the clock and of everything below it is recomputed under
+ * the clk_rate_lock seqlock, and readers only retry on that seqlock.
+ * Internal paths that run under a clock lock keep using
+ * clk_get_rate_locked, which reads the hardware derived state directly.
  */
 
 /* FIXME: remove and never ignore overclock */
@@ -86,6 +96,8 @@
 static DEFINE_MUTEX(clock_list_lock);
 static LIST_HEAD(clocks);
 
+static DEFINE_SEQLOCK(clk_rate_lock);
+
 struct clk *tegra_get_clock_by_name(const char *name)
 {
 	struct clk *c;
@@ -114,13 +126,8 @@ static void clk_stats_update(struct clk *c)
 	c->stats.last_update = cur_jiffies;
 }
 
-/* Must be called with clk_lock(c) held */
-static unsigned long clk_predict_rate_from_parent(struct clk *c, struct clk *p)
+static unsigned long clk_rate_from_parent_rate(struct clk *c, u64 rate)
 {
-	u64 rate;
-
-	rate = clk_get_rate(p);
-
 	if (c->mul != 0 && c->div != 0) {
 		rate *= c->mul;
 		rate += c->div - 1; /* round up */
@@ -130,6 +137,85 @@ static unsigned long clk_predict_rate_from_parent(struct clk *c, struct clk *p)
 	return rate;
 }
 
+static unsigned long clk_get_rate_uncached(struct clk *c)
+{
+	unsigned long flags;
+	unsigned long rate;
+
+	clk_lock_save(c, &flags);
+
+	rate = clk_get_rate_locked(c);
+
+	clk_unlock_restore(c, &flags);
+
+	return rate;
+}
+
+/* Must be called with clk_lock(c) held */
+static unsigned long clk_predict_rate_from_parent(struct clk *c, struct clk *p)
+{
+	return clk_rate_from_parent_rate(c, clk_get_rate_uncached(p));
+}
+
+/* Must be called with clk_rate_lock held for writing */
+static void __clk_rate_publish(struct clk *c)
+{
+	struct clk *child;
+
+	if (c->parent)
+		c->rate_cache = clk_rate_from_parent_rate(c,
+						c->parent->rate_cache);
+	else
+		c->rate_cache = c->rate;
+
+	list_for_each_entry(child, &c->children, sibling)
+		__clk_rate_publish(child);
+}
+
+static void clk_rate_publish(struct clk *c)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&clk_rate_lock, flags);
+	__clk_rate_publish(c);
+	write_sequnlock_irqrestore(&clk_rate_lock, flags);
+}
+
+/* statically defined clocks may be linked in before their own init */
+static void clk_children_init(struct clk *c)
+{
+	if (!c->children.next)
+		INIT_LIST_HEAD(&c->children);
+}
+
+/* Must be called with clk_rate_lock held for writing */
+static void __clk_rate_link(struct clk *c)
+{
+	if (c->sibling.next)
+		list_del(&c->sibling);
+
+	if (c->parent) {
+		clk_children_init(c->parent);
+		list_add_tail(&c->sibling, &c->parent->children);
+	} else {
+		INIT_LIST_HEAD(&c->sibling);
+	}
+}
+
+/*
+ * For code that changed c->parent or c->rate behind the clock framework,
+ * e.g. re-reading the hardware state on resume.
+ */
+void clk_rate_resync(struct clk *c)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&clk_rate_lock, flags);
+	__clk_rate_link(c);
+	__clk_rate_publish(c);
+	write_sequnlock_irqrestore(&clk_rate_lock, flags);
+}
+
 unsigned long clk_get_max_rate(struct clk *c)
 {
 		return c->max_rate;
@@ -155,14 +241,13 @@ unsigned long clk_get_rate_locked(struct clk *c)
 
 unsigned long clk_get_rate(struct clk *c)
 {
-	unsigned long flags;
 	unsigned long rate;
+	unsigned seq;
 
-	clk_lock_save(c, &flags);
-
-	rate = clk_get_rate_locked(c);
-
-	clk_unlock_restore(c, &flags);
+	do {
+		seq = read_seqbegin(&clk_rate_lock);
+		rate = c->rate_cache;
+	} while (read_seqretry(&clk_rate_lock, seq));
 
 	return rate;
 }
@@ -208,17 +293,29 @@ void clk_set_cansleep(struct clk *c)
 
 int clk_reparent(struct clk *c, struct clk *parent)
 {
+	unsigned long flags;
+
+	write_seqlock_irqsave(&clk_rate_lock, flags);
 	c->parent = parent;
+	/* not linked yet if called from the init op */
+	if (c->sibling.next) {
+		__clk_rate_link(c);
+		__clk_rate_publish(c);
+	}
+	write_sequnlock_irqrestore(&clk_rate_lock, flags);
 	return 0;
 }
 
 void clk_init(struct clk *c)
 {
 	clk_lock_init(c);
+	clk_children_init(c);
 
 	if (c->ops && c->ops->init)
 		c->ops->init(c);
 
+	clk_rate_resync(c);
+
 	if (!c->ops || !c->ops->enable) {
 		c->refcnt++;
 		c->set = true;
@@ -382,6 +479,7 @@ int clk_set_parent(struct clk *c, struct clk *parent)
 	}
 
 	ret = c->ops->set_parent(c, parent);
+	clk_rate_publish(c);
 	if (ret)
 		goto out;
 
@@ -406,29 +504,33 @@ struct clk *clk_get_parent(struct clk *c)
 }
 EXPORT_SYMBOL(clk_get_parent);
 
+/* Must be called with clk_lock(c) held */
+static long clk_round_rate_locked(struct clk *c, unsigned long rate)
+{
+	unsigned long max_rate = clk_get_max_rate(c);
+
+	if (rate > max_rate)
+		rate = max_rate;
+
+	if (c->ops && c->ops->round_rate)
+		return c->ops->round_rate(c, rate);
+
+	return rate;
+}
+
 int clk_set_rate_locked(struct clk *c, unsigned long rate)
 {
 	int ret = 0;
-	unsigned long old_rate, max_rate;
+	unsigned long old_rate;
 	long new_rate;
 	bool disable = false;
 
 	old_rate = clk_get_rate_locked(c);
 
-	max_rate = clk_get_max_rate(c);
-	if (rate > max_rate)
-		rate = max_rate;
-
-	if (c->ops && c->ops->round_rate) {
-		new_rate = c->ops->round_rate(c, rate);
-
-		if (new_rate < 0) {
-			ret = new_rate;
-			return ret;
-		}
-
-		rate = new_rate;
-	}
+	new_rate = clk_round_rate_locked(c, rate);
+	if (new_rate < 0)
+		return new_rate;
+	rate = new_rate;
 
 	/* The new clock control register setting does not take effect if
 	 * clock is disabled. Later, when the clock is enabled it would run
@@ -453,6 +555,7 @@ int clk_set_rate_locked(struct clk *c, unsigned long rate)
 
 	trace_clock_set_rate(c->name, rate, 0);
 	ret = c->ops->set_rate(c, rate);
+	clk_rate_publish(c);
 	if (ret)
 		goto out;
 
@@ -486,6 +589,121 @@ int clk_set_rate(struct clk *c, unsigned long rate)
 }
 EXPORT_SYMBOL(clk_set_rate);
 
+/*
+ * Rate transactions. While a transaction runs, shared bus updates caused
+ * by its own rate changes are only collected, and each bus is updated
+ * once at the end: setting 3d, 3d2, 2d and epp moves cbus (and relocks
+ * its PLL) once instead of four times. Voltage for all clocks of the
+ * group that go up is requested before any rate changes, in a single
+ * dvfs pass.
+ */
+#define CLK_TXN_MAX_CLOCKS	16
+#define CLK_TXN_MAX_BUSES	8
+
+static DEFINE_MUTEX(clk_txn_lock);
+static struct {
+	struct task_struct *owner;
+	int nr_buses;
+	struct clk *buses[CLK_TXN_MAX_BUSES];
+} clk_txn;
+
+/* true if the update of bus is left to the running transaction */
+static bool clk_txn_defer_bus(struct clk *bus)
+{
+	int i;
+
+	if (ACCESS_ONCE(clk_txn.owner) != current)
+		return false;
+
+	for (i = 0; i < clk_txn.nr_buses; i++)
+		if (clk_txn.buses[i] == bus)
+			return true;
+
+	if (clk_txn.nr_buses == CLK_TXN_MAX_BUSES)
+		return false;
+
+	clk_txn.buses[clk_txn.nr_buses++] = bus;
+	return true;
+}
+
+static bool clk_txn_dvfs_raise(struct clk *c, unsigned long rate)
+{
+	unsigned long flags;
+	long new_rate;
+	bool raised = false;
+
+	clk_lock_save(c, &flags);
+
+	if (clk_is_auto_dvfs(c) && (c->refcnt > 0)) {
+		new_rate = clk_round_rate_locked(c, rate);
+		if ((new_rate > 0) && (new_rate > clk_get_rate_locked(c)))
+			raised = tegra_dvfs_raise_rate(c, new_rate) > 0;
+	}
+
+	clk_unlock_restore(c, &flags);
+	return raised;
+}
+
+/* drop a raised voltage request the rate change did not follow */
+static void clk_txn_dvfs_restore(struct clk *c)
+{
+	unsigned long flags;
+
+	clk_lock_save(c, &flags);
+	if (clk_is_auto_dvfs(c) && (c->refcnt > 0))
+		tegra_dvfs_set_rate(c, clk_get_rate_locked(c));
+	clk_unlock_restore(c, &flags);
+}
+
+int tegra_clk_set_rates(struct tegra_clk_rate *rates, int n)
+{
+	bool raised[CLK_TXN_MAX_CLOCKS];
+	int i, ret, err = 0;
+
+	if (n > CLK_TXN_MAX_CLOCKS)
+		return -EINVAL;
+
+	mutex_lock(&clk_txn_lock);
+
+	for (i = 0; i < n; i++)
+		raised[i] = clk_txn_dvfs_raise(rates[i].clk, rates[i].rate);
+
+	if (tegra_dvfs_apply()) {
+		/* let each rate change ramp (and report) on its own */
+		for (i = 0; i < n; i++) {
+			if (raised[i])
+				clk_txn_dvfs_restore(rates[i].clk);
+			raised[i] = false;
+		}
+	}
+
+	clk_txn.owner = current;
+	clk_txn.nr_buses = 0;
+
+	for (i = 0; i < n; i++) {
+		ret = clk_set_rate(rates[i].clk, rates[i].rate);
+		if (ret) {
+			if (raised[i])
+				clk_txn_dvfs_restore(rates[i].clk);
+			if (!err)
+				err = ret;
+		}
+	}
+
+	clk_txn.owner = NULL;
+
+	for (i = 0; i < clk_txn.nr_buses; i++) {
+		ret = tegra_clk_shared_bus_update(clk_txn.buses[i]);
+		if (ret && !err)
+			err = ret;
+	}
+
+	mutex_unlock(&clk_txn_lock);
+
+	return err;
+}
+EXPORT_SYMBOL(tegra_clk_set_rates);
+
 /* Must be called with clocks lock and all indvidual clock locks held */
 unsigned long clk_get_rate_all_locked(struct clk *c)
 {
@@ -512,7 +730,7 @@ unsigned long clk_get_rate_all_locked(struct clk *c)
 
 long clk_round_rate(struct clk *c, unsigned long rate)
 {
-	unsigned long flags, max_rate;
+	unsigned long flags;
 	long ret;
 
 	clk_lock_save(c, &flags);
@@ -522,11 +740,7 @@ long clk_round_rate(struct clk *c, unsigned long rate)
 		goto out;
 	}
 
-	max_rate = clk_get_max_rate(c);
-	if (rate > max_rate)
-		rate = max_rate;
-
-	ret = c->ops->round_rate(c, rate);
+	ret = clk_round_rate_locked(c, rate);
 
 out:
 	clk_unlock_restore(c, &flags);
@@ -650,6 +864,9 @@ int tegra_clk_shared_bus_update(struct clk *c)
 	int ret = 0;
 	unsigned long flags;
 
+	if (clk_txn_defer_bus(c))
+		return 0;
+
 	clk_lock_save(c, &flags);
 
 	if (c->ops && c->ops->shared_bus_update)
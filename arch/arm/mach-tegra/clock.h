@@ -141,6 +141,11 @@ struct clk {
 	struct clk		*parent;
 	u32			div;
 	u32			mul;
+
+	/* rate cache, updated under clk_rate_lock */
+	struct list_head	children;
+	struct list_head	sibling;
+	unsigned long		rate_cache;
 	struct clk_stats 	stats;
 
 	const struct clk_mux_sel	*inputs;
@@ -222,6 +227,7 @@ void clk_init(struct clk *clk);
 struct clk *tegra_get_clock_by_name(const char *name);
 unsigned long clk_measure_input_freq(void);
 int clk_reparent(struct clk *c, struct clk *parent);
+void clk_rate_resync(struct clk *c);
 void tegra_clk_init_from_table(struct tegra_clk_init_table *table);
 void clk_set_cansleep(struct clk *c);
 unsigned long clk_get_max_rate(struct clk *c);
@@ -32,15 +32,28 @@
 #include <linux/clk.h>
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/irq_work.h>
+#include <linux/sched_energy.h>
+
+#include <mach/edp.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/tegra_hotplug.h>
 
 #include "pm.h"
 #include "cpu-tegra.h"
 #include "clock.h"
+#include "dvfs.h"
 
 #define INITIAL_STATE		TEGRA_HP_DISABLED
 #define UP2G0_DELAY_MS		200
 #define UP2Gn_DELAY_MS		1000
 #define DOWN_DELAY_MS		2000
+#define NR_RUN_SAMPLE_MS	20
+#define NR_RUN_WINDOW		8	/* samples */
 
 static struct mutex *tegra3_cpu_lock;
 
@@ -68,6 +81,19 @@ module_param(mp_overhead, int, 0644);
 static int balance_level = 75;
 module_param(balance_level, int, 0644);
 
+/*
+ * Runnable thread hysteresis, in hundredths of a thread: ask for one more
+ * core once the windowed nr_running average exceeds the online cores by
+ * nr_run_up_margin, give one back once it is nr_run_down_margin below
+ * what one core less could run.
+ */
+static unsigned int nr_run_sample_ms = NR_RUN_SAMPLE_MS;
+static unsigned int nr_run_up_margin = 25;
+static unsigned int nr_run_down_margin = 25;
+module_param(nr_run_sample_ms, uint, 0644);
+module_param(nr_run_up_margin, uint, 0644);
+module_param(nr_run_down_margin, uint, 0644);
+
 static struct clk *cpu_clk;
 static struct clk *cpu_g_clk;
 static struct clk *cpu_lp_clk;
@@ -76,8 +102,16 @@ static struct {
 	cputime64_t time_up_total;
 	u64 last_update;
 	unsigned int up_down_count;
+	/* time from the hotplug becoming necessary to it being done */
+	u64 decision_total_us;
+	u32 decision_max_us;
+	unsigned int decision_count;
 } hp_stats[CONFIG_NR_CPUS + 1];	/* Append LP CPU entry at the end */
 
+/* when the pending hotplug step became necessary, 0 if none */
+static DEFINE_SPINLOCK(hp_trigger_lock);
+static ktime_t hp_trigger;
+
 static void hp_init_stats(void)
 {
 	int i;
@@ -86,6 +120,9 @@ static void hp_init_stats(void)
 	for (i = 0; i <= CONFIG_NR_CPUS; i++) {
 		hp_stats[i].time_up_total = 0;
 		hp_stats[i].last_update = cur_jiffies;
+		hp_stats[i].decision_total_us = 0;
+		hp_stats[i].decision_max_us = 0;
+		hp_stats[i].decision_count = 0;
 
 		hp_stats[i].up_down_count = 0;
 		if (is_lp_cluster()) {
@@ -122,6 +159,25 @@ static void hp_stats_update(unsigned int cpu, bool up)
 	hp_stats[cpu].last_update = cur_jiffies;
 }
 
+static void hp_trigger_start(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&hp_trigger_lock, flags);
+	if (!hp_trigger.tv64)
+		hp_trigger = ktime_get();
+	spin_unlock_irqrestore(&hp_trigger_lock, flags);
+}
+
+static void hp_trigger_clear(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&hp_trigger_lock, flags);
+	hp_trigger.tv64 = 0;
+	spin_unlock_irqrestore(&hp_trigger_lock, flags);
+}
+
 
 enum {
 	TEGRA_HP_DISABLED = 0,
@@ -130,6 +186,88 @@ enum {
 	TEGRA_HP_UP,
 };
 static int hp_state;
+static bool hp_suspended;
+
+/* called with tegra3_cpu_lock held once a hotplug step has completed */
+static void hp_stats_latency(unsigned int cpu, bool up)
+{
+	unsigned long flags;
+	ktime_t now = ktime_get();
+	ktime_t start;
+	u32 us;
+
+	spin_lock_irqsave(&hp_trigger_lock, flags);
+	start = hp_trigger.tv64 ? hp_trigger : now;
+	/* a follow-up step in the same direction is needed from now on */
+	if ((hp_state == TEGRA_HP_UP) || (hp_state == TEGRA_HP_DOWN))
+		hp_trigger = now;
+	else
+		hp_trigger.tv64 = 0;
+	spin_unlock_irqrestore(&hp_trigger_lock, flags);
+
+	us = (u32)ktime_us_delta(now, start);
+	hp_stats[cpu].decision_total_us += us;
+	hp_stats[cpu].decision_max_us = max(hp_stats[cpu].decision_max_us, us);
+	hp_stats[cpu].decision_count++;
+
+	trace_tegra_hotplug_done(cpu, up, us);
+}
+
+enum {
+	NR_RUN_DOWN = -1,
+	NR_RUN_HOLD = 0,
+	NR_RUN_UP = 1,
+};
+
+static struct timer_list nr_run_timer;
+static unsigned int nr_run_samples[NR_RUN_WINDOW];
+static unsigned int nr_run_idx;
+static unsigned int nr_run_sum;
+static unsigned int nr_run_avg;		/* runnable threads x 100 */
+static int nr_run_last = NR_RUN_HOLD;
+
+static int tegra_cpu_nr_run_balance(void)
+{
+	unsigned int avg = ACCESS_ONCE(nr_run_avg);
+	unsigned int n = num_online_cpus();
+
+	if (avg > n * 100 + nr_run_up_margin)
+		return NR_RUN_UP;
+	if ((n > 1) && (avg + nr_run_down_margin < (n - 1) * 100))
+		return NR_RUN_DOWN;
+	return NR_RUN_HOLD;
+}
+
+static void tegra_nr_run_sample(unsigned long data)
+{
+	unsigned int sample = nr_running() * 100;
+	int nr_run;
+
+	nr_run_sum += sample - nr_run_samples[nr_run_idx];
+	nr_run_samples[nr_run_idx] = sample;
+	nr_run_idx = (nr_run_idx + 1) % NR_RUN_WINDOW;
+	nr_run_avg = nr_run_sum / NR_RUN_WINDOW;
+
+	if (hp_state == TEGRA_HP_DISABLED) {
+		nr_run_last = NR_RUN_HOLD;
+		return;
+	}
+
+	/*
+	 * More threads than cores: re-evaluate now instead of waiting out
+	 * up2gn_delay, the work itself applies the speed/EDP checks.
+	 */
+	nr_run = hp_suspended ? NR_RUN_HOLD : tegra_cpu_nr_run_balance();
+	if ((nr_run == NR_RUN_UP) && (nr_run_last != NR_RUN_UP)) {
+		hp_trigger_start();
+		cancel_delayed_work(&hotplug_work);
+		queue_delayed_work(hotplug_wq, &hotplug_work, 0);
+	}
+	nr_run_last = nr_run;
+
+	mod_timer(&nr_run_timer,
+		  jiffies + msecs_to_jiffies(nr_run_sample_ms));
+}
 
 static int hp_state_set(const char *arg, const struct kernel_param *kp)
 {
@@ -155,8 +293,11 @@ static int hp_state_set(const char *arg, const struct kernel_param *kp)
 		case TEGRA_HP_UP:
 			if (old_state == TEGRA_HP_DISABLED) {
 				hp_init_stats();
+				hp_trigger_clear();
 				queue_delayed_work(
 					hotplug_wq, &hotplug_work, down_delay);
+				mod_timer(&nr_run_timer, jiffies +
+					  msecs_to_jiffies(nr_run_sample_ms));
 				pr_info("Tegra auto-hotplug enabled\n");
 			}
 			break;
@@ -181,11 +322,273 @@ static struct kernel_param_ops tegra_hp_state_ops = {
 };
 module_param_cb(auto_hotplug, &tegra_hp_state_ops, &hp_state, 0644);
 
+#ifdef CONFIG_TEGRA_ENERGY_MODEL
+/*
+ * Energy model of the G and LP clusters for the scheduler. Both run
+ * Cortex-A9 cores, so capacity is proportional to frequency with the
+ * fastest G rate as SCHED_LOAD_SCALE. Busy power is C*V^2*f from the
+ * dvfs tables, with the switched capacitance of one core estimated per
+ * cluster, and the G capacity is capped by the EDP limit for the CPUs
+ * on-line. All CPUs share one clock and one cluster at a time, so the
+ * cluster and current capacity are cached globally.
+ */
+static unsigned int g_cdyn_pf = 530;
+static unsigned int lp_cdyn_pf = 380;
+module_param(g_cdyn_pf, uint, 0444);
+module_param(lp_cdyn_pf, uint, 0444);
+
+/* stay on (go to) LP while the load needs less than this % of it */
+static unsigned int energy_lp_pct = 60;
+module_param(energy_lp_pct, uint, 0644);
+
+static struct sched_energy_opp energy_g_opp[MAX_DVFS_FREQS];
+static struct sched_energy_opp energy_lp_opp[MAX_DVFS_FREQS];
+
+static struct sched_energy_cluster energy_g = {
+	.name	= "G",
+	.opp	= energy_g_opp,
+};
+
+static struct sched_energy_cluster energy_lp = {
+	.name	= "LP",
+	.opp	= energy_lp_opp,
+};
+
+static struct sched_energy_cluster *energy_cluster = &energy_g;
+static unsigned long energy_cap_cur = SCHED_LOAD_SCALE;
+static unsigned long energy_g_max_khz;
+static bool energy_registered;
+static bool energy_up_pending;
+static struct irq_work energy_irq_work;
+
+static struct {
+	unsigned int overutilized;	/* task outgrew LP */
+	unsigned int up_early;		/* hotplug runs acting on it */
+	unsigned int lp_hold;		/* stayed on LP despite the speed */
+	unsigned int g_hold;		/* stayed on G despite the speed */
+} energy_stats;
+
+static inline unsigned long energy_khz_to_cap(unsigned long khz)
+{
+	return khz * SCHED_LOAD_SCALE / energy_g_max_khz;
+}
+
+static int energy_build_cluster(struct sched_energy_cluster *cl,
+				struct clk *c, unsigned int cdyn_pf)
+{
+	struct dvfs *d = c->dvfs;
+	unsigned long max_khz = clk_get_max_rate(c) / 1000;
+	unsigned long khz, prev_khz = 0;
+	struct sched_energy_opp *opp;
+	u64 mw;
+	int i, mv;
+
+	if (!d || !d->num_freqs)
+		return -ENODEV;
+
+	for (i = 0; i < d->num_freqs; i++) {
+		khz = min(d->freqs[i] / 1000, max_khz);
+		/* padding entries, and rates the clock never runs at */
+		if ((khz <= prev_khz) || !energy_khz_to_cap(khz))
+			continue;
+		prev_khz = khz;
+
+		mv = d->millivolts[i];
+		opp = &cl->opp[cl->nr_opp++];
+		opp->cap = energy_khz_to_cap(khz);
+		/* mW = pF * mV^2 * MHz / 10^9 */
+		mw = div_u64((u64)cdyn_pf * mv * mv * (khz / 1000), 1000000000);
+		opp->power = max_t(unsigned long, mw, 1);
+	}
+
+	if (!cl->nr_opp)
+		return -ENODEV;
+
+	cl->cap_max = cl->opp[cl->nr_opp - 1].cap;
+	return 0;
+}
+
+/* refresh cluster, EDP cap and current capacity, any context */
+static void energy_update(unsigned int khz)
+{
+	unsigned int edp = tegra_get_edp_limit();
+	unsigned long cap;
+
+	if (!energy_registered)
+		return;
+
+	cap = energy_g.opp[energy_g.nr_opp - 1].cap;
+	if (edp && (edp < energy_g_max_khz))
+		cap = energy_khz_to_cap(edp);
+	ACCESS_ONCE(energy_g.cap_max) = cap;
+
+	ACCESS_ONCE(energy_cluster) = is_lp_cluster() ? &energy_lp : &energy_g;
+	if (khz)
+		ACCESS_ONCE(energy_cap_cur) = energy_khz_to_cap(khz);
+}
+
+static struct sched_energy_cluster *energy_cpu_cluster(int cpu)
+{
+	return ACCESS_ONCE(energy_cluster);
+}
+
+static unsigned long energy_cpu_cap(int cpu)
+{
+	return ACCESS_ONCE(energy_cap_cur);
+}
+
+/* called by the scheduler with a rq lock held */
+static void energy_overutilized(int cpu, unsigned long demand)
+{
+	if ((ACCESS_ONCE(energy_cluster) != &energy_lp) || no_lp ||
+	    (hp_state == TEGRA_HP_DISABLED) || hp_suspended ||
+	    ACCESS_ONCE(energy_up_pending))
+		return;
+
+	energy_up_pending = true;
+	energy_stats.overutilized++;
+	irq_work_queue(&energy_irq_work);
+}
+
+static void energy_irq_work_func(struct irq_work *work)
+{
+	hp_trigger_start();
+	cancel_delayed_work(&hotplug_work);
+	queue_delayed_work(hotplug_wq, &hotplug_work, 0);
+}
+
+static const struct sched_energy_model tegra_energy_model = {
+	.cpu_cluster	= energy_cpu_cluster,
+	.cpu_cap	= energy_cpu_cap,
+	.overutilized	= energy_overutilized,
+};
+
+/* demand of all CPUs on-line at the current rate, in G capacity units */
+static unsigned long energy_load(void)
+{
+	unsigned long demand = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		demand += sched_cpu_util(cpu);
+
+	return (demand * ACCESS_ONCE(energy_cap_cur)) >> SCHED_LOAD_SHIFT;
+}
+
+static bool energy_fits_lp(void)
+{
+	return energy_load() * 100 <= energy_lp.cap_max * energy_lp_pct;
+}
+
+/* called with tegra3_cpu_lock held by the hotplug work */
+static bool energy_take_up_pending(void)
+{
+	bool pending = ACCESS_ONCE(energy_up_pending);
+
+	if (pending) {
+		energy_up_pending = false;
+		energy_stats.up_early++;
+	}
+	return pending;
+}
+
+/* the governor wants G speed, but the load is light enough for LP */
+static bool energy_hold_lp(int nr_run, bool up_early)
+{
+	if (!energy_registered || up_early || (nr_run == NR_RUN_UP) ||
+	    !energy_fits_lp())
+		return false;
+
+	energy_stats.lp_hold++;
+	return true;
+}
+
+/* the governor is at LP speed, but the load would not fit LP */
+static bool energy_hold_g(void)
+{
+	if (!energy_registered || energy_fits_lp())
+		return false;
+
+	energy_stats.g_hold++;
+	return true;
+}
+
+static int energy_cpufreq_notify(struct notifier_block *nb,
+				 unsigned long event, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+
+	if (event == CPUFREQ_POSTCHANGE)
+		energy_update(freqs->new);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block energy_cpufreq_nb = {
+	.notifier_call = energy_cpufreq_notify,
+};
+
+static int tegra_energy_init(void)
+{
+	int ret;
+
+	energy_g_max_khz = clk_get_max_rate(cpu_g_clk) / 1000;
+	if (!energy_g_max_khz)
+		return -EINVAL;
+
+	ret = energy_build_cluster(&energy_g, cpu_g_clk, g_cdyn_pf);
+	if (!ret)
+		ret = energy_build_cluster(&energy_lp, cpu_lp_clk, lp_cdyn_pf);
+	if (ret) {
+		pr_err("%s: no dvfs table for the cpu clusters\n", __func__);
+		return ret;
+	}
+
+	init_irq_work(&energy_irq_work, energy_irq_work_func);
+	cpufreq_register_notifier(&energy_cpufreq_nb,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+
+	energy_registered = true;
+	energy_update(clk_get_rate(cpu_clk) / 1000);
+	sched_energy_register(&tegra_energy_model);
+
+	return 0;
+}
+
+static void tegra_energy_exit(void)
+{
+	if (!energy_registered)
+		return;
+
+	sched_energy_register(NULL);
+	synchronize_sched();
+	cpufreq_unregister_notifier(&energy_cpufreq_nb,
+				    CPUFREQ_TRANSITION_NOTIFIER);
+	irq_work_sync(&energy_irq_work);
+	energy_registered = false;
+}
+#else
+static inline void energy_update(unsigned int khz)
+{ }
+static inline bool energy_take_up_pending(void)
+{ return false; }
+static inline bool energy_hold_lp(int nr_run, bool up_early)
+{ return false; }
+static inline bool energy_hold_g(void)
+{ return false; }
+static inline int tegra_energy_init(void)
+{ return 0; }
+static inline void tegra_energy_exit(void)
+{ }
+#endif
+
 
 enum {
 	TEGRA_CPU_SPEED_BALANCED,
 	TEGRA_CPU_SPEED_BIASED,
 	TEGRA_CPU_SPEED_SKEWED,
+	TEGRA_CPU_SPEED_EDP_HOLD,
+	TEGRA_CPU_SPEED_EDP_DOWN,
 };
 
 static noinline int tegra_cpu_speed_balance(void)
@@ -197,28 +600,85 @@ static noinline int tegra_cpu_speed_balance(void)
 
 	/* balanced: freq targets for all CPUs are above 50% of highest speed
 	   biased: freq target for at least one CPU is below 50% threshold
-	   skewed: freq targets for at least 2 CPUs are below 25% threshold */
-	if ((tegra_count_slow_cpus(skewed_speed) >= 2) ||
-	    tegra_cpu_edp_favor_down(nr_cpus, mp_overhead))
+	   skewed: freq targets for at least 2 CPUs are below 25% threshold
+	   edp down: EDP limits favor one core less, whatever the load
+	   edp hold: EDP limits don't favor one core more */
+	if (tegra_cpu_edp_favor_down(nr_cpus, mp_overhead))
+		return TEGRA_CPU_SPEED_EDP_DOWN;
+	else if (tegra_count_slow_cpus(skewed_speed) >= 2)
 		return TEGRA_CPU_SPEED_SKEWED;
-	else if ((tegra_count_slow_cpus(balanced_speed) >= 1) ||
-		 (!tegra_cpu_edp_favor_up(nr_cpus, mp_overhead)))
+	else if (!tegra_cpu_edp_favor_up(nr_cpus, mp_overhead))
+		return TEGRA_CPU_SPEED_EDP_HOLD;
+	else if (tegra_count_slow_cpus(balanced_speed) >= 1)
 		return TEGRA_CPU_SPEED_BIASED;
 	return TEGRA_CPU_SPEED_BALANCED;
 }
 
+/* called with tegra3_cpu_lock held */
+static void tegra_auto_hotplug_to_g(void)
+{
+	if (!clk_set_parent(cpu_clk, cpu_g_clk)) {
+		hp_stats_update(CONFIG_NR_CPUS, false);
+		hp_stats_update(0, true);
+		hp_stats_latency(0, true);
+		energy_update(0);
+		/* catch-up with governor target speed */
+		tegra_cpu_set_speed_cap(NULL);
+	}
+}
+
 static void tegra_auto_hotplug_work_func(struct work_struct *work)
 {
 	bool up = false;
+	bool up_early;
 	unsigned int cpu = nr_cpu_ids;
+	int nr_run, speed = -1;
+	int ret;
 
 	mutex_lock(tegra3_cpu_lock);
 
+	nr_run = tegra_cpu_nr_run_balance();
+	/* a task has outgrown the LP CPU, don't wait for the governor */
+	up_early = energy_take_up_pending() && is_lp_cluster();
+
 	switch (hp_state) {
 	case TEGRA_HP_DISABLED:
+		break;
 	case TEGRA_HP_IDLE:
+		/* speed is in the dead band, runnable threads alone decide,
+		   as far as the EDP limits let them */
+		if (((nr_run != NR_RUN_UP) && !up_early) || hp_suspended) {
+			hp_trigger_clear();
+			break;
+		}
+		if (is_lp_cluster()) {
+			if (no_lp) {
+				hp_trigger_clear();
+				break;
+			}
+			tegra_auto_hotplug_to_g();
+		} else {
+			cpu = cpumask_next_zero(0, cpu_online_mask);
+			if ((cpu >= nr_cpu_ids) || !tegra_cpu_edp_favor_up(
+					num_online_cpus(), mp_overhead)) {
+				/* nothing more to bring up, stop polling */
+				cpu = nr_cpu_ids;
+				hp_trigger_clear();
+				break;
+			}
+			up = true;
+			hp_stats_update(cpu, true);
+		}
+		queue_delayed_work(
+			hotplug_wq, &hotplug_work, up2gn_delay);
 		break;
 	case TEGRA_HP_DOWN:
+		/* low speed, but more threads than cores - hold on to them */
+		if (nr_run == NR_RUN_UP) {
+			queue_delayed_work(
+				hotplug_wq, &hotplug_work, down_delay);
+			break;
+		}
 		cpu = tegra_get_slowest_cpu_n();
 		if (cpu < nr_cpu_ids) {
 			up = false;
@@ -226,9 +686,12 @@ static void tegra_auto_hotplug_work_func(struct work_struct *work)
 				hotplug_wq, &hotplug_work, down_delay);
 			hp_stats_update(cpu, false);
 		} else if (!is_lp_cluster() && !no_lp) {
-			if(!clk_set_parent(cpu_clk, cpu_lp_clk)) {
+			if (!energy_hold_g() &&
+			    !clk_set_parent(cpu_clk, cpu_lp_clk)) {
 				hp_stats_update(CONFIG_NR_CPUS, true);
 				hp_stats_update(0, false);
+				hp_stats_latency(CONFIG_NR_CPUS, true);
+				energy_update(0);
 			} else
 				queue_delayed_work(
 					hotplug_wq, &hotplug_work, down_delay);
@@ -236,32 +699,45 @@ static void tegra_auto_hotplug_work_func(struct work_struct *work)
 		break;
 	case TEGRA_HP_UP:
 		if (is_lp_cluster() && !no_lp) {
-			if(!clk_set_parent(cpu_clk, cpu_g_clk)) {
-				hp_stats_update(CONFIG_NR_CPUS, false);
-				hp_stats_update(0, true);
-				/* catch-up with governor target speed */
-				tegra_cpu_set_speed_cap(NULL);
-			}
+			if (!energy_hold_lp(nr_run, up_early))
+				tegra_auto_hotplug_to_g();
 		} else {
-			switch (tegra_cpu_speed_balance()) {
-			/* cpu speed is up and balanced - one more on-line */
+			speed = tegra_cpu_speed_balance();
+			switch (speed) {
+			/* cpu speed is up, but under-utilized - on-line one
+			   more only if threads are queueing for the cores */
+			case TEGRA_CPU_SPEED_BIASED:
+				if (nr_run != NR_RUN_UP)
+					break;
+				/* fall through */
+			/* cpu speed is up and balanced - one more on-line,
+			   unless the threads fit in fewer cores */
 			case TEGRA_CPU_SPEED_BALANCED:
+				if (nr_run == NR_RUN_DOWN)
+					break;
 				cpu = cpumask_next_zero(0, cpu_online_mask);
 				if (cpu < nr_cpu_ids) {
 					up = true;
 					hp_stats_update(cpu, true);
 				}
 				break;
-			/* cpu speed is up, but skewed - remove one core */
+			/* cpu speed is up, but skewed - remove one core,
+			   unless threads are queueing for the cores */
 			case TEGRA_CPU_SPEED_SKEWED:
+				if (nr_run == NR_RUN_UP)
+					break;
+				/* fall through */
+			/* over the EDP budget - remove one core, queued
+			   threads or not */
+			case TEGRA_CPU_SPEED_EDP_DOWN:
 				cpu = tegra_get_slowest_cpu_n();
 				if (cpu < nr_cpu_ids) {
 					up = false;
 					hp_stats_update(cpu, false);
 				}
 				break;
-			/* cpu speed is up, but under-utilized - do nothing */
-			case TEGRA_CPU_SPEED_BIASED:
+			/* EDP limits don't favor one more core - hold */
+			case TEGRA_CPU_SPEED_EDP_HOLD:
 			default:
 				break;
 			}
@@ -273,13 +749,22 @@ static void tegra_auto_hotplug_work_func(struct work_struct *work)
 		pr_err("%s: invalid tegra hotplug state %d\n",
 		       __func__, hp_state);
 	}
+
+	trace_tegra_hotplug_decision(hp_state, nr_run_avg, nr_run, speed,
+				     cpu, up);
 	mutex_unlock(tegra3_cpu_lock);
 
 	if (cpu < nr_cpu_ids) {
 		if (up)
-			cpu_up(cpu);
+			ret = cpu_up(cpu);
 		else
-			cpu_down(cpu);
+			ret = cpu_down(cpu);
+
+		if (!ret) {
+			mutex_lock(tegra3_cpu_lock);
+			hp_stats_latency(cpu, up);
+			mutex_unlock(tegra3_cpu_lock);
+		}
 	}
 }
 
@@ -290,8 +775,10 @@ void tegra_auto_hotplug_governor(unsigned int cpu_freq, bool suspend)
 	if (!is_g_cluster_present())
 		return;
 
+	hp_suspended = suspend;
 	if (suspend && (hp_state != TEGRA_HP_DISABLED)) {
 		hp_state = TEGRA_HP_IDLE;
+		hp_trigger_clear();
 		return;
 	}
 
@@ -303,10 +790,12 @@ void tegra_auto_hotplug_governor(unsigned int cpu_freq, bool suspend)
 	case TEGRA_HP_IDLE:
 		if (cpu_freq > idle_top_freq) {
 			hp_state = TEGRA_HP_UP;
+			hp_trigger_start();
 			queue_delayed_work(
 				hotplug_wq, &hotplug_work, up_delay);
 		} else if (cpu_freq <= idle_bottom_freq) {
 			hp_state = TEGRA_HP_DOWN;
+			hp_trigger_start();
 			queue_delayed_work(
 				hotplug_wq, &hotplug_work, down_delay);
 		}
@@ -314,19 +803,25 @@ void tegra_auto_hotplug_governor(unsigned int cpu_freq, bool suspend)
 	case TEGRA_HP_DOWN:
 		if (cpu_freq > idle_top_freq) {
 			hp_state = TEGRA_HP_UP;
+			hp_trigger_clear();
+			hp_trigger_start();
 			queue_delayed_work(
 				hotplug_wq, &hotplug_work, up_delay);
 		} else if (cpu_freq > idle_bottom_freq) {
 			hp_state = TEGRA_HP_IDLE;
+			hp_trigger_clear();
 		}
 		break;
 	case TEGRA_HP_UP:
 		if (cpu_freq <= idle_bottom_freq) {
 			hp_state = TEGRA_HP_DOWN;
+			hp_trigger_clear();
+			hp_trigger_start();
 			queue_delayed_work(
 				hotplug_wq, &hotplug_work, down_delay);
 		} else if (cpu_freq <= idle_top_freq) {
 			hp_state = TEGRA_HP_IDLE;
+			hp_trigger_clear();
 		}
 		break;
 	default:
@@ -348,6 +843,10 @@ int tegra_auto_hotplug_init(struct mutex *cpu_lock)
 		return -ENOMEM;
 	INIT_DELAYED_WORK(&hotplug_work, tegra_auto_hotplug_work_func);
 
+	/* deferrable: no point waking an idle system to count threads */
+	init_timer_deferrable(&nr_run_timer);
+	nr_run_timer.function = tegra_nr_run_sample;
+
 	cpu_clk = clk_get_sys(NULL, "cpu");
 	cpu_g_clk = clk_get_sys(NULL, "cpu_g");
 	cpu_lp_clk = clk_get_sys(NULL, "cpu_lp");
@@ -364,6 +863,7 @@ int tegra_auto_hotplug_init(struct mutex *cpu_lock)
 	tegra3_cpu_lock = cpu_lock;
 	hp_state = INITIAL_STATE;
 	hp_init_stats();
+	tegra_energy_init();
 	pr_info("Tegra auto-hotplug initialized: %s\n",
 		(hp_state == TEGRA_HP_DISABLED) ? "disabled" : "enabled");
 
@@ -407,6 +907,29 @@ static int hp_stats_show(struct seq_file *s, void *data)
 	}
 	seq_printf(s, "\n");
 
+	seq_printf(s, "%-15s ", "decisions:");
+	for (i = 0; i <= CONFIG_NR_CPUS; i++) {
+		seq_printf(s, "%-10u ", hp_stats[i].decision_count);
+	}
+	seq_printf(s, "\n");
+
+	seq_printf(s, "%-15s ", "latency avg us:");
+	for (i = 0; i <= CONFIG_NR_CPUS; i++) {
+		seq_printf(s, "%-10llu ", hp_stats[i].decision_count ?
+			   div_u64(hp_stats[i].decision_total_us,
+				   hp_stats[i].decision_count) : 0);
+	}
+	seq_printf(s, "\n");
+
+	seq_printf(s, "%-15s ", "latency max us:");
+	for (i = 0; i <= CONFIG_NR_CPUS; i++) {
+		seq_printf(s, "%-10u ", hp_stats[i].decision_max_us);
+	}
+	seq_printf(s, "\n");
+
+	seq_printf(s, "%-15s nr_running %u.%02u\n", "window avg:",
+		   nr_run_avg / 100, nr_run_avg % 100);
+
 	seq_printf(s, "%-15s %llu\n", "time-stamp:",
 		   cputime64_to_clock_t(cur_jiffies));
 
@@ -425,6 +948,52 @@ static const struct file_operations hp_stats_fops = {
 	.release	= single_release,
 };
 
+#ifdef CONFIG_TEGRA_ENERGY_MODEL
+static void energy_show_cluster(struct seq_file *s,
+				struct sched_energy_cluster *cl)
+{
+	int i;
+
+	seq_printf(s, "%s: cap_max %lu%s\n", cl->name, cl->cap_max,
+		   (cl == energy_cluster) ? " (active)" : "");
+	seq_printf(s, "  %-8s %-8s\n", "cap", "mW");
+	for (i = 0; i < cl->nr_opp; i++)
+		seq_printf(s, "  %-8lu %-8lu\n", cl->opp[i].cap,
+			   cl->opp[i].power);
+}
+
+static int energy_show(struct seq_file *s, void *data)
+{
+	if (!energy_registered)
+		return 0;
+
+	energy_show_cluster(s, &energy_g);
+	energy_show_cluster(s, &energy_lp);
+
+	seq_printf(s, "\n%-15s %lu\n", "cap now:", energy_cap_cur);
+	seq_printf(s, "%-15s %lu\n", "load:", energy_load());
+	seq_printf(s, "%-15s %u\n", "overutilized:",
+		   energy_stats.overutilized);
+	seq_printf(s, "%-15s %u\n", "up early:", energy_stats.up_early);
+	seq_printf(s, "%-15s %u\n", "LP hold:", energy_stats.lp_hold);
+	seq_printf(s, "%-15s %u\n", "G hold:", energy_stats.g_hold);
+
+	return 0;
+}
+
+static int energy_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, energy_show, inode->i_private);
+}
+
+static const struct file_operations energy_fops = {
+	.open		= energy_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 static int __init tegra_auto_hotplug_debug_init(void)
 {
 	if (!tegra3_cpu_lock)
@@ -438,6 +1007,12 @@ static int __init tegra_auto_hotplug_debug_init(void)
 		"stats", S_IRUGO, hp_debugfs_root, NULL, &hp_stats_fops))
 		goto err_out;
 
+#ifdef CONFIG_TEGRA_ENERGY_MODEL
+	if (!debugfs_create_file(
+		"energy", S_IRUGO, hp_debugfs_root, NULL, &energy_fops))
+		goto err_out;
+#endif
+
 	return 0;
 
 err_out:
@@ -450,6 +1025,9 @@ late_initcall(tegra_auto_hotplug_debug_init);
 
 void tegra_auto_hotplug_exit(void)
 {
+	hp_state = TEGRA_HP_DISABLED;
+	tegra_energy_exit();
+	del_timer_sync(&nr_run_timer);
 	destroy_workqueue(hotplug_wq);
 #ifdef CONFIG_DEBUG_FS
 	debugfs_remove_recursive(hp_debugfs_root);
@@ -0,0 +1,276 @@
+/*
+ * arch/arm/mach-tegra/cpuidle-gov.c
+ *
+ * Residency predicting cpuidle governor for Tegra LP3/LP2
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/pm_qos_params.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/tick.h>
+
+/*
+ * LP2 flushes the caches and power gates the CPU, so waking up before its
+ * target residency costs both latency and energy. The menu governor only
+ * scales the next timer event by a running correction factor; here each
+ * CPU keeps a histogram of the idle intervals that were ended by an
+ * interrupt rather than by the timer, and a state is only chosen when the
+ * next timer event is far enough away and the history says an interrupt
+ * is unlikely to arrive before the state pays off.
+ *
+ * Buckets are powers of two in us: bucket b holds intervals in
+ * [2^b, 2^(b+1)) us, the last bucket everything longer.
+ */
+
+#define IDLE_HIST_BUCKETS	20
+#define IDLE_HIST_MAX		1024	/* halve the histogram past this */
+
+/* % of past wakeups allowed to land before a state's target residency */
+static unsigned int early_wake_pct = 25;
+module_param(early_wake_pct, uint, 0644);
+
+/* wakeups this close to the next timer event are counted as the timer */
+static unsigned int timer_slack_us = 200;
+module_param(timer_slack_us, uint, 0644);
+
+struct tegra_idle_gov_cpu {
+	/* prediction */
+	unsigned int hist[IDLE_HIST_BUCKETS];	/* interrupt wakeups */
+	unsigned int hist_timer;		/* timer wakeups */
+	unsigned int hist_total;
+
+	/* last selection */
+	int last_idx;
+	int deepest_idx;	/* deepest state the timer alone allowed */
+	unsigned int expected_us;
+	bool needs_update;
+
+	/* statistics */
+	unsigned long entries[CPUIDLE_STATE_MAX];
+	u64 time_us[CPUIDLE_STATE_MAX];
+	unsigned long too_deep[CPUIDLE_STATE_MAX];
+	unsigned long too_shallow[CPUIDLE_STATE_MAX];
+	unsigned long timer_wakeups;
+	unsigned long irq_wakeups;
+};
+
+static DEFINE_PER_CPU(struct tegra_idle_gov_cpu, idle_gov_cpu);
+
+static inline int idle_hist_bucket(unsigned int us)
+{
+	int b = us ? fls(us) - 1 : 0;
+
+	return min(b, IDLE_HIST_BUCKETS - 1);
+}
+
+/* % of recorded wakeups that came earlier than residency_us */
+static unsigned int idle_gov_early_pct(struct tegra_idle_gov_cpu *data,
+				       unsigned int residency_us)
+{
+	unsigned int early = 0;
+	int b, last;
+
+	if (!data->hist_total)
+		return 0;
+
+	/* only buckets that lie entirely below the residency */
+	last = idle_hist_bucket(residency_us);
+	for (b = 0; b < last; b++)
+		early += data->hist[b];
+
+	return early * 100 / data->hist_total;
+}
+
+static void idle_gov_update(struct cpuidle_device *dev)
+{
+	struct tegra_idle_gov_cpu *data = &__get_cpu_var(idle_gov_cpu);
+	struct cpuidle_state *s = &dev->states[data->last_idx];
+	unsigned int measured_us = cpuidle_get_last_residency(dev);
+	int i;
+
+	data->entries[data->last_idx]++;
+	data->time_us[data->last_idx] += measured_us;
+
+	if (measured_us + timer_slack_us + s->exit_latency >=
+	    data->expected_us) {
+		data->timer_wakeups++;
+		data->hist_timer++;
+	} else {
+		data->irq_wakeups++;
+		data->hist[idle_hist_bucket(measured_us)]++;
+	}
+
+	if (++data->hist_total > IDLE_HIST_MAX) {
+		data->hist_total = 0;
+		for (i = 0; i < IDLE_HIST_BUCKETS; i++) {
+			data->hist[i] >>= 1;
+			data->hist_total += data->hist[i];
+		}
+		data->hist_timer >>= 1;
+		data->hist_total += data->hist_timer;
+	}
+
+	/* mispredictions: paid for a state too deep, or missed a deeper one */
+	if (measured_us < s->target_residency) {
+		data->too_deep[data->last_idx]++;
+	} else {
+		for (i = data->deepest_idx; i > data->last_idx; i--) {
+			if (measured_us >= dev->states[i].target_residency) {
+				data->too_shallow[data->last_idx]++;
+				break;
+			}
+		}
+	}
+}
+
+static int tegra_idle_gov_select(struct cpuidle_device *dev)
+{
+	struct tegra_idle_gov_cpu *data = &__get_cpu_var(idle_gov_cpu);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	int i;
+
+	if (data->needs_update) {
+		idle_gov_update(dev);
+		data->needs_update = false;
+	}
+
+	data->last_idx = 0;
+	data->deepest_idx = 0;
+	data->expected_us = ktime_to_us(tick_nohz_get_sleep_length());
+
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	/* an interrupt is already on its way back in */
+	if (local_softirq_pending())
+		return 0;
+
+	for (i = CPUIDLE_DRIVER_STATE_START; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->target_residency > data->expected_us)
+			continue;
+
+		data->deepest_idx = i;
+
+		if (idle_gov_early_pct(data, s->target_residency) >
+		    early_wake_pct)
+			continue;
+
+		data->last_idx = i;
+	}
+
+	return data->last_idx;
+}
+
+static void tegra_idle_gov_reflect(struct cpuidle_device *dev)
+{
+	struct tegra_idle_gov_cpu *data = &__get_cpu_var(idle_gov_cpu);
+
+	data->needs_update = true;
+}
+
+static int tegra_idle_gov_enable(struct cpuidle_device *dev)
+{
+	struct tegra_idle_gov_cpu *data = &per_cpu(idle_gov_cpu, dev->cpu);
+
+	memset(data, 0, sizeof(*data));
+
+	return 0;
+}
+
+static struct cpuidle_governor tegra_idle_governor = {
+	.name =		"tegra",
+	.rating =	30,
+	.enable =	tegra_idle_gov_enable,
+	.select =	tegra_idle_gov_select,
+	.reflect =	tegra_idle_gov_reflect,
+	.owner =	THIS_MODULE,
+};
+
+#ifdef CONFIG_DEBUG_FS
+static int idle_gov_debug_show(struct seq_file *s, void *data)
+{
+	struct tegra_idle_gov_cpu *d;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		d = &per_cpu(idle_gov_cpu, cpu);
+
+		seq_printf(s, "cpu%d: %lu timer wakeups, %lu irq wakeups\n",
+			   cpu, d->timer_wakeups, d->irq_wakeups);
+		seq_printf(s, "  state   entries       time(us)  too_deep  too_shallow\n");
+		for (i = 0; i < CPUIDLE_STATE_MAX; i++) {
+			if (!d->entries[i])
+				continue;
+			seq_printf(s, "  %-5d %9lu %14llu %9lu %12lu\n",
+				   i, d->entries[i], d->time_us[i],
+				   d->too_deep[i], d->too_shallow[i]);
+		}
+
+		seq_printf(s, "  irq wakeup histogram (us):\n");
+		for (i = 0; i < IDLE_HIST_BUCKETS; i++) {
+			if (!d->hist[i])
+				continue;
+			seq_printf(s, "  %8u+ %6u\n", 1 << i, d->hist[i]);
+		}
+		seq_printf(s, "  timer   %6u\n\n", d->hist_timer);
+	}
+
+	return 0;
+}
+
+static int idle_gov_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, idle_gov_debug_show, inode->i_private);
+}
+
+static const struct file_operations idle_gov_debug_ops = {
+	.open		= idle_gov_debug_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init tegra_idle_gov_debug_init(void)
+{
+	if (!debugfs_create_file("cpuidle_gov", S_IRUGO, NULL, NULL,
+				 &idle_gov_debug_ops))
+		pr_err("%s: failed to create debugfs file\n", __func__);
+}
+#else
+static inline void tegra_idle_gov_debug_init(void)
+{ }
+#endif
+
+static int __init tegra_idle_gov_init(void)
+{
+	tegra_idle_gov_debug_init();
+
+	return cpuidle_register_governor(&tegra_idle_governor);
+}
+module_init(tegra_idle_gov_init);
@@ -186,11 +186,16 @@ bool tegra_dma_is_stopped(struct tegra_dma_channel *ch)
 
 int tegra_dma_cancel(struct tegra_dma_channel *ch)
 {
+	struct tegra_dma_req *req;
 	unsigned long irq_flags;
 
 	spin_lock_irqsave(&ch->lock, irq_flags);
-	while (!list_empty(&ch->list))
-		list_del(ch->list.next);
+	while (!list_empty(&ch->list)) {
+		req = list_entry(ch->list.next, typeof(*req), node);
+		list_del(&req->node);
+		/* the complete callback will never run for this one */
+		req->status = -TEGRA_DMA_REQ_ERROR_ABORTED;
+	}
 
 	tegra_dma_stop(ch);
 
@@ -448,6 +453,24 @@ int tegra_dma_enqueue_req(struct tegra_dma_channel *ch,
 }
 EXPORT_SYMBOL(tegra_dma_enqueue_req);
 
+/* Switch an idle channel between oneshot and continuous operation */
+int tegra_dma_set_mode(struct tegra_dma_channel *ch, int mode)
+{
+	unsigned long irq_flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&ch->lock, irq_flags);
+	if (!list_empty(&ch->list))
+		ret = -EBUSY;
+	else
+		ch->mode = (ch->mode & TEGRA_DMA_SHARED) |
+			(mode & ~TEGRA_DMA_SHARED);
+	spin_unlock_irqrestore(&ch->lock, irq_flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(tegra_dma_set_mode);
+
 static void tegra_dma_dump_channel_usage(void)
 {
 	int i;
@@ -706,6 +729,15 @@ static void handle_oneshot_dma(struct tegra_dma_channel *ch)
 		req->bytes_transferred = req->size;
 		req->status = TEGRA_DMA_REQ_SUCCESS;
 
+		/* Start the next queued request before running the callback
+		 * so the channel does not sit idle while the client works. */
+		if (!list_empty(&ch->list)) {
+			struct tegra_dma_req *next_req;
+			next_req = list_entry(ch->list.next,
+				typeof(*next_req), node);
+			tegra_dma_update_hw(ch, next_req);
+		}
+
 		spin_unlock_irqrestore(&ch->lock, irq_flags);
 		/* Callback should be called without any lock */
 		pr_debug("%s: transferred %d bytes\n", __func__,
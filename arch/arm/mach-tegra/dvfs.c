@@ -32,6 +32,8 @@
 #include <linux/suspend.h>
 #include <linux/delay.h>
 #include <linux/reboot.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 
 #include <mach/clk.h>
 
@@ -42,7 +44,29 @@
 static LIST_HEAD(dvfs_rail_list);
 static DEFINE_MUTEX(dvfs_lock);
 
+/*
+ * Rate requests record the voltage their clock needs under dvfs_lock and
+ * bump dvfs_req_seq. A request that raises its voltage runs one planner
+ * pass over all rails before it drops the lock; the pass picks up every
+ * request recorded before it, so raises staged by tegra_dvfs_raise_rate()
+ * go out in a single ramp with tegra_dvfs_apply(). Requests that lower
+ * their voltage do not run a pass; they are folded into the next one,
+ * DVFS_PLAN_DEFER_JIFFIES later at the latest.
+ */
+#define DVFS_PLAN_DEFER_JIFFIES	1
+
+static atomic_t dvfs_req_seq = ATOMIC_INIT(0);
+static int dvfs_done_seq;	/* last request seq covered by a pass */
+
+static struct {
+	atomic_t requests;
+	atomic_t deferred;
+	unsigned int plans;
+} dvfs_stats;
+
 static int dvfs_rail_update(struct dvfs_rail *rail);
+static void dvfs_plan_work_func(struct work_struct *work);
+static DECLARE_DELAYED_WORK(dvfs_plan_work, dvfs_plan_work_func);
 
 void tegra_dvfs_add_relationships(struct dvfs_relationship *rels, int n)
 {
@@ -97,6 +121,8 @@ static int dvfs_rail_set_voltage(struct dvfs_rail *rail, int millivolts)
 	int step = (millivolts > rail->millivolts) ? rail->step : -rail->step;
 	int i;
 	int steps;
+	ktime_t start;
+	u32 us;
 
 	if (!rail->reg) {
 		if (millivolts == rail->millivolts)
@@ -110,6 +136,7 @@ static int dvfs_rail_set_voltage(struct dvfs_rail *rail, int millivolts)
 
 	rail->resolving_to = true;
 	steps = DIV_ROUND_UP(abs(millivolts - rail->millivolts), rail->step);
+	start = ktime_get();
 
 	for (i = 0; i < steps; i++) {
 		if (abs(millivolts - rail->millivolts) > rail->step)
@@ -142,6 +169,7 @@ static int dvfs_rail_set_voltage(struct dvfs_rail *rail, int millivolts)
 		}
 
 		rail->millivolts = rail->new_millivolts;
+		rail->steps++;
 
 		/* After changing the voltage, tell each rail that depends
 		 * on this rail that the voltage has changed.
@@ -161,6 +189,12 @@ static int dvfs_rail_set_voltage(struct dvfs_rail *rail, int millivolts)
 	}
 
 out:
+	if (steps) {
+		us = (u32)ktime_us_delta(ktime_get(), start);
+		rail->ramps++;
+		rail->ramp_total_us += us;
+		rail->ramp_max_us = max(rail->ramp_max_us, us);
+	}
 	rail->resolving_to = false;
 	return ret;
 }
@@ -239,11 +273,35 @@ static int dvfs_rail_connect_to_regulator(struct dvfs_rail *rail)
 	return 0;
 }
 
-static int
-__tegra_dvfs_set_rate(struct dvfs *d, unsigned long rate)
+/* must be called with dvfs lock held */
+static void dvfs_plan_apply(void)
+{
+	struct dvfs_rail *rail;
+	int seq = atomic_read(&dvfs_req_seq);
+
+	/* pairs with atomic_inc_return() in tegra_dvfs_set_rate() */
+	smp_rmb();
+
+	list_for_each_entry(rail, &dvfs_rail_list, node)
+		rail->plan_ret = dvfs_rail_update(rail);
+
+	dvfs_done_seq = seq;
+	dvfs_stats.plans++;
+}
+
+static void dvfs_plan_work_func(struct work_struct *work)
+{
+	mutex_lock(&dvfs_lock);
+	if (dvfs_done_seq != atomic_read(&dvfs_req_seq))
+		dvfs_plan_apply();
+	mutex_unlock(&dvfs_lock);
+}
+
+/* Returns the voltage d needs at rate, or an error */
+static int dvfs_rate_millivolts(struct dvfs *d, unsigned long rate)
 {
 	int i = 0;
-	int ret;
+	int millivolts = 0;
 
 	if (d->freqs == NULL || d->millivolts == NULL)
 		return -ENODEV;
@@ -254,29 +312,20 @@ __tegra_dvfs_set_rate(struct dvfs *d, unsigned long rate)
 		return -EINVAL;
 	}
 
-	if (rate == 0) {
-		d->cur_millivolts = 0;
-	} else {
+	if (rate != 0) {
 		while (i < d->num_freqs && rate > d->freqs[i])
 			i++;
 
-		d->cur_millivolts = d->millivolts[i];
+		millivolts = d->millivolts[i];
 		if ((d->max_millivolts) &&
-		    (d->cur_millivolts > d->max_millivolts)) {
+		    (millivolts > d->max_millivolts)) {
 			pr_warn("tegra_dvfs: voltage %d too high for dvfs on"
-				" %s\n", d->cur_millivolts, d->clk_name);
+				" %s\n", millivolts, d->clk_name);
 			return -EINVAL;
 		}
 	}
 
-	d->cur_rate = rate;
-
-	ret = dvfs_rail_update(d->dvfs_rail);
-	if (ret)
-		pr_err("Failed to set regulator %s for clock %s to %d mV\n",
-			d->dvfs_rail->reg_id, d->clk_name, d->cur_millivolts);
-
-	return ret;
+	return millivolts;
 }
 
 int tegra_dvfs_predict_millivolts(struct clk *c, unsigned long rate)
@@ -302,19 +351,116 @@ int tegra_dvfs_predict_millivolts(struct clk *c, unsigned long rate)
 
 int tegra_dvfs_set_rate(struct clk *c, unsigned long rate)
 {
+	struct dvfs *d = c->dvfs;
+	unsigned long old_rate;
+	int old_millivolts;
+	int millivolts;
 	int ret;
 
-	if (!c->dvfs)
+	if (!d)
 		return -EINVAL;
 
+	millivolts = dvfs_rate_millivolts(d, rate);
+	if (millivolts < 0)
+		return millivolts;
+
 	mutex_lock(&dvfs_lock);
-	ret = __tegra_dvfs_set_rate(c->dvfs, rate);
+
+	old_rate = d->cur_rate;
+	old_millivolts = d->cur_millivolts;
+	d->cur_rate = rate;
+	d->cur_millivolts = millivolts;
+	if (millivolts == old_millivolts) {
+		mutex_unlock(&dvfs_lock);
+		return 0;
+	}
+
+	/* full barrier, pairs with smp_rmb() in dvfs_plan_apply() */
+	atomic_inc_return(&dvfs_req_seq);
+	atomic_inc(&dvfs_stats.requests);
+
+	/* the clock is already running slower, the rail can follow later */
+	if (millivolts < old_millivolts) {
+		mutex_unlock(&dvfs_lock);
+		atomic_inc(&dvfs_stats.deferred);
+		schedule_delayed_work(&dvfs_plan_work, DVFS_PLAN_DEFER_JIFFIES);
+		return 0;
+	}
+
+	dvfs_plan_apply();
+	ret = d->dvfs_rail->plan_ret;
+
+	/* the clock stays at its old rate, and a retry must ramp again */
+	if (ret) {
+		d->cur_rate = old_rate;
+		d->cur_millivolts = old_millivolts;
+	}
 	mutex_unlock(&dvfs_lock);
 
+	if (ret)
+		pr_err("Failed to set regulator %s for clock %s to %d mV\n",
+			d->dvfs_rail->reg_id, d->clk_name, millivolts);
+
 	return ret;
 }
 EXPORT_SYMBOL(tegra_dvfs_set_rate);
 
+/*
+ * Records the higher voltage c needs at rate without ramping the rail, so
+ * that several clocks can be raised by one tegra_dvfs_apply() pass. Must
+ * be called with the clock lock held. Returns 1 if the request went up.
+ */
+int tegra_dvfs_raise_rate(struct clk *c, unsigned long rate)
+{
+	struct dvfs *d = c->dvfs;
+	int millivolts;
+
+	if (!d)
+		return -EINVAL;
+
+	millivolts = dvfs_rate_millivolts(d, rate);
+	if (millivolts < 0)
+		return millivolts;
+
+	mutex_lock(&dvfs_lock);
+
+	/* lowering is left to the rate change itself */
+	if (millivolts <= d->cur_millivolts) {
+		mutex_unlock(&dvfs_lock);
+		return 0;
+	}
+
+	d->cur_rate = rate;
+	d->cur_millivolts = millivolts;
+
+	/* full barrier, pairs with smp_rmb() in dvfs_plan_apply() */
+	atomic_inc_return(&dvfs_req_seq);
+	atomic_inc(&dvfs_stats.requests);
+	mutex_unlock(&dvfs_lock);
+	return 1;
+}
+
+/* Runs a planner pass if any request is not covered yet */
+int tegra_dvfs_apply(void)
+{
+	struct dvfs_rail *rail;
+	int ret = 0;
+
+	mutex_lock(&dvfs_lock);
+	if (dvfs_done_seq != atomic_read(&dvfs_req_seq)) {
+		dvfs_plan_apply();
+		list_for_each_entry(rail, &dvfs_rail_list, node) {
+			if (rail->plan_ret) {
+				ret = rail->plan_ret;
+				break;
+			}
+		}
+	}
+	mutex_unlock(&dvfs_lock);
+
+	return ret;
+}
+
 /* May only be called during clock init, does not take any locks on clock c. */
 int __init tegra_enable_dvfs_on_clk(struct clk *c, struct dvfs *d)
 {
@@ -633,6 +779,45 @@ static const struct file_operations dvfs_tree_fops = {
 	.release	= single_release,
 };
 
+static int dvfs_stats_show(struct seq_file *s, void *data)
+{
+	struct dvfs_rail *rail;
+
+	mutex_lock(&dvfs_lock);
+
+	seq_printf(s, "requests %u deferred %u plans %u\n",
+		atomic_read(&dvfs_stats.requests),
+		atomic_read(&dvfs_stats.deferred),
+		dvfs_stats.plans);
+
+	seq_printf(s, "\n   rail       ramps    steps    avg us   max us\n");
+	seq_printf(s, "------------------------------------------------\n");
+
+	list_for_each_entry(rail, &dvfs_rail_list, node) {
+		seq_printf(s, "   %-10s %-8u %-8u %-8llu %-8u\n", rail->reg_id,
+			rail->ramps, rail->steps,
+			rail->ramps ? div_u64(rail->ramp_total_us, rail->ramps)
+				    : 0,
+			rail->ramp_max_us);
+	}
+
+	mutex_unlock(&dvfs_lock);
+
+	return 0;
+}
+
+static int dvfs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dvfs_stats_show, inode->i_private);
+}
+
+static const struct file_operations dvfs_stats_fops = {
+	.open		= dvfs_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 int __init dvfs_debugfs_init(struct dentry *clk_debugfs_root)
 {
 	struct dentry *d;
@@ -642,6 +827,11 @@ int __init dvfs_debugfs_init(struct dentry *clk_debugfs_root)
 	if (!d)
 		return -ENOMEM;
 
+	d = debugfs_create_file("dvfs_stats", S_IRUGO, clk_debugfs_root, NULL,
+		&dvfs_stats_fops);
+	if (!d)
+		return -ENOMEM;
+
 	return 0;
 }
 
@@ -61,6 +61,15 @@ struct dvfs_rail {
 	int millivolts;
 	int new_millivolts;
 	bool suspended;
+
+	/* result of the last planner pass, for requests merged into it */
+	int plan_ret;
+
+	/* statistics, protected by dvfs_lock */
+	unsigned int ramps;
+	unsigned int steps;
+	u64 ramp_total_us;
+	u32 ramp_max_us;
 };
 
 struct dvfs {
@@ -98,6 +107,8 @@ void tegra_dvfs_rail_enable(struct dvfs_rail *rail);
 void tegra_dvfs_rail_disable(struct dvfs_rail *rail);
 bool tegra_dvfs_rail_updating(struct clk *clk);
 int tegra_dvfs_predict_millivolts(struct clk *c, unsigned long rate);
+int tegra_dvfs_raise_rate(struct clk *c, unsigned long rate);
+int tegra_dvfs_apply(void);
 #else
 static inline void tegra_soc_init_dvfs(void)
 {}
@@ -119,6 +130,10 @@ static inline bool tegra_dvfs_rail_updating(struct clk *clk)
 { return false; }
 static inline int tegra_dvfs_predict_millivolts(struct clk *c, unsigned long rate)
 { return 0; }
+static inline int tegra_dvfs_raise_rate(struct clk *c, unsigned long rate)
+{ return 0; }
+static inline int tegra_dvfs_apply(void)
+{ return 0; }
 #endif
 
 #endif
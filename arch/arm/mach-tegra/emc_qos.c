@@ -0,0 +1,332 @@
+/*
+ * arch/arm/mach-tegra/emc_qos.c
+ *
+ * Memory bandwidth QoS governor for the Tegra EMC clock
+ *
+ * Copyright (C) 2011, NVIDIA Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/clk.h>
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include <mach/emc_qos.h>
+
+/*
+ * The governor owns the "qos.emc" shared bus user and keeps it at the
+ * rate all registered clients need together; the emc bus still takes the
+ * maximum with its other users (cpu, avp, usb, ...).
+ */
+
+#define EMC_QOS_HISTORY		16
+#define EMC_QOS_BW_INF		(~0ULL)
+
+/* DDR: 8 bytes transfer per clock */
+#if defined(CONFIG_TEGRA_EMC_TO_DDR_CLOCK)
+#define EMC_QOS_TO_DDR_CLOCK	CONFIG_TEGRA_EMC_TO_DDR_CLOCK
+#else
+#define EMC_QOS_TO_DDR_CLOCK	2
+#endif
+
+/* % of the theoretical DRAM bandwidth clients can actually get */
+static unsigned int bw_efficiency = 100;
+module_param(bw_efficiency, uint, 0644);
+
+/* EMC clocks a loaded memory access takes, for latency requests */
+static unsigned int latency_cycles = 100;
+module_param(latency_cycles, uint, 0644);
+
+struct emc_qos_hist {
+	ktime_t time;
+	unsigned long bw_kbps;
+	unsigned int latency_ns;
+	unsigned long rate;		/* EMC rate chosen after the request */
+};
+
+struct tegra_emc_qos_client {
+	struct list_head node;
+	const char *name;
+	unsigned long bw_kbps;
+	unsigned int latency_ns;
+
+	unsigned int nr_requests;
+	unsigned int hist_idx;
+	struct emc_qos_hist hist[EMC_QOS_HISTORY];
+};
+
+static LIST_HEAD(qos_clients);
+static DEFINE_MUTEX(qos_lock);
+
+static struct clk *qos_clk;
+static unsigned long qos_max_rate;
+static unsigned long qos_rate;
+static unsigned long qos_actmon_khz;
+
+/* why the current rate was picked, for debugfs */
+static struct {
+	u64 bw_kbps;
+	unsigned long bw_rate;
+	unsigned long latency_rate;
+	unsigned long actmon_rate;
+	unsigned int updates;
+	unsigned int changes;
+} qos_state;
+
+static unsigned long emc_qos_bw_to_rate(u64 bw_kbps)
+{
+	u64 rate = bw_kbps * 1000 * EMC_QOS_TO_DDR_CLOCK / 8;
+
+	if (bw_efficiency && (bw_efficiency < 100))
+		rate = div_u64(rate * 100, bw_efficiency);
+
+	return (rate > ULONG_MAX) ? ULONG_MAX : (unsigned long)rate;
+}
+
+static unsigned long emc_qos_latency_to_rate(unsigned int latency_ns)
+{
+	u64 rate;
+
+	if (!latency_ns)
+		return 0;
+
+	rate = div_u64((u64)latency_cycles * NSEC_PER_SEC, latency_ns);
+	return (rate > ULONG_MAX) ? ULONG_MAX : (unsigned long)rate;
+}
+
+/* must be called with qos_lock held */
+static int emc_qos_update(void)
+{
+	struct tegra_emc_qos_client *c;
+	unsigned long rate;
+	long rounded;
+	int ret = 0;
+
+	qos_state.bw_kbps = 0;
+	qos_state.latency_rate = 0;
+	qos_state.actmon_rate = qos_actmon_khz * 1000;
+
+	list_for_each_entry(c, &qos_clients, node) {
+		if (c->bw_kbps == TEGRA_EMC_QOS_BW_MAX)
+			qos_state.bw_kbps = EMC_QOS_BW_INF;
+		else if (qos_state.bw_kbps != EMC_QOS_BW_INF)
+			qos_state.bw_kbps += c->bw_kbps;
+
+		qos_state.latency_rate = max(qos_state.latency_rate,
+			emc_qos_latency_to_rate(c->latency_ns));
+	}
+
+	qos_state.bw_rate = (qos_state.bw_kbps == EMC_QOS_BW_INF) ? ULONG_MAX :
+		emc_qos_bw_to_rate(qos_state.bw_kbps);
+
+	rate = max3(qos_state.bw_rate, qos_state.latency_rate,
+		    qos_state.actmon_rate);
+	rate = min(rate, qos_max_rate);
+	qos_state.updates++;
+
+	if (!qos_clk)
+		return 0;
+
+	/* lowest EMC table entry at or above the combined need */
+	rounded = clk_round_rate(qos_clk, rate);
+	if (rounded > 0)
+		rate = rounded;
+
+	if (rate != qos_rate) {
+		ret = clk_set_rate(qos_clk, rate);
+		if (!ret) {
+			qos_rate = rate;
+			qos_state.changes++;
+		}
+	}
+
+	return ret;
+}
+
+struct tegra_emc_qos_client *tegra_emc_qos_register(const char *name)
+{
+	struct tegra_emc_qos_client *c;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return NULL;
+
+	c->name = name;
+
+	mutex_lock(&qos_lock);
+	list_add_tail(&c->node, &qos_clients);
+	mutex_unlock(&qos_lock);
+
+	return c;
+}
+EXPORT_SYMBOL(tegra_emc_qos_register);
+
+void tegra_emc_qos_unregister(struct tegra_emc_qos_client *c)
+{
+	if (!c)
+		return;
+
+	mutex_lock(&qos_lock);
+	list_del(&c->node);
+	emc_qos_update();
+	mutex_unlock(&qos_lock);
+
+	kfree(c);
+}
+EXPORT_SYMBOL(tegra_emc_qos_unregister);
+
+int tegra_emc_qos_request(struct tegra_emc_qos_client *c,
+			  unsigned long bw_kbps, unsigned int latency_ns)
+{
+	struct emc_qos_hist *h;
+	int ret;
+
+	if (!c)
+		return -EINVAL;
+
+	mutex_lock(&qos_lock);
+
+	c->bw_kbps = bw_kbps;
+	c->latency_ns = latency_ns;
+	ret = emc_qos_update();
+
+	h = &c->hist[c->hist_idx];
+	h->time = ktime_get();
+	h->bw_kbps = bw_kbps;
+	h->latency_ns = latency_ns;
+	h->rate = qos_rate;
+	c->hist_idx = (c->hist_idx + 1) % EMC_QOS_HISTORY;
+	c->nr_requests++;
+
+	mutex_unlock(&qos_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL(tegra_emc_qos_request);
+
+/* Average EMC activity plus boost from the activity monitor, in kHz */
+void tegra_emc_qos_actmon_update(unsigned long khz)
+{
+	mutex_lock(&qos_lock);
+	if (khz != qos_actmon_khz) {
+		qos_actmon_khz = khz;
+		emc_qos_update();
+	}
+	mutex_unlock(&qos_lock);
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+static int emc_qos_show(struct seq_file *s, void *data)
+{
+	struct tegra_emc_qos_client *c;
+	struct emc_qos_hist *h;
+	s64 now = ktime_to_us(ktime_get());
+	int i, n;
+
+	mutex_lock(&qos_lock);
+
+	seq_printf(s, "rate: %lu kHz (max %lu kHz)\n",
+		   qos_rate / 1000, qos_max_rate / 1000);
+	if (qos_state.bw_kbps == EMC_QOS_BW_INF)
+		seq_printf(s, "bandwidth: max\n");
+	else
+		seq_printf(s, "bandwidth: %llu kB/s -> %lu kHz\n",
+			   qos_state.bw_kbps, qos_state.bw_rate / 1000);
+	seq_printf(s, "latency: %lu kHz\n", qos_state.latency_rate / 1000);
+	seq_printf(s, "actmon: %lu kHz\n", qos_state.actmon_rate / 1000);
+	seq_printf(s, "updates: %u changes: %u\n",
+		   qos_state.updates, qos_state.changes);
+
+	list_for_each_entry(c, &qos_clients, node) {
+		seq_printf(s, "\n%s: %lu kB/s %u ns, %u requests\n",
+			   c->name, c->bw_kbps, c->latency_ns,
+			   c->nr_requests);
+
+		/* oldest first */
+		n = min_t(unsigned int, c->nr_requests, EMC_QOS_HISTORY);
+		for (i = 0; i < n; i++) {
+			h = &c->hist[(c->hist_idx + EMC_QOS_HISTORY - n + i) %
+				     EMC_QOS_HISTORY];
+			seq_printf(s, "   -%-10lld us %-12lu kB/s %-8u ns %lu kHz\n",
+				   now - ktime_to_us(h->time), h->bw_kbps,
+				   h->latency_ns, h->rate / 1000);
+		}
+	}
+
+	mutex_unlock(&qos_lock);
+
+	return 0;
+}
+
+static int emc_qos_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, emc_qos_show, inode->i_private);
+}
+
+static const struct file_operations emc_qos_fops = {
+	.open		= emc_qos_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init emc_qos_debug_init(void)
+{
+	if (!debugfs_create_file("emc_qos", S_IRUGO, NULL, NULL,
+				 &emc_qos_fops))
+		pr_err("%s: failed to create debugfs file\n", __func__);
+}
+#else
+static inline void emc_qos_debug_init(void)
+{ }
+#endif
+
+static int __init tegra_emc_qos_init(void)
+{
+	struct clk *c;
+	long rate;
+
+	c = clk_get_sys("tegra_emc_qos", "emc");
+	if (IS_ERR(c)) {
+		pr_err("%s: failed to get qos.emc clock\n", __func__);
+		return PTR_ERR(c);
+	}
+
+	rate = clk_round_rate(c, ULONG_MAX);
+	if (rate <= 0) {
+		clk_put(c);
+		return -EINVAL;
+	}
+
+	clk_enable(c);
+
+	mutex_lock(&qos_lock);
+	qos_max_rate = rate;
+	qos_clk = c;
+	emc_qos_update();
+	mutex_unlock(&qos_lock);
+
+	emc_qos_debug_init();
+
+	return 0;
+}
+late_initcall(tegra_emc_qos_init);
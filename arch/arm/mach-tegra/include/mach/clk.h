@@ -58,6 +58,22 @@ int tegra_register_clk_rate_notifier(struct clk *c, struct notifier_block *nb);
 void tegra_unregister_clk_rate_notifier(
 	struct clk *c, struct notifier_block *nb);
 
+struct tegra_clk_rate {
+	struct clk *clk;
+	unsigned long rate;
+};
+
+/**
+ * tegra_clk_set_rates - set the rates of a group of related clocks
+ * @rates: clocks and their new rates, at most 16
+ * @n: number of entries
+ *
+ * Shared buses below the group are updated once, after all rates are
+ * recorded, and voltage for the whole group is raised in one step.
+ * May sleep. Returns the first error, the other clocks are still set.
+ */
+int tegra_clk_set_rates(struct tegra_clk_rate *rates, int n);
+
 /**
  * tegra_is_clk_enabled - get info if the clk is enabled or not
  * @clk: clock source
@@ -164,6 +164,12 @@ bool tegra_dma_is_stopped(struct tegra_dma_channel *ch);
 struct tegra_dma_channel *tegra_dma_allocate_channel(int mode, const char namefmt [ ],...);
 void tegra_dma_free_channel(struct tegra_dma_channel *ch);
 int tegra_dma_cancel(struct tegra_dma_channel *ch);
+int tegra_dma_set_mode(struct tegra_dma_channel *ch, int mode);
+
+/* Passed as dma_chan->private by clients of the dmaengine driver */
+struct tegra_dma_slave {
+	unsigned long req_sel;
+};
 
 int __init tegra_dma_init(void);
 
@@ -0,0 +1,54 @@
+/*
+ * arch/arm/mach-tegra/include/mach/emc_qos.h
+ *
+ * Copyright (C) 2011, NVIDIA Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _MACH_TEGRA_EMC_QOS_H_
+#define _MACH_TEGRA_EMC_QOS_H_
+
+#include <linux/kernel.h>
+
+/* request the maximum EMC rate regardless of bandwidth */
+#define TEGRA_EMC_QOS_BW_MAX	ULONG_MAX
+
+struct tegra_emc_qos_client;
+
+/*
+ * Memory bandwidth QoS. Each client states the bandwidth it consumes in
+ * kB/s and the worst memory latency it tolerates in ns (0 for none). The
+ * EMC rate is set to the lowest table entry that meets the sum of all
+ * bandwidths, the tightest latency and the actmon measured demand.
+ * All calls may sleep.
+ */
+#ifdef CONFIG_TEGRA_EMC_QOS
+struct tegra_emc_qos_client *tegra_emc_qos_register(const char *name);
+void tegra_emc_qos_unregister(struct tegra_emc_qos_client *client);
+int tegra_emc_qos_request(struct tegra_emc_qos_client *client,
+			  unsigned long bw_kbps, unsigned int latency_ns);
+void tegra_emc_qos_actmon_update(unsigned long khz);
+#else
+static inline struct tegra_emc_qos_client *tegra_emc_qos_register(
+	const char *name)
+{ return NULL; }
+static inline void tegra_emc_qos_unregister(
+	struct tegra_emc_qos_client *client)
+{ }
+static inline int tegra_emc_qos_request(struct tegra_emc_qos_client *client,
+	unsigned long bw_kbps, unsigned int latency_ns)
+{ return 0; }
+static inline void tegra_emc_qos_actmon_update(unsigned long khz)
+{ }
+#endif
+
+#endif
@@ -106,6 +106,11 @@ static inline void tegra_disable_latency_scaling(enum tegra_la_id id)
 {
 	return;
 }
+
+static inline void tegra_latency_allowance_underflow(enum tegra_la_id id)
+{
+	return;
+}
 #else
 int tegra_set_latency_allowance(enum tegra_la_id id,
 				unsigned int bandwidth_in_mbps);
@@ -116,6 +121,8 @@ int tegra_enable_latency_scaling(enum tegra_la_id id,
 				    unsigned int threshold_high);
 
 void tegra_disable_latency_scaling(enum tegra_la_id id);
+
+void tegra_latency_allowance_underflow(enum tegra_la_id id);
 #endif
 
 #endif /* _MACH_TEGRA_LATENCY_ALLOWANCE_H_ */
@@ -23,6 +23,9 @@
 #include <linux/spinlock_types.h>
 #include <linux/spinlock.h>
 #include <linux/stringify.h>
+#include <linux/module.h>
+#include <linux/workqueue.h>
+#include <asm/atomic.h>
 #include <asm/bug.h>
 #include <asm/io.h>
 #include <asm/string.h>
@@ -30,6 +33,8 @@
 #include <mach/io.h>
 #include <mach/latency_allowance.h>
 
+#include "tegra3_emc.h"
+
 #define MC_ARB_OVERRIDE		0xe8
 #define GLOBAL_LATENCY_SCALING_ENABLE_BIT 7
 
@@ -222,6 +227,16 @@ struct la_scaling_info {
 	int scaling_ref_count;
 	int actual_la_to_set;
 	int la_set;
+
+	/* runtime tuning, display clients only */
+	unsigned int la_pct;		/* % of actual_la_to_set programmed */
+	unsigned int uf_pct;		/* la_pct that last underflowed, or 0 */
+	unsigned int quiet_periods;	/* tuning periods without underflow */
+	bool in_use;			/* has bandwidth, la_pct applies */
+	atomic_t underflows;
+	unsigned long total_underflows;
+	unsigned long tightened;
+	unsigned long relaxed;
 };
 
 struct la_scaling_reg_info {
@@ -299,6 +314,37 @@ struct la_scaling_reg_info vi_info[] = {
 static struct la_scaling_info scaling_info[TEGRA_LA_MAX_ID];
 static int la_scaling_enable_count;
 
+/*
+ * Closed loop tuning of the display latency allowance. The LA computed
+ * from the window bandwidth is scaled by la_pct: an underflow reported
+ * by the display controller halves it, which raises the display's memory
+ * priority, and after la_relax_periods quiet periods with the EMC busy it
+ * is raised again by la_relax_step so the CPU and other clients get their
+ * share back, but never back up to the value that last underflowed. That
+ * bound is forgotten when the client's bandwidth changes. While the EMC is
+ * mostly idle nobody is starved and the value is left alone, as are
+ * clients the display does not use.
+ */
+#define LA_DISP_DEFAULT_PCT	33	/* the old fixed LA / 3, Bug 862709 */
+
+static unsigned int la_tune_period_ms = 100;
+module_param(la_tune_period_ms, uint, 0644);
+static unsigned int la_relax_periods = 20;
+module_param(la_relax_periods, uint, 0644);
+static unsigned int la_relax_step = 5;
+module_param(la_relax_step, uint, 0644);
+static unsigned int la_busy_pct = 60;
+module_param(la_busy_pct, uint, 0644);
+static unsigned int la_min_pct = 5;
+module_param(la_min_pct, uint, 0644);
+
+static struct delayed_work la_tune_work;
+
+static inline bool la_is_tuned(enum tegra_la_id id)
+{
+	return id >= ID(DISPLAY_0A) && id <= ID(DISPLAY_HCB);
+}
+
 #define VALIDATE_ID(id) \
 	do { \
 		if (id >= TEGRA_LA_MAX_ID) \
@@ -374,6 +420,22 @@ static void set_vi_latency_thresholds(enum tegra_la_id id)
 	set_thresholds(&vi_info[id - ID(VI_WSB)], id);
 }
 
+/* must be called with safety_lock held */
+static void la_program(enum tegra_la_id id, int la_to_set)
+{
+	struct la_client_info *ci = &la_info[id];
+	unsigned long reg_read;
+	unsigned long reg_write;
+
+	reg_read = readl(ci->reg_addr);
+	reg_write = (reg_read & ~ci->mask) |
+			(la_to_set << ci->shift);
+	writel(reg_write, ci->reg_addr);
+	scaling_info[id].la_set = la_to_set;
+	la_debug("reg_addr=0x%x, read=0x%x, write=0x%x",
+		(u32)ci->reg_addr, (u32)reg_read, (u32)reg_write);
+}
+
 /* Sets latency allowance based on clients memory bandwitdh requirement.
  * Bandwidth passed is in mega bytes per second.
  */
@@ -382,8 +444,6 @@ int tegra_set_latency_allowance(enum tegra_la_id id,
 {
 	int ideal_la;
 	int la_to_set;
-	unsigned long reg_read;
-	unsigned long reg_write;
 	int bytes_per_atom = normal_atom_size;
 	struct la_client_info *ci;
 
@@ -407,25 +467,88 @@ int tegra_set_latency_allowance(enum tegra_la_id id,
 		__func__, id, bandwidth_in_mbps, la_to_set);
 	la_to_set = (la_to_set < 0) ? 0 : la_to_set;
 	la_to_set = (la_to_set > MC_LA_MAX_VALUE) ? MC_LA_MAX_VALUE : la_to_set;
-	scaling_info[id].actual_la_to_set = la_to_set;
-
-	/* until display can use latency allowance scaling, use a more
-	 * aggressive LA setting. Bug 862709 */
-	if (id >= ID(DISPLAY_0A) && id <= ID(DISPLAY_HCB))
-		la_to_set /= 3;
 
 	spin_lock(&safety_lock);
-	reg_read = readl(ci->reg_addr);
-	reg_write = (reg_read & ~ci->mask) |
-			(la_to_set << ci->shift);
-	writel(reg_write, ci->reg_addr);
-	scaling_info[id].la_set = la_to_set;
-	la_debug("reg_addr=0x%x, read=0x%x, write=0x%x",
-		(u32)ci->reg_addr, (u32)reg_read, (u32)reg_write);
+	/* display runs more aggressive than its bandwidth asks for, by
+	 * however much the underflow feedback has settled on. */
+	if (la_is_tuned(id)) {
+		if (scaling_info[id].actual_la_to_set != la_to_set)
+			scaling_info[id].uf_pct = 0;
+		scaling_info[id].in_use = bandwidth_in_mbps != 0;
+		scaling_info[id].actual_la_to_set = la_to_set;
+		if (scaling_info[id].in_use)
+			la_to_set = la_to_set * scaling_info[id].la_pct / 100;
+	} else
+		scaling_info[id].actual_la_to_set = la_to_set;
+	la_program(id, la_to_set);
 	spin_unlock(&safety_lock);
 	return 0;
 }
 
+/* Called from the display controller interrupt on a window underflow */
+void tegra_latency_allowance_underflow(enum tegra_la_id id)
+{
+	if (id >= TEGRA_LA_MAX_ID || !la_is_tuned(id))
+		return;
+
+	atomic_inc(&scaling_info[id].underflows);
+}
+
+static void la_tune_worker(struct work_struct *work)
+{
+	struct la_scaling_info *si;
+	unsigned int load = tegra_actmon_emc_load();
+	unsigned int pct, limit, uf;
+	enum tegra_la_id id;
+
+	for (id = ID(DISPLAY_0A); id <= ID(DISPLAY_HCB); id++) {
+		si = &scaling_info[id];
+		uf = atomic_xchg(&si->underflows, 0);
+		pct = si->la_pct;
+
+		if (!si->in_use || !si->actual_la_to_set) {
+			si->quiet_periods = 0;
+			continue;
+		}
+
+		if (uf) {
+			si->total_underflows += uf;
+			si->quiet_periods = 0;
+			si->uf_pct = pct;
+			pct = max(pct / 2, la_min_pct);
+		} else if (++si->quiet_periods >= la_relax_periods &&
+			   load >= la_busy_pct) {
+			si->quiet_periods = 0;
+			limit = si->uf_pct ? si->uf_pct - 1 : 100;
+			if (pct < limit)
+				pct = min(pct + la_relax_step, limit);
+		}
+
+		if (pct == si->la_pct)
+			continue;
+
+		if (pct < si->la_pct)
+			si->tightened++;
+		else
+			si->relaxed++;
+
+		spin_lock(&safety_lock);
+		si->la_pct = pct;
+		if (!si->in_use || !si->actual_la_to_set) {
+			spin_unlock(&safety_lock);
+			continue;
+		}
+		la_program(id, si->actual_la_to_set * pct / 100);
+		if (si->scaling_ref_count && id <= ID(DISPLAY_1BB) &&
+		    disp_info[id - ID(DISPLAY_0A)].id == id)
+			set_disp_latency_thresholds(id);
+		spin_unlock(&safety_lock);
+	}
+
+	schedule_delayed_work(&la_tune_work,
+			      msecs_to_jiffies(la_tune_period_ms));
+}
+
 /* Thresholds for scaling are specified in % of fifo freeness.
  * If threshold_low is specified as 20%, it means when the fifo free
  * between 0 to 20%, use la as programmed_la.
@@ -525,6 +648,36 @@ static const struct file_operations regs_fops = {
 	.release        = single_release,
 };
 
+static int la_tune_show(struct seq_file *s, void *unused)
+{
+	enum tegra_la_id id;
+	struct la_scaling_info *si;
+
+	seq_printf(s, "emc load: %u%%\n", tegra_actmon_emc_load());
+	seq_printf(s, "%-16s %4s %4s %10s %9s %8s\n", "client", "la",
+		   "pct", "underflows", "tightened", "relaxed");
+	for (id = ID(DISPLAY_0A); id <= ID(DISPLAY_HCB); id++) {
+		si = &scaling_info[id];
+		seq_printf(s, "%-16s %4d %3u%% %10lu %9lu %8lu\n",
+			   la_info[id].name, si->la_set, si->la_pct,
+			   si->total_underflows, si->tightened, si->relaxed);
+	}
+
+	return 0;
+}
+
+static int dbg_la_tune_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, la_tune_show, inode->i_private);
+}
+
+static const struct file_operations tune_fops = {
+	.open           = dbg_la_tune_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static int __init tegra_latency_allowance_debugfs_init(void)
 {
 	if (latency_debug_dir)
@@ -534,6 +687,8 @@ static int __init tegra_latency_allowance_debugfs_init(void)
 
 	debugfs_create_file("la_info", S_IRUGO, latency_debug_dir, NULL,
 		&regs_fops);
+	debugfs_create_file("la_tune", S_IRUGO, latency_debug_dir, NULL,
+		&tune_fops);
 
 	return 0;
 }
@@ -542,12 +697,29 @@ late_initcall(tegra_latency_allowance_debugfs_init);
 
 static int __init tegra_latency_allowance_init(void)
 {
+	enum tegra_la_id id;
+
 	la_scaling_enable_count = 0;
+
+	for (id = ID(DISPLAY_0A); id <= ID(DISPLAY_HCB); id++)
+		scaling_info[id].la_pct = LA_DISP_DEFAULT_PCT;
+
 	return 0;
 }
 
 core_initcall(tegra_latency_allowance_init);
 
+/* actmon is up by now, start the display LA feedback loop */
+static int __init tegra_latency_allowance_tune_init(void)
+{
+	INIT_DELAYED_WORK_DEFERRABLE(&la_tune_work, la_tune_worker);
+	schedule_delayed_work(&la_tune_work,
+			      msecs_to_jiffies(la_tune_period_ms));
+	return 0;
+}
+
+late_initcall(tegra_latency_allowance_tune_init);
+
 #if TEST_LA_CODE
 static int __init test_la(void)
 {
@@ -29,8 +29,10 @@
 #include <mach/iomap.h>
 #include <mach/irqs.h>
 #include <mach/clk.h>
+#include <mach/emc_qos.h>
 
 #include "clock.h"
+#include "tegra3_emc.h"
 
 #define ACTMON_GLB_STATUS			0x00
 #define ACTMON_GLB_PERIOD_CTRL			0x04
@@ -66,6 +68,13 @@
 #define ACTMON_DEV_INTR_AVG_UP_WMARK		(0x1 << 24)
 
 #define ACTMON_DEFAULT_AVG_WINDOW_LOG2		6
+
+/* EMC target goes to the bandwidth QoS governor instead of mon.emc */
+#ifdef CONFIG_TEGRA_EMC_QOS
+#define ACTMON_EMC_QOS				true
+#else
+#define ACTMON_EMC_QOS				false
+#endif
 #define ACTMON_DEFAULT_AVG_BAND			6	/* 1/10 of % */
 
 enum actmon_type {
@@ -123,6 +132,7 @@ struct actmon_dev {
 	enum actmon_type	type;
 	enum actmon_state	state;
 	enum actmon_state	saved_state;
+	bool			emc_qos;
 
 	spinlock_t	lock;
 
@@ -282,7 +292,10 @@ irqreturn_t actmon_dev_fn(int irq, void *dev_id)
 	pr_debug("%s.%s(kHz): avg: %lu, target: %lu current: %lu\n",
 			dev->dev_id, dev->con_id, dev->avg_actv_freq,
 			dev->target_freq, dev->cur_freq);
-	clk_set_rate(dev->clk, freq * 1000);
+	if (dev->emc_qos)
+		tegra_emc_qos_actmon_update(freq);
+	else
+		clk_set_rate(dev->clk, freq * 1000);
 
 	return IRQ_HANDLED;
 }
@@ -410,11 +423,17 @@ static void actmon_dev_resume(struct actmon_dev *dev)
 {
 	u32 val;
 	unsigned long flags;
-	unsigned long freq = clk_get_rate(dev->clk) / 1000;
+	unsigned long freq = 0;
+
+	/* the user clock is parked at 0 on the QoS path, see init */
+	if (!dev->emc_qos)
+		freq = clk_get_rate(dev->clk) / 1000;
 
 	spin_lock_irqsave(&dev->lock, flags);
 
 	if (dev->state == ACTMON_SUSPENDED) {
+		if (dev->emc_qos)
+			freq = dev->target_freq ? : dev->max_freq;
 		actmon_dev_configure(dev, freq);
 		dev->state = dev->saved_state;
 		if (dev->state == ACTMON_ON) {
@@ -442,9 +461,20 @@ static int __init actmon_dev_init(struct actmon_dev *dev)
 		return -ENODEV;
 	}
 	dev->max_freq = clk_round_rate(dev->clk, ULONG_MAX);
-	clk_set_rate(dev->clk, dev->max_freq);
+	if (dev->emc_qos) {
+		/* start at max as below, but through the governor */
+		clk_set_rate(dev->clk, 0);
+		tegra_emc_qos_actmon_update(dev->max_freq / 1000);
+	} else {
+		clk_set_rate(dev->clk, dev->max_freq);
+	}
 	dev->max_freq /= 1000;
-	freq = clk_get_rate(dev->clk) / 1000;
+	/* the user clock was set to 0 on the QoS path, the bus runs at
+	   the rate requested from the governor */
+	if (dev->emc_qos)
+		freq = dev->max_freq;
+	else
+		freq = clk_get_rate(dev->clk) / 1000;
 	actmon_dev_configure(dev, freq);
 
 	/* actmon device controls shared bus user clock, but rate
@@ -499,6 +529,7 @@ static struct actmon_dev actmon_dev_emc = {
 
 	.type			= ACTMON_FREQ_SAMPLER,
 	.state			= ACTMON_UNINITIALIZED,
+	.emc_qos		= ACTMON_EMC_QOS,
 
 	.rate_change_nb = {
 		.notifier_call = actmon_rate_notify_cb,
@@ -539,6 +570,24 @@ static struct actmon_dev *actmon_devices[] = {
 	&actmon_dev_avp,
 };
 
+/* EMC activity as % of the current EMC rate, from the last average */
+unsigned int tegra_actmon_emc_load(void)
+{
+	unsigned long flags;
+	unsigned int load = 0;
+	struct actmon_dev *dev = &actmon_dev_emc;
+
+	if (dev->state == ACTMON_UNINITIALIZED)
+		return 0;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if ((dev->state == ACTMON_ON) && dev->cur_freq)
+		load = min(dev->avg_actv_freq * 100 / dev->cur_freq, 100UL);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return load;
+}
+
 /* Activity monitor suspend/resume */
 static int actmon_pm_notify(struct notifier_block *nb,
 			    unsigned long event, void *data)
@@ -3984,6 +3984,7 @@ struct clk tegra_list_clks[] = {
 	SHARED_CLK("usb2.emc",	"tegra-ehci.1",		"emc",	&tegra_clk_emc, NULL, 0, 0),
 	SHARED_CLK("usb3.emc",	"tegra-ehci.2",		"emc",	&tegra_clk_emc, NULL, 0, 0),
 	SHARED_CLK("mon.emc",	"tegra_actmon",		"emc",	&tegra_clk_emc, NULL, 0, 0),
+	SHARED_CLK("qos.emc",	"tegra_emc_qos",	"emc",	&tegra_clk_emc, NULL, 0, 0),
 	SHARED_CLK("cap.emc",	"cap.emc",		NULL,	&tegra_clk_emc, NULL, 0, SHARED_CEILING),
 	SHARED_CLK("3d.emc",	"tegra_gr3d",		"emc",	&tegra_clk_emc, NULL, 0, 0),
 	SHARED_CLK("2d.emc",	"tegra_gr2d",		"emc",	&tegra_clk_emc, NULL, 0, 0),
@@ -4443,6 +4444,7 @@ static void tegra_clk_resume(void)
 	   suspend, update current state, and mark EMC DFS as out of sync */
 	p = tegra_clk_emc.parent;
 	tegra3_periph_clk_init(&tegra_clk_emc);
+	clk_rate_resync(&tegra_clk_emc);
 
 	if (p != tegra_clk_emc.parent) {
 		/* FIXME: old parent is left enabled here even if EMC was its
@@ -4464,6 +4466,8 @@ static void tegra_clk_resume(void)
 
 	tegra3_pll_clk_init(&tegra_pll_u); /* Re-init utmi parameters */
 	tegra3_pll_clk_init(&tegra_pll_p); /* Fire a bug if not restored */
+	clk_rate_resync(&tegra_pll_u);
+	clk_rate_resync(&tegra_pll_p);
 }
 #else
 #define tegra_clk_suspend NULL
@@ -0,0 +1,643 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Based on the deadline scheduler, Copyright (C) 2002 Jens Axboe.
+ *
+ *  On eMMC and other managed flash there is no seek to avoid, but a read
+ *  stuck behind a stream of writes waits for the card to program them and
+ *  writes are cheapest when they arrive in big, aligned runs. So:
+ *
+ *  - reads are served first, in arrival order;
+ *  - writes are sent in batches of up to write_batch_kb, starting at the
+ *    chunk_kb aligned chunk of the oldest write and going up in sector
+ *    order, once reads have starved them writes_starved times or the
+ *    oldest has expired;
+ *  - discards wait until the device has been idle for discard_idle ms,
+ *    or until they expire.
+ *
+ *  See Documentation/block/flash-iosched.txt
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/workqueue.h>
+
+enum {
+	FLASH_READ,
+	FLASH_WRITE,
+	FLASH_DISCARD,
+	FLASH_NR_TYPES,
+};
+
+static const int writes_starved = 16;		/* reads sent while writes wait */
+static const int write_expire = HZ;		/* async writes */
+static const int sync_write_expire = HZ / 10;	/* fsync and O_SYNC writes */
+static const int write_batch_kb = 1024;		/* one write batch */
+static const int chunk_kb = 512;		/* write batch alignment */
+static const int discard_idle = HZ / 10;	/* idle time before discards */
+static const int discard_expire = 5 * HZ;	/* discards go out regardless */
+
+struct flash_data {
+	struct request_queue *queue;
+
+	/*
+	 * requests are on both sort_list and fifo_list of their type
+	 */
+	struct rb_root sort_list[FLASH_NR_TYPES];
+	struct list_head fifo_list[FLASH_NR_TYPES];
+
+	/*
+	 * current write batch: next write in sort order and what is left
+	 * of the batch, in sectors
+	 */
+	struct request *next_write;
+	unsigned int batch_left;
+	int batch_forced;		/* reads may not cut it short */
+	int starved;			/* reads sent while writes wait */
+
+	unsigned int in_driver;
+	unsigned long last_busy;	/* jiffies the device was last busy */
+	struct delayed_work kick_work;
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int writes_starved;
+	int write_expire;
+	int sync_write_expire;
+	int write_batch_kb;
+	int chunk_kb;
+	int discard_idle;
+	int discard_expire;
+	int front_merges;
+};
+
+static void flash_move_to_dispatch(struct flash_data *, struct request *);
+
+static inline int flash_rq_type(struct request *rq)
+{
+	if (rq->cmd_flags & REQ_DISCARD)
+		return FLASH_DISCARD;
+	return rq_data_dir(rq) == READ ? FLASH_READ : FLASH_WRITE;
+}
+
+static inline int flash_bio_type(struct bio *bio)
+{
+	if (bio->bi_rw & REQ_DISCARD)
+		return FLASH_DISCARD;
+	return bio_data_dir(bio) == READ ? FLASH_READ : FLASH_WRITE;
+}
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[flash_rq_type(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_to_dispatch(fd, __alias);
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+static inline int flash_overlaps(struct request *a, struct request *b)
+{
+	return blk_rq_pos(a) < rq_end_sector(b) &&
+	       blk_rq_pos(b) < rq_end_sector(a);
+}
+
+/*
+ * Requests of @type that rq overlaps were queued before it and must not be
+ * overtaken by it: send them now. Used between discards and everything
+ * else, the only types that are not always dispatched in a safe order.
+ */
+static void flash_dispatch_overlaps(struct flash_data *fd, struct request *rq,
+				    int type)
+{
+	struct request *orq, *tmp;
+
+	list_for_each_entry_safe(orq, tmp, &fd->fifo_list[type], queuelist) {
+		if (flash_overlaps(orq, rq))
+			flash_move_to_dispatch(fd, orq);
+	}
+}
+
+static inline int flash_bio_overlaps(struct request *rq, struct bio *bio)
+{
+	return blk_rq_pos(rq) < bio->bi_sector + bio_sectors(bio) &&
+	       bio->bi_sector < rq_end_sector(rq);
+}
+
+static int flash_bio_overlaps_type(struct flash_data *fd, struct bio *bio,
+				   int type)
+{
+	struct request *orq;
+
+	list_for_each_entry(orq, &fd->fifo_list[type], queuelist) {
+		if (flash_bio_overlaps(orq, bio))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * A bio merged into a queued request never goes through
+ * flash_add_request(), so it must not carry its sectors past an overlapping
+ * request of the other kind that is queued already: it gets a request of its
+ * own instead. Request to request merges need no check, neither side
+ * overlaps anything it has to be ordered against.
+ */
+static int flash_allow_merge(struct request_queue *q, struct request *rq,
+			     struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (flash_bio_type(bio) == FLASH_DISCARD)
+		return !flash_bio_overlaps_type(fd, bio, FLASH_READ) &&
+		       !flash_bio_overlaps_type(fd, bio, FLASH_WRITE);
+
+	return !flash_bio_overlaps_type(fd, bio, FLASH_DISCARD);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int type = flash_rq_type(rq);
+	int expire;
+
+	if (type == FLASH_DISCARD) {
+		flash_dispatch_overlaps(fd, rq, FLASH_READ);
+		flash_dispatch_overlaps(fd, rq, FLASH_WRITE);
+	} else
+		flash_dispatch_overlaps(fd, rq, FLASH_DISCARD);
+
+	flash_add_rq_rb(fd, rq);
+
+	if (type == FLASH_WRITE)
+		expire = rq_is_sync(rq) ? fd->sync_write_expire :
+					  fd->write_expire;
+	else if (type == FLASH_DISCARD)
+		expire = fd->discard_expire;
+	else
+		expire = 0;		/* reads go in fifo order anyway */
+
+	rq_set_fifo_time(rq, jiffies + expire);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[type]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[flash_bio_type(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void
+flash_move_to_dispatch(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+static inline int flash_fifo_expired(struct flash_data *fd, int type)
+{
+	struct request *rq;
+
+	if (list_empty(&fd->fifo_list[type]))
+		return 0;
+
+	rq = rq_entry_fifo(fd->fifo_list[type].next);
+
+	return time_after_eq(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Start a write batch at the oldest write: back up to the first queued
+ * write in its chunk, so the chunk is written from its start.
+ */
+static void flash_start_write_batch(struct flash_data *fd, int forced)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[FLASH_WRITE].next);
+	unsigned int chunk = fd->chunk_kb << 1;
+	sector_t start = blk_rq_pos(rq);
+	struct rb_node *node;
+
+	if (chunk) {
+		sector_t off = start;
+
+		start -= sector_div(off, chunk);
+	}
+
+	while ((node = rb_prev(&rq->rb_node)) &&
+	       blk_rq_pos(rb_entry_rq(node)) >= start)
+		rq = rb_entry_rq(node);
+
+	fd->next_write = rq;
+	fd->batch_left = fd->write_batch_kb << 1;
+	fd->batch_forced = forced;
+	fd->starved = 0;
+}
+
+static void flash_dispatch_write(struct flash_data *fd)
+{
+	struct request *rq = fd->next_write;
+	unsigned int sectors = blk_rq_sectors(rq);
+
+	fd->batch_left -= min(fd->batch_left, sectors);
+	flash_move_to_dispatch(fd, rq);
+	if (!fd->batch_left)
+		fd->next_write = NULL;
+}
+
+/*
+ * Discards are sent when nothing else is queued and the device has been
+ * idle for discard_idle, or when the oldest one has expired. Otherwise
+ * make sure the queue is run again once the idle time has passed.
+ */
+static int flash_dispatch_discard(struct flash_data *fd, int force)
+{
+	struct request *rq;
+	unsigned long idle_at;
+
+	if (list_empty(&fd->fifo_list[FLASH_DISCARD]))
+		return 0;
+
+	if (!force && !flash_fifo_expired(fd, FLASH_DISCARD)) {
+		if (fd->in_driver)
+			return 0;	/* completion kicks the queue */
+
+		idle_at = fd->last_busy + fd->discard_idle;
+		if (time_before(jiffies, idle_at)) {
+			kblockd_schedule_delayed_work(fd->queue,
+				&fd->kick_work, idle_at - jiffies);
+			return 0;
+		}
+	}
+
+	rq = rq_entry_fifo(fd->fifo_list[FLASH_DISCARD].next);
+	flash_move_to_dispatch(fd, rq);
+
+	return 1;
+}
+
+/*
+ * flash_dispatch_requests selects the best request according to the read
+ * preference, write starvation and batching, and discard idling
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[FLASH_READ]);
+	const int writes = !list_empty(&fd->fifo_list[FLASH_WRITE]);
+	struct request *rq;
+
+	/* expired discards get out even past busy reads and writes */
+	if (flash_fifo_expired(fd, FLASH_DISCARD))
+		return flash_dispatch_discard(fd, 1);
+
+	/*
+	 * keep going with a write batch, unless it was started on an idle
+	 * queue and reads have shown up since
+	 */
+	if (fd->next_write && (fd->batch_forced || !reads)) {
+		flash_dispatch_write(fd);
+		return 1;
+	}
+
+	if (reads) {
+		if (writes && (fd->starved++ >= fd->writes_starved ||
+			       flash_fifo_expired(fd, FLASH_WRITE))) {
+			flash_start_write_batch(fd, 1);
+			flash_dispatch_write(fd);
+			return 1;
+		}
+
+		rq = rq_entry_fifo(fd->fifo_list[FLASH_READ].next);
+		fd->next_write = NULL;
+		flash_move_to_dispatch(fd, rq);
+		return 1;
+	}
+
+	if (writes) {
+		flash_start_write_batch(fd, 0);
+		flash_dispatch_write(fd);
+		return 1;
+	}
+
+	return flash_dispatch_discard(fd, force);
+}
+
+static void flash_activate_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	fd->in_driver++;
+}
+
+static void flash_deactivate_request(struct request_queue *q,
+				     struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	WARN_ON(!fd->in_driver);
+	fd->in_driver--;
+}
+
+static void flash_completed_request(struct request_queue *q,
+				    struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	WARN_ON(!fd->in_driver);
+	fd->in_driver--;
+	fd->last_busy = jiffies;
+
+	/* the idle period for held back discards starts now */
+	if (!fd->in_driver && !list_empty(&fd->fifo_list[FLASH_DISCARD]))
+		kblockd_schedule_delayed_work(q, &fd->kick_work,
+					      fd->discard_idle);
+}
+
+static void flash_kick_queue(struct work_struct *work)
+{
+	struct flash_data *fd =
+		container_of(work, struct flash_data, kick_work.work);
+	struct request_queue *q = fd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(q);
+	spin_unlock_irq(q->queue_lock);
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	cancel_delayed_work_sync(&fd->kick_work);
+
+	BUG_ON(!list_empty(&fd->fifo_list[FLASH_READ]));
+	BUG_ON(!list_empty(&fd->fifo_list[FLASH_WRITE]));
+	BUG_ON(!list_empty(&fd->fifo_list[FLASH_DISCARD]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int i;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	for (i = 0; i < FLASH_NR_TYPES; i++) {
+		INIT_LIST_HEAD(&fd->fifo_list[i]);
+		fd->sort_list[i] = RB_ROOT;
+	}
+	fd->queue = q;
+	fd->last_busy = jiffies;
+	INIT_DELAYED_WORK(&fd->kick_work, flash_kick_queue);
+
+	fd->writes_starved = writes_starved;
+	fd->write_expire = write_expire;
+	fd->sync_write_expire = sync_write_expire;
+	fd->write_batch_kb = write_batch_kb;
+	fd->chunk_kb = chunk_kb;
+	fd->discard_idle = discard_idle;
+	fd->discard_expire = discard_expire;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_expire_show, fd->write_expire, 1);
+SHOW_FUNCTION(flash_sync_write_expire_show, fd->sync_write_expire, 1);
+SHOW_FUNCTION(flash_write_batch_kb_show, fd->write_batch_kb, 0);
+SHOW_FUNCTION(flash_chunk_kb_show, fd->chunk_kb, 0);
+SHOW_FUNCTION(flash_discard_idle_show, fd->discard_idle, 1);
+SHOW_FUNCTION(flash_discard_expire_show, fd->discard_expire, 1);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_expire_store, &fd->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_sync_write_expire_store, &fd->sync_write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_write_batch_kb_store, &fd->write_batch_kb, 1, INT_MAX >> 1, 0);
+STORE_FUNCTION(flash_chunk_kb_store, &fd->chunk_kb, 0, INT_MAX >> 1, 0);
+STORE_FUNCTION(flash_discard_idle_store, &fd->discard_idle, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_discard_expire_store, &fd->discard_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(writes_starved),
+	FD_ATTR(write_expire),
+	FD_ATTR(sync_write_expire),
+	FD_ATTR(write_batch_kb),
+	FD_ATTR(chunk_kb),
+	FD_ATTR(discard_idle),
+	FD_ATTR(discard_expire),
+	FD_ATTR(front_merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_allow_merge_fn =	flash_allow_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_activate_req_fn =	flash_activate_request,
+		.elevator_deactivate_req_fn =	flash_deactivate_request,
+		.elevator_completed_req_fn =	flash_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -0,0 +1,217 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * Scheduler-driven cpufreq governor.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/init.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+
+/*
+ * The fair class calls cpufreq_sched_update() with the rq lock held and
+ * interrupts off, so the fast path only turns the utilization into a
+ * table frequency and records it. Drivers such as tegra_target() take
+ * mutexes and program clocks, so the request is handed over through an
+ * irq_work (we cannot wake a task under the rq lock) to a SCHED_FIFO
+ * thread which calls into the driver. Nothing here runs from a timer.
+ */
+
+struct cpufreq_sched_cpu {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	unsigned int min;
+	unsigned int max;
+	unsigned int req_freq;	/* written by the fast path only */
+	int enabled;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpu, sched_cpu);
+static DEFINE_PER_CPU(struct irq_work, sched_irq_work);
+
+/* cpus with a req_freq the thread has not applied yet */
+static cpumask_t pending_mask;
+
+static struct task_struct *sched_task;
+
+/* serializes the thread against governor start/stop/limits */
+static DEFINE_MUTEX(sched_mutex);
+
+/* utilization is scaled by 5/4 so 80% busy asks for policy max */
+static unsigned int sched_util_to_freq(struct cpufreq_sched_cpu *sc,
+				       unsigned long util)
+{
+	struct cpufreq_frequency_table *table = sc->freq_table;
+	unsigned int target, freq, best = sc->max;
+	int i;
+
+	target = ((u64)sc->max * (util + (util >> 2))) >> SCHED_LOAD_SHIFT;
+	if (target <= sc->min)
+		return sc->min;
+	if (target >= sc->max)
+		return sc->max;
+
+	/* lowest table frequency at or above the target */
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		freq = table[i].frequency;
+		if (freq == CPUFREQ_ENTRY_INVALID)
+			continue;
+		if (freq >= target && freq < best)
+			best = freq;
+	}
+
+	return best;
+}
+
+void cpufreq_sched_update(int cpu, unsigned long util)
+{
+	struct cpufreq_sched_cpu *sc = &per_cpu(sched_cpu, cpu);
+	unsigned int freq;
+
+	if (!sc->enabled)
+		return;
+
+	freq = sched_util_to_freq(sc, util);
+	if (freq == sc->req_freq)
+		return;
+
+	sc->req_freq = freq;
+	cpumask_set_cpu(cpu, &pending_mask);
+	irq_work_queue(&__get_cpu_var(sched_irq_work));
+}
+
+static void cpufreq_sched_irq_work(struct irq_work *work)
+{
+	wake_up_process(sched_task);
+}
+
+static int cpufreq_sched_thread(void *data)
+{
+	struct cpufreq_sched_cpu *sc;
+	unsigned int cpu;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+
+		if (cpumask_empty(&pending_mask)) {
+			schedule();
+
+			if (kthread_should_stop())
+				break;
+		}
+
+		set_current_state(TASK_RUNNING);
+
+		mutex_lock(&sched_mutex);
+		for_each_cpu(cpu, &pending_mask) {
+			cpumask_clear_cpu(cpu, &pending_mask);
+			sc = &per_cpu(sched_cpu, cpu);
+			if (!sc->enabled)
+				continue;
+
+			__cpufreq_driver_target(sc->policy,
+						ACCESS_ONCE(sc->req_freq),
+						CPUFREQ_RELATION_L);
+		}
+		mutex_unlock(&sched_mutex);
+	}
+
+	return 0;
+}
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+				  unsigned int event)
+{
+	struct cpufreq_sched_cpu *sc = &per_cpu(sched_cpu, policy->cpu);
+	struct cpufreq_frequency_table *table;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu))
+			return -EINVAL;
+
+		table = cpufreq_frequency_get_table(policy->cpu);
+		if (!table)
+			return -EINVAL;
+
+		mutex_lock(&sched_mutex);
+		sc->policy = policy;
+		sc->freq_table = table;
+		sc->min = policy->min;
+		sc->max = policy->max;
+		sc->req_freq = policy->cur;
+		smp_wmb();
+		sc->enabled = 1;
+		mutex_unlock(&sched_mutex);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		mutex_lock(&sched_mutex);
+		sc->enabled = 0;
+		cpumask_clear_cpu(policy->cpu, &pending_mask);
+		mutex_unlock(&sched_mutex);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&sched_mutex);
+		sc->min = policy->min;
+		sc->max = policy->max;
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		mutex_unlock(&sched_mutex);
+		break;
+	}
+
+	return 0;
+}
+
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+static int __init cpufreq_sched_init(void)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+	unsigned int i;
+
+	for_each_possible_cpu(i)
+		init_irq_work(&per_cpu(sched_irq_work, i),
+			      cpufreq_sched_irq_work);
+
+	sched_task = kthread_create(cpufreq_sched_thread, NULL, "kschedfreq");
+	if (IS_ERR(sched_task))
+		return PTR_ERR(sched_task);
+
+	sched_setscheduler_nocheck(sched_task, SCHED_FIFO, &param);
+	get_task_struct(sched_task);
+
+	/* NB: wake up so the thread does not look hung to the freezer */
+	wake_up_process(sched_task);
+
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+fs_initcall(cpufreq_sched_init);
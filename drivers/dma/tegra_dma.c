@@ -0,0 +1,537 @@
+/*
+ * drivers/dma/tegra_dma.c
+ *
+ * dmaengine driver for the NVIDIA Tegra APB DMA controller
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/kernel.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/platform_device.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include <mach/dma.h>
+
+/*
+ * Each dmaengine channel owns one channel of the system DMA driver in
+ * arch/arm/mach-tegra/dma.c. A prepared descriptor is a chain of
+ * tegra_dma_req, one per scatterlist entry or cyclic period, and all of
+ * them are handed to the channel queue at once when the descriptor is
+ * issued. The channel ISR then starts the next request before it runs
+ * the completion of the previous one, so back to back requests are not
+ * held up by client callbacks. Cyclic transfers run the channel in
+ * continuous mode, where the next period is latched into the hardware
+ * while the current one is still moving.
+ *
+ * Client callbacks are called straight from the DMA ISR, there is no
+ * tasklet in between, so they must not sleep.
+ *
+ * Clients pass a struct tegra_dma_slave through dma_chan->private from
+ * their dma_request_channel() filter to select the request line.
+ */
+
+#define TEGRA_DMAE_CHANNELS		16
+
+/* APB side is always a single FIFO register */
+#define TEGRA_DMAE_APB_WRAP		4
+#define TEGRA_DMAE_AHB_BUS_WIDTH	32
+
+struct tegra_dmae_desc {
+	struct dma_async_tx_descriptor	txd;
+	struct list_head		node;
+	bool				cyclic;
+	bool				active;
+	size_t				len;
+	size_t				bytes_done;
+	unsigned int			nr_reqs;
+	unsigned int			nr_done;
+	unsigned int			pending;	/* completions still owed */
+	struct tegra_dma_req		reqs[0];
+};
+
+struct tegra_dmae_chan {
+	struct dma_chan			chan;
+	struct tegra_dma_channel	*ch;
+	int				mode;
+	unsigned long			req_sel;
+	struct dma_slave_config		cfg;
+
+	spinlock_t			lock;
+	struct list_head		submitted;	/* not issued yet */
+	struct list_head		queued;		/* waiting for the channel */
+	struct list_head		active;		/* on the channel queue */
+	dma_cookie_t			completed_cookie;
+};
+
+struct tegra_dmae {
+	struct dma_device		dma;
+	struct device_dma_parameters	dma_parms;
+	struct tegra_dmae_chan		chans[TEGRA_DMAE_CHANNELS];
+};
+
+static struct tegra_dmae tegra_dmae;
+
+static inline struct tegra_dmae_chan *to_tegra_dmae_chan(struct dma_chan *c)
+{
+	return container_of(c, struct tegra_dmae_chan, chan);
+}
+
+static inline struct tegra_dmae_desc *to_tegra_dmae_desc(
+	struct dma_async_tx_descriptor *txd)
+{
+	return container_of(txd, struct tegra_dmae_desc, txd);
+}
+
+/* must be called with tc->lock held */
+static void tegra_dmae_start(struct tegra_dmae_chan *tc)
+{
+	struct tegra_dmae_desc *d, *tmp;
+	unsigned int i;
+	int mode;
+
+	list_for_each_entry_safe(d, tmp, &tc->queued, node) {
+		mode = d->cyclic ? TEGRA_DMA_MODE_CONTINUOUS_SINGLE :
+			TEGRA_DMA_MODE_ONESHOT;
+
+		if (!list_empty(&tc->active)) {
+			/* oneshot descriptors chain, a cyclic one owns
+			 * the channel until it is terminated */
+			if (d->cyclic || tc->mode != mode)
+				break;
+		} else if (tc->mode != mode) {
+			if (tegra_dma_set_mode(tc->ch, mode))
+				break;
+			tc->mode = mode;
+		}
+
+		list_move_tail(&d->node, &tc->active);
+		d->active = true;
+		d->pending = d->nr_reqs;
+		for (i = 0; i < d->nr_reqs; i++)
+			tegra_dma_enqueue_req(tc->ch, &d->reqs[i]);
+	}
+}
+
+/*
+ * Called from the channel ISR without the channel lock held. The ISR may
+ * already have taken the request off the channel queue when the
+ * descriptor is terminated, so the descriptor stays allocated until every
+ * request handed to the channel has either been cancelled or come through
+ * here, see d->pending.
+ */
+static void tegra_dmae_req_complete(struct tegra_dma_req *req)
+{
+	struct tegra_dmae_desc *d = req->dev;
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(d->txd.chan);
+	dma_async_tx_callback callback = NULL;
+	void *param = NULL;
+	unsigned long flags;
+	bool done;
+
+	spin_lock_irqsave(&tc->lock, flags);
+
+	/* terminated while this request was finishing */
+	if (!d->active || req->status != TEGRA_DMA_REQ_SUCCESS) {
+		done = !--d->pending && !d->active;
+		spin_unlock_irqrestore(&tc->lock, flags);
+		if (done)
+			kfree(d);
+		return;
+	}
+
+	if (d->cyclic) {
+		d->bytes_done += req->size;
+		if (d->bytes_done >= d->len)
+			d->bytes_done = 0;
+
+		/* put the period back at the tail of the ring */
+		tegra_dma_enqueue_req(tc->ch, req);
+
+		callback = d->txd.callback;
+		param = d->txd.callback_param;
+		spin_unlock_irqrestore(&tc->lock, flags);
+
+		if (callback)
+			callback(param);
+		return;
+	}
+
+	d->bytes_done += req->bytes_transferred;
+	d->pending--;
+	if (++d->nr_done < d->nr_reqs) {
+		spin_unlock_irqrestore(&tc->lock, flags);
+		return;
+	}
+
+	list_del(&d->node);
+	d->active = false;
+	tc->completed_cookie = d->txd.cookie;
+	if (d->txd.flags & DMA_PREP_INTERRUPT) {
+		callback = d->txd.callback;
+		param = d->txd.callback_param;
+	}
+
+	tegra_dmae_start(tc);
+	spin_unlock_irqrestore(&tc->lock, flags);
+
+	kfree(d);
+
+	if (callback)
+		callback(param);
+}
+
+static dma_cookie_t tegra_dmae_tx_submit(struct dma_async_tx_descriptor *txd)
+{
+	struct tegra_dmae_desc *d = to_tegra_dmae_desc(txd);
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(txd->chan);
+	dma_cookie_t cookie;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tc->lock, flags);
+
+	cookie = tc->chan.cookie + 1;
+	if (cookie < 0)
+		cookie = 1;
+	tc->chan.cookie = cookie;
+	txd->cookie = cookie;
+
+	list_add_tail(&d->node, &tc->submitted);
+
+	spin_unlock_irqrestore(&tc->lock, flags);
+
+	return cookie;
+}
+
+static struct tegra_dmae_desc *tegra_dmae_alloc_desc(struct tegra_dmae_chan *tc,
+	unsigned int nr_reqs)
+{
+	struct tegra_dmae_desc *d;
+
+	d = kzalloc(sizeof(*d) + nr_reqs * sizeof(d->reqs[0]), GFP_ATOMIC);
+	if (!d)
+		return NULL;
+
+	dma_async_tx_descriptor_init(&d->txd, &tc->chan);
+	d->txd.tx_submit = tegra_dmae_tx_submit;
+	INIT_LIST_HEAD(&d->node);
+	d->nr_reqs = nr_reqs;
+
+	return d;
+}
+
+static int tegra_dmae_fill_req(struct tegra_dmae_chan *tc,
+	struct tegra_dmae_desc *d, struct tegra_dma_req *req,
+	dma_addr_t addr, size_t len, enum dma_data_direction direction)
+{
+	unsigned long apb_addr;
+	unsigned int apb_width;
+
+	if (!len || len > TEGRA_DMA_MAX_TRANSFER_SIZE || (len & 0x3) ||
+	    (addr & 0x3))
+		return -EINVAL;
+
+	if (direction == DMA_TO_DEVICE) {
+		apb_addr = tc->cfg.dst_addr;
+		apb_width = tc->cfg.dst_addr_width;
+	} else {
+		apb_addr = tc->cfg.src_addr;
+		apb_width = tc->cfg.src_addr_width;
+	}
+
+	if (!apb_addr)
+		return -EINVAL;
+
+	apb_width = apb_width ? apb_width * 8 : 32;
+
+	req->complete = tegra_dmae_req_complete;
+	req->dev = d;
+	req->req_sel = tc->req_sel;
+	req->size = len;
+	req->to_memory = (direction == DMA_FROM_DEVICE);
+
+	if (req->to_memory) {
+		req->source_addr = apb_addr;
+		req->source_wrap = TEGRA_DMAE_APB_WRAP;
+		req->source_bus_width = apb_width;
+		req->dest_addr = addr;
+		req->dest_wrap = 0;
+		req->dest_bus_width = TEGRA_DMAE_AHB_BUS_WIDTH;
+	} else {
+		req->source_addr = addr;
+		req->source_wrap = 0;
+		req->source_bus_width = TEGRA_DMAE_AHB_BUS_WIDTH;
+		req->dest_addr = apb_addr;
+		req->dest_wrap = TEGRA_DMAE_APB_WRAP;
+		req->dest_bus_width = apb_width;
+	}
+
+	d->len += len;
+
+	return 0;
+}
+
+static struct dma_async_tx_descriptor *tegra_dmae_prep_slave_sg(
+	struct dma_chan *chan, struct scatterlist *sgl, unsigned int sg_len,
+	enum dma_data_direction direction, unsigned long flags)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+	struct tegra_dmae_desc *d;
+	struct scatterlist *sg;
+	unsigned int i;
+
+	if (!sg_len ||
+	    (direction != DMA_TO_DEVICE && direction != DMA_FROM_DEVICE))
+		return NULL;
+
+	d = tegra_dmae_alloc_desc(tc, sg_len);
+	if (!d)
+		return NULL;
+
+	for_each_sg(sgl, sg, sg_len, i) {
+		if (tegra_dmae_fill_req(tc, d, &d->reqs[i], sg_dma_address(sg),
+					sg_dma_len(sg), direction)) {
+			dev_err(&chan->dev->device, "invalid sg entry %u\n", i);
+			kfree(d);
+			return NULL;
+		}
+	}
+
+	d->txd.flags = flags;
+
+	return &d->txd;
+}
+
+static struct dma_async_tx_descriptor *tegra_dmae_prep_dma_cyclic(
+	struct dma_chan *chan, dma_addr_t buf_addr, size_t buf_len,
+	size_t period_len, enum dma_data_direction direction)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+	struct tegra_dmae_desc *d;
+	unsigned int i, nr_periods;
+
+	if (!period_len || (buf_len % period_len) ||
+	    (direction != DMA_TO_DEVICE && direction != DMA_FROM_DEVICE))
+		return NULL;
+
+	nr_periods = buf_len / period_len;
+	d = tegra_dmae_alloc_desc(tc, nr_periods);
+	if (!d)
+		return NULL;
+
+	d->cyclic = true;
+	for (i = 0; i < nr_periods; i++) {
+		if (tegra_dmae_fill_req(tc, d, &d->reqs[i],
+					buf_addr + i * period_len,
+					period_len, direction)) {
+			dev_err(&chan->dev->device, "invalid cyclic buffer\n");
+			kfree(d);
+			return NULL;
+		}
+	}
+
+	return &d->txd;
+}
+
+static void tegra_dmae_terminate_all(struct tegra_dmae_chan *tc)
+{
+	struct tegra_dmae_desc *d, *tmp;
+	unsigned long flags;
+	unsigned int i;
+	LIST_HEAD(head);
+
+	spin_lock_irqsave(&tc->lock, flags);
+
+	tegra_dma_cancel(tc->ch);
+
+	/*
+	 * Requests still on the channel queue were marked aborted by the
+	 * cancel and will never complete. Anything else the ISR has already
+	 * taken, and its completion frees the descriptor once it gets here.
+	 */
+	list_for_each_entry_safe(d, tmp, &tc->active, node) {
+		d->active = false;
+		for (i = 0; i < d->nr_reqs; i++)
+			if (d->reqs[i].status == -TEGRA_DMA_REQ_ERROR_ABORTED)
+				d->pending--;
+		if (d->pending)
+			list_del_init(&d->node);
+		else
+			list_move_tail(&d->node, &head);
+	}
+	list_splice_tail_init(&tc->queued, &head);
+	list_splice_tail_init(&tc->submitted, &head);
+	tc->completed_cookie = tc->chan.cookie;
+
+	spin_unlock_irqrestore(&tc->lock, flags);
+
+	list_for_each_entry_safe(d, tmp, &head, node)
+		kfree(d);
+}
+
+static int tegra_dmae_control(struct dma_chan *chan, enum dma_ctrl_cmd cmd,
+	unsigned long arg)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+	struct dma_slave_config *cfg = (struct dma_slave_config *)arg;
+	unsigned long flags;
+
+	switch (cmd) {
+	case DMA_TERMINATE_ALL:
+		tegra_dmae_terminate_all(tc);
+		return 0;
+
+	case DMA_SLAVE_CONFIG:
+		spin_lock_irqsave(&tc->lock, flags);
+		tc->cfg = *cfg;
+		spin_unlock_irqrestore(&tc->lock, flags);
+		return 0;
+
+	default:
+		return -ENXIO;
+	}
+}
+
+static enum dma_status tegra_dmae_tx_status(struct dma_chan *chan,
+	dma_cookie_t cookie, struct dma_tx_state *txstate)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+	struct tegra_dmae_desc *d;
+	enum dma_status ret;
+	unsigned long flags;
+	u32 residue = 0;
+
+	spin_lock_irqsave(&tc->lock, flags);
+
+	ret = dma_async_is_complete(cookie, tc->completed_cookie,
+				    tc->chan.cookie);
+	if (ret != DMA_SUCCESS && !list_empty(&tc->active)) {
+		d = list_first_entry(&tc->active, struct tegra_dmae_desc, node);
+		if (d->txd.cookie == cookie) {
+			residue = d->len - d->bytes_done;
+			if (!d->cyclic)
+				residue -= tegra_dma_get_transfer_count(tc->ch,
+						&d->reqs[d->nr_done], false);
+		}
+	}
+
+	dma_set_tx_state(txstate, tc->completed_cookie, tc->chan.cookie,
+			 residue);
+
+	spin_unlock_irqrestore(&tc->lock, flags);
+
+	return ret;
+}
+
+static void tegra_dmae_issue_pending(struct dma_chan *chan)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&tc->lock, flags);
+	list_splice_tail_init(&tc->submitted, &tc->queued);
+	tegra_dmae_start(tc);
+	spin_unlock_irqrestore(&tc->lock, flags);
+}
+
+static int tegra_dmae_alloc_chan_resources(struct dma_chan *chan)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+	struct tegra_dma_slave *slave = chan->private;
+
+	if (!slave)
+		return -EINVAL;
+
+	tc->ch = tegra_dma_allocate_channel(TEGRA_DMA_MODE_ONESHOT, "%s",
+					    dma_chan_name(chan));
+	if (!tc->ch)
+		return -EBUSY;
+
+	tc->mode = TEGRA_DMA_MODE_ONESHOT;
+	tc->req_sel = slave->req_sel;
+	memset(&tc->cfg, 0, sizeof(tc->cfg));
+	chan->cookie = 1;
+	tc->completed_cookie = 1;
+
+	return 0;
+}
+
+static void tegra_dmae_free_chan_resources(struct dma_chan *chan)
+{
+	struct tegra_dmae_chan *tc = to_tegra_dmae_chan(chan);
+
+	tegra_dmae_terminate_all(tc);
+	tegra_dma_free_channel(tc->ch);
+	tc->ch = NULL;
+}
+
+static int __init tegra_dmae_init(void)
+{
+	struct platform_device *pdev;
+	struct dma_device *dma = &tegra_dmae.dma;
+	int i, ret;
+
+	pdev = platform_device_register_simple("tegra-apbdma", -1, NULL, 0);
+	if (IS_ERR(pdev))
+		return PTR_ERR(pdev);
+
+	dma_cap_set(DMA_SLAVE, dma->cap_mask);
+	dma_cap_set(DMA_PRIVATE, dma->cap_mask);
+	dma_cap_set(DMA_CYCLIC, dma->cap_mask);
+
+	INIT_LIST_HEAD(&dma->channels);
+	for (i = 0; i < TEGRA_DMAE_CHANNELS; i++) {
+		struct tegra_dmae_chan *tc = &tegra_dmae.chans[i];
+
+		tc->chan.device = dma;
+		spin_lock_init(&tc->lock);
+		INIT_LIST_HEAD(&tc->submitted);
+		INIT_LIST_HEAD(&tc->queued);
+		INIT_LIST_HEAD(&tc->active);
+		list_add_tail(&tc->chan.device_node, &dma->channels);
+	}
+
+	dma->dev = &pdev->dev;
+	dma->dev->dma_parms = &tegra_dmae.dma_parms;
+	dma_set_max_seg_size(dma->dev, TEGRA_DMA_MAX_TRANSFER_SIZE);
+
+	dma->device_alloc_chan_resources = tegra_dmae_alloc_chan_resources;
+	dma->device_free_chan_resources = tegra_dmae_free_chan_resources;
+	dma->device_prep_slave_sg = tegra_dmae_prep_slave_sg;
+	dma->device_prep_dma_cyclic = tegra_dmae_prep_dma_cyclic;
+	dma->device_control = tegra_dmae_control;
+	dma->device_tx_status = tegra_dmae_tx_status;
+	dma->device_issue_pending = tegra_dmae_issue_pending;
+
+	ret = dma_async_device_register(dma);
+	if (ret) {
+		dev_err(&pdev->dev, "unable to register\n");
+		platform_device_unregister(pdev);
+		return ret;
+	}
+
+	dev_info(&pdev->dev, "%d channels\n", TEGRA_DMAE_CHANNELS);
+
+	return 0;
+}
+subsys_initcall(tegra_dmae_init);
@@ -31,6 +31,10 @@
 #include <linux/mutex.h>
 #include <linux/scatterlist.h>
 #include <linux/string_helpers.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
@@ -72,6 +76,31 @@ static int max_devices;
 /* 256 minors, so at most 256 separate devices */
 static DECLARE_BITMAP(dev_use, 256);
 
+/*
+ * Upper bound on the requests packed into one eMMC packed write, on top of
+ * what the card and host allow. 0 turns packing off.
+ */
+static unsigned int packed_writes = MMC_PACKED_MAX;
+
+#define MMC_BLK_LAT_BUCKETS	16	/* log2 of us, last one open ended */
+#define MMC_BLK_PACKED_BUCKETS	6	/* log2 of entries, 2..63 */
+
+/*
+ * Time from handing a read/write to the host until it completes, and how
+ * well small writes get packed. Only the queue thread updates these.
+ */
+struct mmc_blk_stats {
+	unsigned long	reqs[2];		/* by rq_data_dir() */
+	u64		lat_us[2];
+	unsigned int	lat_max_us[2];
+	unsigned long	lat_hist[2][MMC_BLK_LAT_BUCKETS];
+
+	unsigned long	packed_cmds;
+	unsigned long	packed_reqs;
+	unsigned long	packed_fails;
+	unsigned long	packed_hist[MMC_BLK_PACKED_BUCKETS];
+};
+
 /*
  * There is one mmc_blk_data per slot.
  */
@@ -82,6 +111,9 @@ struct mmc_blk_data {
 
 	unsigned int	usage;
 	unsigned int	read_only;
+
+	struct mmc_blk_stats stats;
+	struct dentry	*stats_dentry;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -89,6 +121,9 @@ static DEFINE_MUTEX(open_lock);
 module_param(perdev_minors, int, 0444);
 MODULE_PARM_DESC(perdev_minors, "Minors numbers to allocate per device");
 
+module_param(packed_writes, uint, 0644);
+MODULE_PARM_DESC(packed_writes, "Most requests in one packed write, 0 disables");
+
 static struct mmc_blk_data *mmc_blk_get(struct gendisk *disk)
 {
 	struct mmc_blk_data *md;
@@ -168,11 +203,13 @@ static const struct block_device_operations mmc_bdops = {
 	.owner			= THIS_MODULE,
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
+enum mmc_blk_status {
+	MMC_BLK_SUCCESS = 0,
+	MMC_BLK_PARTIAL,
+	MMC_BLK_RETRY_SINGLE,
+	MMC_BLK_DATA_ERR,
+	MMC_BLK_CMD_ERR,
+	MMC_BLK_PACKED_ERR,
 };
 
 static u32 mmc_sd_num_wr_blocks(struct mmc_card *card)
@@ -272,8 +309,6 @@ static int mmc_blk_issue_discard_rq(struct mmc_queue *mq, struct request *req)
 	unsigned int from, nr, arg;
 	int err = 0;
 
-	mmc_claim_host(card->host);
-
 	if (!mmc_can_erase(card)) {
 		err = -EOPNOTSUPP;
 		goto out;
@@ -302,8 +337,6 @@ out:
 	__blk_end_request(req, err, blk_rq_bytes(req));
 	spin_unlock_irq(&md->lock);
 
-	mmc_release_host(card->host);
-
 	return err ? 0 : 1;
 }
 
@@ -315,8 +348,6 @@ static int mmc_blk_issue_secdiscard_rq(struct mmc_queue *mq,
 	unsigned int from, nr, arg;
 	int err = 0;
 
-	mmc_claim_host(card->host);
-
 	if (!mmc_can_secure_erase_trim(card)) {
 		err = -EOPNOTSUPP;
 		goto out;
@@ -355,204 +386,524 @@ out:
 	__blk_end_request(req, err, blk_rq_bytes(req));
 	spin_unlock_irq(&md->lock);
 
-	mmc_release_host(card->host);
-
 	return err ? 0 : 1;
 }
 
-static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
+static int mmc_blk_issue_flush(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
-	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request brq;
-	int ret = 1, disable_multi = 0;
+	int err;
 
-	mmc_claim_host(card->host);
+	err = mmc_flush_cache(md->queue.card);
 
-	do {
-		struct mmc_command cmd;
-		u32 readcmd, writecmd, status = 0;
-
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
-
-		brq.cmd.arg = blk_rq_pos(req);
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
+	spin_lock_irq(&md->lock);
+	__blk_end_request_all(req, err);
+	spin_unlock_irq(&md->lock);
 
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
+	return err ? 0 : 1;
+}
 
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
-		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
+/*
+ * Reliable writes bypass the cache and are used for REQ_FUA. Only the
+ * eMMC 4.4 flavour is supported, where any block count is allowed.
+ */
+static inline int mmc_blk_can_rel_wr(struct mmc_card *card)
+{
+	return (card->host->caps & MMC_CAP_CMD23) &&
+	       (card->ext_csd.rel_param & EXT_CSD_WR_REL_PARAM_EN);
+}
 
-		if (brq.data.blocks > 1) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host)
-					|| rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
-		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
+static int mmc_blk_err_check(struct mmc_card *card,
+			     struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_mrq = container_of(areq, struct mmc_queue_req,
+						    mmc_active);
+	struct mmc_blk_request *brq = &mq_mrq->brq;
+	struct request *req = mq_mrq->req;
+	struct mmc_command cmd;
+	u32 status = 0;
+
+	/*
+	 * Check for errors here, but don't jump to cmd_err
+	 * until later as we need to wait for the card to leave
+	 * programming mode even when things go wrong.
+	 */
+	if (brq->sbc.error || brq->cmd.error || brq->data.error ||
+	    brq->stop.error) {
+		if (brq->data.blocks > 1 && rq_data_dir(req) == READ) {
+			/* Redo read one sector at a time */
+			printk(KERN_WARNING "%s: retrying using single "
+			       "block read\n", req->rq_disk->disk_name);
+			return MMC_BLK_RETRY_SINGLE;
 		}
+		status = get_card_status(card, req);
+	}
+
+	if (brq->sbc.error) {
+		printk(KERN_ERR "%s: error %d sending SET_BLOCK_COUNT "
+		       "command, response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->sbc.error,
+		       brq->sbc.resp[0], status);
+	}
 
-		mmc_set_data_timeout(&brq.data, card);
+	if (brq->cmd.error) {
+		printk(KERN_ERR "%s: error %d sending read/write "
+		       "command, response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->cmd.error,
+		       brq->cmd.resp[0], status);
+	}
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+	if (brq->data.error) {
+		if (brq->data.error == -ETIMEDOUT && brq->mrq.stop)
+			/* 'Stop' response contains card status */
+			status = brq->mrq.stop->resp[0];
+		printk(KERN_ERR "%s: error %d transferring data,"
+		       " sector %u, nr %u, card status %#x\n",
+		       req->rq_disk->disk_name, brq->data.error,
+		       (unsigned)blk_rq_pos(req),
+		       (unsigned)blk_rq_sectors(req), status);
+	}
 
-		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
-		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
+	if (brq->stop.error) {
+		printk(KERN_ERR "%s: error %d sending stop command, "
+		       "response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->stop.error,
+		       brq->stop.resp[0], status);
+	}
+
+	if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
+		do {
+			int err;
+
+			memset(&cmd, 0, sizeof(struct mmc_command));
+			cmd.opcode = MMC_SEND_STATUS;
+			cmd.arg = card->rca << 16;
+			cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+			err = mmc_wait_for_cmd(card->host, &cmd, 5);
+			if (err) {
+				printk(KERN_ERR "%s: error %d requesting status\n",
+				       req->rq_disk->disk_name, err);
+				return MMC_BLK_CMD_ERR;
 			}
-			brq.data.sg_len = i;
-		}
+			/*
+			 * Some cards mishandle the status bits,
+			 * so make sure to check both the busy
+			 * indication and the card state.
+			 */
+		} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
+			(R1_CURRENT_STATE(cmd.resp[0]) == 7));
+	}
 
-		mmc_queue_bounce_pre(mq);
+	/* a packed write either went through as a whole or is redone */
+	if (mq_mrq->packed_nr) {
+		if (brq->sbc.error || brq->cmd.error || brq->stop.error ||
+		    brq->data.error ||
+		    brq->data.bytes_xfered != brq->data.blocks << 9)
+			return MMC_BLK_PACKED_ERR;
+		return MMC_BLK_SUCCESS;
+	}
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+	if (brq->sbc.error || brq->cmd.error || brq->stop.error ||
+	    brq->data.error) {
+		if (rq_data_dir(req) == READ)
+			return MMC_BLK_DATA_ERR;
+		else
+			return MMC_BLK_CMD_ERR;
+	}
 
-		mmc_queue_bounce_post(mq);
+	if (blk_rq_bytes(req) != brq->data.bytes_xfered)
+		return MMC_BLK_PARTIAL;
 
-		/*
-		 * Check for errors here, but don't jump to cmd_err
-		 * until later as we need to wait for the card to leave
-		 * programming mode even when things go wrong.
+	return MMC_BLK_SUCCESS;
+}
+
+static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
+			       struct mmc_card *card,
+			       int disable_multi,
+			       struct mmc_queue *mq)
+{
+	u32 readcmd, writecmd;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+	bool do_rel_wr = (req->cmd_flags & REQ_FUA) &&
+			 rq_data_dir(req) == WRITE &&
+			 mmc_blk_can_rel_wr(card);
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->cmd.arg = blk_rq_pos(req);
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = blk_rq_sectors(req);
+
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
+
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
+
+	/* reliable writes are only defined for CMD25 */
+	if (brq->data.blocks > 1 || do_rel_wr) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
 		 */
-		if (brq.cmd.error || brq.data.error || brq.stop.error) {
-			if (brq.data.blocks > 1 && rq_data_dir(req) == READ) {
-				/* Redo read one sector at a time */
-				printk(KERN_WARNING "%s: retrying using single "
-				       "block read\n", req->rq_disk->disk_name);
-				disable_multi = 1;
-				continue;
+		if (!mmc_host_is_spi(card->host)
+				|| rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+	}
+
+	if (do_rel_wr) {
+		brq->mrq.sbc = &brq->sbc;
+		brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+		brq->sbc.arg = brq->data.blocks | MMC_CMD23_ARG_REL_WR;
+		brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != blk_rq_sectors(req)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
 			}
-			status = get_card_status(card, req);
-		} else if (disable_multi == 1) {
-			disable_multi = 0;
 		}
+		brq->data.sg_len = i;
+	}
 
-		if (brq.cmd.error) {
-			printk(KERN_ERR "%s: error %d sending read/write "
-			       "command, response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.cmd.error,
-			       brq.cmd.resp[0], status);
-		}
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_err_check;
+	mqrq->start = ktime_get();
 
-		if (brq.data.error) {
-			if (brq.data.error == -ETIMEDOUT && brq.mrq.stop)
-				/* 'Stop' response contains card status */
-				status = brq.mrq.stop->resp[0];
-			printk(KERN_ERR "%s: error %d transferring data,"
-			       " sector %u, nr %u, card status %#x\n",
-			       req->rq_disk->disk_name, brq.data.error,
-			       (unsigned)blk_rq_pos(req),
-			       (unsigned)blk_rq_sectors(req), status);
-		}
+	mmc_queue_bounce_pre(mqrq);
+}
 
-		if (brq.stop.error) {
-			printk(KERN_ERR "%s: error %d sending stop command, "
-			       "response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.stop.error,
-			       brq.stop.resp[0], status);
-		}
+static inline bool mmc_blk_packable(struct request *req)
+{
+	return req->cmd_type == REQ_TYPE_FS && rq_data_dir(req) == WRITE &&
+	       blk_rq_sectors(req) &&
+	       !(req->cmd_flags & (REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
 
-		if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
-			do {
-				int err;
-
-				cmd.opcode = MMC_SEND_STATUS;
-				cmd.arg = card->rca << 16;
-				cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
-				err = mmc_wait_for_cmd(card->host, &cmd, 5);
-				if (err) {
-					printk(KERN_ERR "%s: error %d requesting status\n",
-					       req->rq_disk->disk_name, err);
-					goto cmd_err;
-				}
-				/*
-				 * Some cards mishandle the status bits,
-				 * so make sure to check both the busy
-				 * indication and the card state.
-				 */
-			} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
-				(R1_CURRENT_STATE(cmd.resp[0]) == 7));
-
-#if 0
-			if (cmd.resp[0] & ~0x00000900)
-				printk(KERN_ERR "%s: status = %08x\n",
-				       req->rq_disk->disk_name, cmd.resp[0]);
-			if (mmc_decode_status(cmd.resp))
-				goto cmd_err;
-#endif
-		}
+/*
+ * Pull the writes queued right behind mqrq->req into one packed write,
+ * as long as they fit the header and the host's transfer limits. Reads,
+ * flushes, discards and FUA writes end the pack.
+ */
+static void mmc_blk_packed_gather(struct mmc_queue *mq,
+				  struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_host *host = mq->card->host;
+	struct request *req = mqrq->req, *next;
+	unsigned int max_nr, max_blocks, nr = 1;
+	unsigned int blocks, segs;
+
+	max_nr = min(mq->max_packed, packed_writes);
+	if (max_nr < 2 || !mmc_blk_packable(req))
+		return;
 
-		if (brq.cmd.error || brq.stop.error || brq.data.error) {
-			if (rq_data_dir(req) == READ) {
+	max_blocks = min(host->max_blk_count, host->max_req_size >> 9);
+	blocks = 1 + blk_rq_sectors(req);
+	segs = 1 + req->nr_phys_segments;
+
+	spin_lock_irq(&md->lock);
+	while (nr < max_nr) {
+		next = blk_peek_request(mq->queue);
+		if (!next || !mmc_blk_packable(next))
+			break;
+		if (blocks + blk_rq_sectors(next) > max_blocks ||
+		    segs + next->nr_phys_segments > host->max_segs)
+			break;
+
+		blk_start_request(next);
+		if (nr == 1)
+			list_add_tail(&req->queuelist, &mqrq->packed_list);
+		list_add_tail(&next->queuelist, &mqrq->packed_list);
+		blocks += blk_rq_sectors(next);
+		segs += next->nr_phys_segments;
+		nr++;
+	}
+	spin_unlock_irq(&md->lock);
+
+	if (nr > 1) {
+		mqrq->packed_nr = nr;
+		mqrq->packed_blocks = blocks - 1;
+	}
+}
+
+static void mmc_blk_packed_rq_prep(struct mmc_queue_req *mqrq,
+				   struct mmc_card *card,
+				   struct mmc_queue *mq)
+{
+	struct mmc_blk_request *brq = &mqrq->brq;
+	__le32 *hdr = mqrq->packed_hdr;
+	struct request *req;
+	int i = 1;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	memset(hdr, 0, MMC_PACKED_HDR_SIZE);
+
+	/* one CMD23/CMD25 argument pair per request, after a version word */
+	hdr[0] = cpu_to_le32((mqrq->packed_nr << 16) |
+			     (EXT_CSD_PACKED_WRITE << 8) |
+			     EXT_CSD_PACKED_VERSION);
+	list_for_each_entry(req, &mqrq->packed_list, queuelist) {
+		hdr[i * 2] = cpu_to_le32(blk_rq_sectors(req));
+		hdr[i * 2 + 1] = cpu_to_le32(blk_rq_pos(req));
+		i++;
+	}
+
+	brq->mrq.sbc = &brq->sbc;
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+	brq->mrq.stop = &brq->stop;
+
+	brq->sbc.opcode = MMC_SET_BLOCK_COUNT;
+	brq->sbc.arg = MMC_CMD23_ARG_PACKED | (mqrq->packed_blocks + 1);
+	brq->sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+
+	brq->cmd.opcode = MMC_WRITE_MULTIPLE_BLOCK;
+	brq->cmd.arg = blk_rq_pos(mqrq->req);
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+
+	brq->data.blksz = 512;
+	brq->data.blocks = mqrq->packed_blocks + 1;
+	brq->data.flags |= MMC_DATA_WRITE;
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_packed_map_sg(mq, mqrq);
+
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_err_check;
+	mqrq->start = ktime_get();
+}
+
+static void mmc_blk_prep(struct mmc_queue_req *mqrq, struct mmc_card *card,
+			 int disable_multi, struct mmc_queue *mq)
+{
+	if (mqrq->packed_nr)
+		mmc_blk_packed_rq_prep(mqrq, card, mq);
+	else
+		mmc_blk_rw_rq_prep(mqrq, card, disable_multi, mq);
+}
+
+/* Complete every request of a packed write that went through. */
+static void mmc_blk_packed_end(struct mmc_blk_data *md,
+			       struct mmc_queue_req *mqrq)
+{
+	struct request *req, *tmp;
+
+	spin_lock_irq(&md->lock);
+	list_for_each_entry_safe(req, tmp, &mqrq->packed_list, queuelist) {
+		list_del_init(&req->queuelist);
+		__blk_end_request_all(req, 0);
+	}
+	spin_unlock_irq(&md->lock);
+
+	mqrq->packed_nr = 0;
+}
+
+/*
+ * A packed write failed: give all but the first request back to the
+ * block layer, in order, so that the first can be redone on its own.
+ * Rewriting blocks the card may already have programmed is harmless.
+ */
+static void mmc_blk_packed_requeue(struct mmc_blk_data *md,
+				   struct mmc_queue_req *mqrq)
+{
+	struct request *req, *tmp;
+
+	spin_lock_irq(&md->lock);
+	list_for_each_entry_safe_reverse(req, tmp, &mqrq->packed_list,
+					 queuelist) {
+		list_del_init(&req->queuelist);
+		if (req != mqrq->req)
+			blk_requeue_request(md->queue.queue, req);
+	}
+	spin_unlock_irq(&md->lock);
+
+	mqrq->packed_nr = 0;
+}
+
+static void mmc_blk_account(struct mmc_blk_data *md,
+			    struct mmc_queue_req *mqrq)
+{
+	struct mmc_blk_stats *st = &md->stats;
+	int dir = rq_data_dir(mqrq->req);
+	unsigned int nr = mqrq->packed_nr ? mqrq->packed_nr : 1;
+	unsigned int us;
+	int b;
+
+	us = ktime_to_us(ktime_sub(ktime_get(), mqrq->start));
+	b = us ? fls(us) - 1 : 0;
+
+	st->reqs[dir] += nr;
+	st->lat_us[dir] += (u64)us * nr;
+	st->lat_max_us[dir] = max(st->lat_max_us[dir], us);
+	st->lat_hist[dir][min(b, MMC_BLK_LAT_BUCKETS - 1)] += nr;
+
+	if (mqrq->packed_nr) {
+		st->packed_cmds++;
+		st->packed_reqs += nr;
+		st->packed_hist[fls(nr) - 1]++;
+	}
+}
+
+/*
+ * Issue @rqc and complete the request that was started before it, if any.
+ * The new request is started on the host before the previous one is
+ * handed back to the block layer, so the card stays busy while the CPU
+ * unmaps and completes. A NULL @rqc only completes the previous request.
+ */
+static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request *brq = &mq->mqrq_cur->brq;
+	int ret = 1, disable_multi = 0;
+	enum mmc_blk_status status;
+	struct mmc_queue_req *mq_rq;
+	struct request *req;
+	struct mmc_async_req *areq;
+
+	if (!rqc && !mq->mqrq_prev->req)
+		return 0;
+
+	if (rqc)
+		mmc_blk_packed_gather(mq, mq->mqrq_cur);
+
+	do {
+		if (rqc) {
+			mmc_blk_prep(mq->mqrq_cur, card, 0, mq);
+			areq = &mq->mqrq_cur->mmc_active;
+		} else
+			areq = NULL;
+		areq = mmc_start_req(card->host, areq, (int *) &status);
+		if (!areq)
+			return 0;
+
+		mq_rq = container_of(areq, struct mmc_queue_req, mmc_active);
+		brq = &mq_rq->brq;
+		req = mq_rq->req;
+		mmc_queue_bounce_post(mq_rq);
+
+		switch (status) {
+		case MMC_BLK_SUCCESS:
+		case MMC_BLK_PARTIAL:
+			mmc_blk_account(md, mq_rq);
+			if (mq_rq->packed_nr) {
+				mmc_blk_packed_end(md, mq_rq);
+				ret = 0;
+				break;
+			}
+			/*
+			 * A block was successfully transferred.
+			 */
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, 0,
+						brq->data.bytes_xfered);
+			spin_unlock_irq(&md->lock);
+			if (status == MMC_BLK_SUCCESS && ret) {
 				/*
-				 * After an error, we redo I/O one sector at a
-				 * time, so we only reach here after trying to
-				 * read a single sector.
+				 * The whole request was transferred without
+				 * error, yet the block layer wants more.
+				 * That is a bug; @rqc is already running so
+				 * leave it to be completed on the next call.
 				 */
-				spin_lock_irq(&md->lock);
-				ret = __blk_end_request(req, -EIO, brq.data.blksz);
-				spin_unlock_irq(&md->lock);
-				continue;
+				printk(KERN_ERR "%s BUG rq_tot %d d_xfer %d\n",
+				       __func__, blk_rq_bytes(req),
+				       brq->data.bytes_xfered);
+				rqc = NULL;
+				goto cmd_abort;
 			}
+			break;
+		case MMC_BLK_CMD_ERR:
 			goto cmd_err;
+		case MMC_BLK_RETRY_SINGLE:
+			disable_multi = 1;
+			break;
+		case MMC_BLK_DATA_ERR:
+			/*
+			 * After an error, we redo I/O one sector at a
+			 * time, so we only reach here after trying to
+			 * read a single sector.
+			 */
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, -EIO,
+						brq->data.blksz);
+			spin_unlock_irq(&md->lock);
+			if (!ret)
+				goto start_new_req;
+			break;
+		case MMC_BLK_PACKED_ERR:
+			md->stats.packed_fails++;
+			mmc_blk_packed_requeue(md, mq_rq);
+			ret = 1;
+			break;
 		}
 
-		/*
-		 * A block was successfully transferred.
-		 */
-		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
-		spin_unlock_irq(&md->lock);
+		if (ret) {
+			/*
+			 * In case of a none complete request
+			 * prepare it again and resend. Any failure
+			 * status left @rqc unstarted, so the host is
+			 * idle here.
+			 */
+			mmc_blk_rw_rq_prep(mq_rq, card, disable_multi, mq);
+			mmc_start_req(card->host, &mq_rq->mmc_active, NULL);
+		}
 	} while (ret);
 
-	mmc_release_host(card->host);
-
 	return 1;
 
  cmd_err:
@@ -575,17 +926,22 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *req)
 		}
 	} else {
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	}
 
-	mmc_release_host(card->host);
-
+ cmd_abort:
 	spin_lock_irq(&md->lock);
 	while (ret)
 		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
 	spin_unlock_irq(&md->lock);
 
+ start_new_req:
+	if (rqc) {
+		mmc_blk_prep(mq->mqrq_cur, card, 0, mq);
+		mmc_start_req(card->host, &mq->mqrq_cur->mmc_active, NULL);
+	}
+
 	return 0;
 }
 
@@ -594,24 +950,42 @@ mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card);
 
 static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 {
-#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+	int ret;
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
 
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
 	if (mmc_bus_needs_resume(card->host)) {
 		mmc_resume_bus(card->host);
 		mmc_blk_set_blksize(md, card);
 	}
 #endif
 
-	if (req->cmd_flags & REQ_DISCARD) {
+	if (req && !mq->mqrq_prev->req)
+		/* claim host only for the first request */
+		mmc_claim_host(card->host);
+
+	if (req && req->cmd_flags & REQ_DISCARD) {
+		/* complete ongoing async transfer before issuing discard */
+		if (card->host->areq)
+			mmc_blk_issue_rw_rq(mq, NULL);
 		if (req->cmd_flags & REQ_SECURE)
-			return mmc_blk_issue_secdiscard_rq(mq, req);
+			ret = mmc_blk_issue_secdiscard_rq(mq, req);
 		else
-			return mmc_blk_issue_discard_rq(mq, req);
+			ret = mmc_blk_issue_discard_rq(mq, req);
+	} else if (req && req->cmd_flags & REQ_FLUSH) {
+		/* the cache may only be flushed once earlier writes are in */
+		if (card->host->areq)
+			mmc_blk_issue_rw_rq(mq, NULL);
+		ret = mmc_blk_issue_flush(mq, req);
 	} else {
-		return mmc_blk_issue_rw_rq(mq, req);
+		ret = mmc_blk_issue_rw_rq(mq, req);
 	}
+
+	if (!req)
+		/* release host only when there are no more requests */
+		mmc_release_host(card->host);
+	return ret;
 }
 
 static inline int mmc_blk_readonly(struct mmc_card *card)
@@ -685,6 +1059,13 @@ static struct mmc_blk_data *mmc_blk_alloc(struct mmc_card *card)
 
 	blk_queue_logical_block_size(md->queue.queue, 512);
 
+	if (mmc_card_mmc(card) && card->ext_csd.cache_ctrl) {
+		if (mmc_blk_can_rel_wr(card))
+			blk_queue_flush(md->queue.queue, REQ_FLUSH | REQ_FUA);
+		else
+			blk_queue_flush(md->queue.queue, REQ_FLUSH);
+	}
+
 	if (!mmc_card_sd(card) && mmc_card_blockaddr(card)) {
 		/*
 		 * The EXT_CSD sector count is in number or 512 byte
@@ -727,6 +1108,68 @@ mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card)
 	return 0;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int mmc_blk_stats_show(struct seq_file *s, void *data)
+{
+	struct mmc_blk_data *md = s->private;
+	struct mmc_blk_stats *st = &md->stats;
+	static const char *dir_name[2] = { "read", "write" };
+	int dir, i;
+
+	for (dir = 0; dir < 2; dir++) {
+		seq_printf(s, "%s: %lu requests, avg %llu us, max %u us\n",
+			   dir_name[dir], st->reqs[dir],
+			   st->reqs[dir] ? div_u64(st->lat_us[dir],
+						   st->reqs[dir]) : 0,
+			   st->lat_max_us[dir]);
+	}
+
+	seq_printf(s, "latency (us)     read    write\n");
+	for (i = 0; i < MMC_BLK_LAT_BUCKETS; i++) {
+		if (!st->lat_hist[READ][i] && !st->lat_hist[WRITE][i])
+			continue;
+		seq_printf(s, "  %8u+ %8lu %8lu\n", 1 << i,
+			   st->lat_hist[READ][i], st->lat_hist[WRITE][i]);
+	}
+
+	seq_printf(s, "packed: %lu commands, %lu requests, %lu failed "
+		   "(max %u entries)\n", st->packed_cmds, st->packed_reqs,
+		   st->packed_fails, min(md->queue.max_packed, packed_writes));
+	for (i = 1; i < MMC_BLK_PACKED_BUCKETS; i++) {
+		if (!st->packed_hist[i])
+			continue;
+		seq_printf(s, "  %2u+ entries %8lu\n", 1 << i,
+			   st->packed_hist[i]);
+	}
+
+	return 0;
+}
+
+static int mmc_blk_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mmc_blk_stats_show, inode->i_private);
+}
+
+static const struct file_operations mmc_blk_stats_fops = {
+	.open		= mmc_blk_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void mmc_blk_add_debugfs(struct mmc_card *card, struct mmc_blk_data *md)
+{
+	if (card->debugfs_root)
+		md->stats_dentry = debugfs_create_file("block_stats", S_IRUSR,
+			card->debugfs_root, md, &mmc_blk_stats_fops);
+}
+#else
+static inline void mmc_blk_add_debugfs(struct mmc_card *card,
+				       struct mmc_blk_data *md)
+{
+}
+#endif
+
 static const struct mmc_fixup blk_fixups[] =
 {
 	MMC_FIXUP("SEM16G", 0x2, 0x100, add_quirk, MMC_QUIRK_INAND_CMD38),
@@ -762,6 +1205,7 @@ static int mmc_blk_probe(struct mmc_card *card)
 
 	mmc_set_drvdata(card, md);
 	mmc_fixup_device(card, blk_fixups);
+	mmc_blk_add_debugfs(card, md);
 
 #ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
 	mmc_set_bus_resume_policy(card->host, 1);
@@ -781,6 +1225,8 @@ static void mmc_blk_remove(struct mmc_card *card)
 	struct mmc_blk_data *md = mmc_get_drvdata(card);
 
 	if (md) {
+		debugfs_remove(md->stats_dentry);
+
 		/* Stop new requests from getting into the queue */
 		del_gendisk(md->disk);
 
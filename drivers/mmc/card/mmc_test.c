@@ -148,6 +148,16 @@ struct mmc_test_card {
 	struct mmc_test_general_result	*gr;
 };
 
+/**
+ * struct mmc_test_async_req - request for non-blocking transfers.
+ * @areq: request handed to mmc_start_req()
+ * @test: test the request belongs to
+ */
+struct mmc_test_async_req {
+	struct mmc_async_req areq;
+	struct mmc_test_card *test;
+};
+
 /*******************************************************************/
 /*  General helper functions                                       */
 /*******************************************************************/
@@ -755,6 +765,78 @@ static int mmc_test_simple_transfer(struct mmc_test_card *test,
 	return mmc_test_check_result(test, &mrq);
 }
 
+static void mmc_test_nonblock_reset(struct mmc_request *mrq,
+				    struct mmc_command *cmd,
+				    struct mmc_command *stop,
+				    struct mmc_data *data)
+{
+	memset(mrq, 0, sizeof(struct mmc_request));
+	memset(cmd, 0, sizeof(struct mmc_command));
+	memset(data, 0, sizeof(struct mmc_data));
+	memset(stop, 0, sizeof(struct mmc_command));
+
+	mrq->cmd = cmd;
+	mrq->data = data;
+	mrq->stop = stop;
+}
+
+static int mmc_test_check_result_async(struct mmc_card *card,
+				       struct mmc_async_req *areq)
+{
+	struct mmc_test_async_req *test_async =
+		container_of(areq, struct mmc_test_async_req, areq);
+
+	mmc_test_wait_busy(test_async->test);
+
+	return mmc_test_check_result(test_async->test, areq->mrq);
+}
+
+/*
+ * Transfer count consecutive requests, starting each one before the
+ * previous one has been completed, so that the host can prepare the next
+ * request while the card is busy with the current one.
+ */
+static int mmc_test_nonblock_transfer(struct mmc_test_card *test,
+	struct scatterlist *sg, unsigned sg_len, unsigned dev_addr,
+	unsigned blocks, unsigned blksz, int write, unsigned count)
+{
+	struct mmc_request mrq[2];
+	struct mmc_command cmd[2];
+	struct mmc_command stop[2];
+	struct mmc_data data[2];
+	struct mmc_test_async_req test_areq[2];
+	struct mmc_async_req *done_areq;
+	unsigned i, n;
+	int ret = 0;
+
+	for (i = 0; i < 2; i++) {
+		test_areq[i].test = test;
+		test_areq[i].areq.mrq = &mrq[i];
+		test_areq[i].areq.err_check = mmc_test_check_result_async;
+	}
+
+	for (i = 0; i < count; i++) {
+		/* this slot's previous request completed in the last round */
+		n = i & 1;
+		mmc_test_nonblock_reset(&mrq[n], &cmd[n], &stop[n], &data[n]);
+		mmc_test_prepare_mrq(test, &mrq[n], sg, sg_len, dev_addr,
+			blocks, blksz, write);
+
+		done_areq = mmc_start_req(test->card->host, &test_areq[n].areq,
+					  &ret);
+		if (ret)
+			return ret;
+		if (!done_areq && i > 0)
+			return RESULT_FAIL;
+
+		dev_addr += blocks;
+	}
+
+	mmc_start_req(test->card->host, NULL, &ret);
+
+	return ret;
+}
+
 /*
  * Tests a transfer where the card will fail completely or partly
  */
@@ -1736,6 +1818,80 @@ static int mmc_test_profile_seq_write_perf(struct mmc_test_card *test)
 	return mmc_test_seq_write_perf(test, sz);
 }
 
+/*
+ * Transfer the whole test area in maximum sized requests, either waiting
+ * for each request or keeping the next one prepared while one is active.
+ */
+static int mmc_test_seq_async_perf(struct mmc_test_card *test, int write,
+				   int nonblock)
+{
+	struct mmc_test_area *t = &test->area;
+	unsigned long sz = t->max_tfr;
+	unsigned int dev_addr, i, cnt;
+	struct timespec ts1, ts2;
+	int ret;
+
+	if (write) {
+		ret = mmc_test_area_erase(test);
+		if (ret)
+			return ret;
+	}
+
+	ret = mmc_test_area_map(test, sz, 0);
+	if (ret)
+		return ret;
+
+	cnt = t->max_sz / sz;
+	dev_addr = t->dev_addr;
+
+	getnstimeofday(&ts1);
+	if (nonblock) {
+		ret = mmc_test_nonblock_transfer(test, t->sg, t->sg_len,
+						 dev_addr, t->blocks, 512,
+						 write, cnt);
+	} else {
+		for (i = 0; i < cnt && !ret; i++) {
+			ret = mmc_test_area_transfer(test, dev_addr, write);
+			dev_addr += t->blocks;
+		}
+	}
+	if (ret)
+		return ret;
+	getnstimeofday(&ts2);
+
+	printk(KERN_INFO "%s: %s requests:\n", mmc_hostname(test->card->host),
+	       nonblock ? "Non-blocking" : "Blocking");
+	mmc_test_print_avg_rate(test, sz, cnt, &ts1, &ts2);
+
+	return 0;
+}
+
+/*
+ * Consecutive read performance, blocking vs non-blocking requests.
+ */
+static int mmc_test_profile_seq_read_nonblock_perf(struct mmc_test_card *test)
+{
+	int ret;
+
+	ret = mmc_test_seq_async_perf(test, 0, 0);
+	if (ret)
+		return ret;
+	return mmc_test_seq_async_perf(test, 0, 1);
+}
+
+/*
+ * Consecutive write performance, blocking vs non-blocking requests.
+ */
+static int mmc_test_profile_seq_write_nonblock_perf(struct mmc_test_card *test)
+{
+	int ret;
+
+	ret = mmc_test_seq_async_perf(test, 1, 0);
+	if (ret)
+		return ret;
+	return mmc_test_seq_async_perf(test, 1, 1);
+}
+
 /*
  * Consecutive trim performance by transfer size.
  */
@@ -2223,6 +2379,20 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.cleanup = mmc_test_area_cleanup,
 	},
 
+	{
+		.name = "Consecutive read performance, blocking vs non-blocking",
+		.prepare = mmc_test_area_prepare_fill,
+		.run = mmc_test_profile_seq_read_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
+	{
+		.name = "Consecutive write performance, blocking vs non-blocking",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_profile_seq_write_nonblock_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
@@ -4,19 +4,62 @@
 struct request;
 struct task_struct;
 
+struct mmc_blk_request {
+	struct mmc_request	mrq;
+	struct mmc_command	sbc;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+};
+
+/*
+ * One slot of the two deep request pipeline: while one slot is on the
+ * bus the other is being mapped, or completed back to the block layer.
+ */
+struct mmc_queue_req {
+	struct request		*req;
+	struct mmc_blk_request	brq;
+	struct scatterlist	*sg;
+	char			*bounce_buf;
+	struct scatterlist	*bounce_sg;
+	unsigned int		bounce_sg_len;	/* 0 when not bounced */
+	struct mmc_async_req	mmc_active;
+	ktime_t			start;		/* handed to the host */
+
+	/*
+	 * Packed write: the requests (req first) are linked through their
+	 * queuelist, packed_hdr is the header block sent ahead of the data.
+	 */
+	struct list_head	packed_list;
+	unsigned int		packed_nr;	/* 0 when not packed */
+	unsigned int		packed_blocks;	/* data blocks, no header */
+	__le32			*packed_hdr;
+};
+
+/* entries that fit in a 512 byte packed command header */
+#define MMC_PACKED_MAX		63
+#define MMC_PACKED_HDR_SIZE	512
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
 	struct semaphore	thread_sem;
 	unsigned int		flags;
-	struct request		*req;
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
 	void			*data;
 	struct request_queue	*queue;
-	struct scatterlist	*sg;
-	char			*bounce_buf;
-	struct scatterlist	*bounce_sg;
-	unsigned int		bounce_sg_len;
+	struct mmc_queue_req	mqrq[2];
+	struct mmc_queue_req	*mqrq_cur;
+	struct mmc_queue_req	*mqrq_prev;
+
+	/* bounce buffer use, only kept when bounce buffers are set up */
+	unsigned long		bounce_pfn;	/* highest pfn the host reaches */
+	u32			bounce_reqs;	/* requests copied */
+	u64			bounce_bytes;
+	u32			direct_reqs;	/* requests mapped in place */
+	struct dentry		*bounce_dentry;
+
+	unsigned int		max_packed;	/* 0: card can't pack writes */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *);
@@ -24,8 +67,11 @@ extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
 
-extern unsigned int mmc_queue_map_sg(struct mmc_queue *);
-extern void mmc_queue_bounce_pre(struct mmc_queue *);
-extern void mmc_queue_bounce_post(struct mmc_queue *);
+extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
+				     struct mmc_queue_req *);
+extern unsigned int mmc_queue_packed_map_sg(struct mmc_queue *,
+					    struct mmc_queue_req *);
+extern void mmc_queue_bounce_pre(struct mmc_queue_req *);
+extern void mmc_queue_bounce_post(struct mmc_queue_req *);
 
 #endif
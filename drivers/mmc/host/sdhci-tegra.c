@@ -19,6 +19,7 @@
 #include <linux/io.h>
 #include <linux/gpio.h>
 #include <linux/slab.h>
+#include <linux/dma-mapping.h>
 #include <linux/mmc/card.h>
 #include <linux/mmc/host.h>
 #include <linux/regulator/consumer.h>
@@ -47,6 +48,9 @@ static struct tegra_sdhci_hw_ops tegra_3x_sdhci_ops = {
 	.set_card_clock = tegra_3x_sdhci_set_card_clock,
 };
 
+/* the controllers reach all of DRAM */
+static u64 tegra_sdhci_dma_mask = DMA_BIT_MASK(32);
+
 struct tegra_sdhci_host {
 	bool	clk_enabled;
 	char	wp_gpio_name[32];
@@ -68,6 +72,17 @@ static u32 tegra_sdhci_readl(struct sdhci_host *host, int reg)
 		return val | SDHCI_WRITE_PROTECT;
 	}
 
+	if (unlikely(reg == SDHCI_CAPABILITIES)) {
+		/*
+		 * Every Tegra controller walks ADMA2 descriptor chains, but
+		 * the capability register does not reliably say so. Without
+		 * it sdhci drops to single segment SDMA and the block queue
+		 * bounces every request through a copy buffer.
+		 */
+		val = readl(host->ioaddr + reg);
+		return val | SDHCI_CAN_DO_ADMA2;
+	}
+
 	return readl(host->ioaddr + reg);
 }
 
@@ -420,6 +435,14 @@ static int tegra_sdhci_pltfm_init(struct sdhci_host *host,
 	pltfm_host->priv = tegra_host;
 	tegra_host->clk_enabled = true;
 
+	/*
+	 * Without a mask the block layer bounces highmem pages into
+	 * lowmem before every transfer.
+	 */
+	if (!pdev->dev.dma_mask)
+		pdev->dev.dma_mask = &tegra_sdhci_dma_mask;
+	pdev->dev.coherent_dma_mask = DMA_BIT_MASK(32);
+
 	host->mmc->caps |= MMC_CAP_ERASE;
 	if (plat->is_8bit)
 		host->mmc->caps |= MMC_CAP_8_BIT_DATA;
@@ -29,13 +29,30 @@
 #include <linux/types.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/scatterlist.h>
 
 #include <linux/usb/android_composite.h>
 
-#define BULK_BUFFER_SIZE           4096
+#define BULK_BUFFER_SIZE           16384
+#define BULK_BUFFER_SIZE_MAX       131072
 
 /* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+#define TX_REQ_MAX 8
+#define TX_REQ_LIMIT 32
+
+/* Size of each request's buffer, the most a read() may ask for and the
+ * most a write() queues per request, and the number of requests a write()
+ * keeps in flight.  Both are used when the function is bound.
+ */
+static unsigned int transfer_size = BULK_BUFFER_SIZE;
+module_param(transfer_size, uint, 0444);
+MODULE_PARM_DESC(transfer_size, "bytes per adb usb request");
+
+static unsigned int tx_reqs = TX_REQ_MAX;
+module_param(tx_reqs, uint, 0444);
+MODULE_PARM_DESC(tx_reqs, "adb usb write requests in flight");
 
 static const char shortname[] = "android_adb";
 
@@ -60,6 +77,29 @@ struct adb_dev {
 	wait_queue_head_t write_wq;
 	struct usb_request *rx_req;
 	int rx_done;
+
+	unsigned int xfer_size;
+	int tx_req_count;
+
+	/* statistics, under lock */
+	unsigned long long rx_bytes;
+	unsigned long long tx_bytes;
+	unsigned long rx_requests;
+	unsigned long tx_requests;
+	unsigned long sg_requests;
+	int tx_queued;
+	int tx_queued_max;
+};
+
+/* User pages a request is transferring, hung off req->context when the
+ * controller takes scatterlists; reads and writes of whole pages then go
+ * straight between the user buffer and the controller.
+ */
+struct adb_req_pages {
+	struct scatterlist *sg;
+	struct page **pages;
+	int count;
+	int dirty;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -128,7 +168,23 @@ static inline struct adb_dev *func_to_dev(struct usb_function *f)
 }
 
 
-static struct usb_request *adb_request_new(struct usb_ep *ep, int buffer_size)
+static struct adb_req_pages *adb_req_pages_new(int buffer_size)
+{
+	struct adb_req_pages *rp;
+	int nents = buffer_size / PAGE_SIZE + 1;
+
+	rp = kzalloc(sizeof(*rp) + nents * (sizeof(struct scatterlist) +
+			sizeof(struct page *)), GFP_KERNEL);
+	if (!rp)
+		return NULL;
+
+	rp->sg = (struct scatterlist *)(rp + 1);
+	rp->pages = (struct page **)(rp->sg + nents);
+	return rp;
+}
+
+static struct usb_request *adb_request_new(struct usb_ep *ep, int buffer_size,
+		int sg)
 {
 	struct usb_request *req = usb_ep_alloc_request(ep, GFP_KERNEL);
 	if (!req)
@@ -141,12 +197,79 @@ static struct usb_request *adb_request_new(struct usb_ep *ep, int buffer_size)
 		return NULL;
 	}
 
+	req->context = NULL;
+	if (sg) {
+		req->context = adb_req_pages_new(buffer_size);
+		if (!req->context) {
+			kfree(req->buf);
+			usb_ep_free_request(ep, req);
+			return NULL;
+		}
+	}
+
 	return req;
 }
 
+/* Pin the user pages holding len bytes at ubuf and point req at them.
+ * Returns 0, or an error if the buffer cannot be used.
+ */
+static int adb_req_pin(struct usb_request *req, const char __user *ubuf,
+		int len, int write)
+{
+	struct adb_req_pages *rp = req->context;
+	unsigned long start = (unsigned long)ubuf;
+	unsigned int off = start & ~PAGE_MASK;
+	unsigned int chunk;
+	int n, i;
+
+	n = (off + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	rp->count = get_user_pages_fast(start & PAGE_MASK, n, write,
+			rp->pages);
+	if (rp->count < n) {
+		while (rp->count > 0)
+			put_page(rp->pages[--rp->count]);
+		rp->count = 0;
+		return -EFAULT;
+	}
+
+	sg_init_table(rp->sg, n);
+	for (i = 0; i < n; i++) {
+		chunk = min_t(unsigned int, len, PAGE_SIZE - off);
+		sg_set_page(&rp->sg[i], rp->pages[i], chunk, off);
+		len -= chunk;
+		off = 0;
+	}
+	rp->dirty = write;
+
+	req->sg = rp->sg;
+	req->num_sgs = n;
+	return 0;
+}
+
+/* release the user pages of a request, once the controller is done;
+ * pages read into have to be dirtied, which may sleep
+ */
+static void adb_req_unpin(struct usb_request *req)
+{
+	struct adb_req_pages *rp = req->context;
+
+	if (rp) {
+		while (rp->count > 0) {
+			rp->count--;
+			if (rp->dirty)
+				set_page_dirty_lock(rp->pages[rp->count]);
+			put_page(rp->pages[rp->count]);
+		}
+	}
+	req->sg = NULL;
+	req->num_sgs = 0;
+}
+
 static void adb_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
+		adb_req_unpin(req);
+		kfree(req->context);
 		kfree(req->buf);
 		usb_ep_free_request(ep, req);
 	}
@@ -202,11 +325,22 @@ struct usb_request *req_get(struct adb_dev *dev, struct list_head *head)
 static void adb_complete_in(struct usb_ep *ep, struct usb_request *req)
 {
 	struct adb_dev *dev = _adb_dev;
+	unsigned long flags;
 
 	if (req->status != 0)
 		dev->error = 1;
 
-	req_put(dev, &dev->tx_idle, req);
+	/* the pages were only read from, dropping them is fine here */
+	adb_req_unpin(req);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->tx_queued--;
+	if (req->status == 0) {
+		dev->tx_bytes += req->actual;
+		dev->tx_requests++;
+	}
+	list_add_tail(&req->list, &dev->tx_idle);
+	spin_unlock_irqrestore(&dev->lock, flags);
 
 	wake_up(&dev->write_wq);
 }
@@ -214,14 +348,44 @@ static void adb_complete_in(struct usb_ep *ep, struct usb_request *req)
 static void adb_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct adb_dev *dev = _adb_dev;
+	unsigned long flags;
 
 	dev->rx_done = 1;
 	if (req->status != 0)
 		dev->error = 1;
 
+	spin_lock_irqsave(&dev->lock, flags);
+	if (req->status == 0) {
+		dev->rx_bytes += req->actual;
+		dev->rx_requests++;
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+
 	wake_up(&dev->read_wq);
 }
 
+/* queue a write request, keeping count of the requests in flight */
+static int adb_queue_tx(struct adb_dev *dev, struct usb_request *req)
+{
+	int ret;
+
+	spin_lock_irq(&dev->lock);
+	dev->tx_queued++;
+	if (dev->tx_queued > dev->tx_queued_max)
+		dev->tx_queued_max = dev->tx_queued;
+	if (req->num_sgs)
+		dev->sg_requests++;
+	spin_unlock_irq(&dev->lock);
+
+	ret = usb_ep_queue(dev->ep_in, req, GFP_ATOMIC);
+	if (ret < 0) {
+		spin_lock_irq(&dev->lock);
+		dev->tx_queued--;
+		spin_unlock_irq(&dev->lock);
+	}
+	return ret;
+}
+
 static int __init create_bulk_endpoints(struct adb_dev *dev,
 				struct usb_endpoint_descriptor *in_desc,
 				struct usb_endpoint_descriptor *out_desc)
@@ -251,15 +415,24 @@ static int __init create_bulk_endpoints(struct adb_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_out = ep;
 
+	/* requests end on a packet boundary, so that only the last request
+	 * of a write can be short and end the transfer early
+	 */
+	dev->xfer_size = clamp_t(unsigned int, PAGE_ALIGN(transfer_size),
+			PAGE_SIZE, BULK_BUFFER_SIZE_MAX);
+	dev->tx_req_count = clamp_t(unsigned int, tx_reqs, 1, TX_REQ_LIMIT);
+
 	/* now allocate requests for our endpoints */
-	req = adb_request_new(dev->ep_out, BULK_BUFFER_SIZE);
+	req = adb_request_new(dev->ep_out, dev->xfer_size,
+			cdev->gadget->sg_supported);
 	if (!req)
 		goto fail;
 	req->complete = adb_complete_out;
 	dev->rx_req = req;
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_in, BULK_BUFFER_SIZE);
+	for (i = 0; i < dev->tx_req_count; i++) {
+		req = adb_request_new(dev->ep_in, dev->xfer_size,
+				cdev->gadget->sg_supported);
 		if (!req)
 			goto fail;
 		req->complete = adb_complete_in;
@@ -281,10 +454,11 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 	struct usb_request *req;
 	int r = count, xfer;
 	int ret;
+	int use_sg = 0;
 
 	DBG(cdev, "adb_read(%d)\n", count);
 
-	if (count > BULK_BUFFER_SIZE)
+	if (count > dev->xfer_size)
 		return -EINVAL;
 
 	if (_lock(&dev->read_excl))
@@ -305,9 +479,15 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 		goto done;
 	}
 
+	/* read whole pages straight into the user buffer */
+	req = dev->rx_req;
+	if (req->context && count >= PAGE_SIZE) {
+		if (adb_req_pin(req, buf, count, 1) == 0)
+			use_sg = 1;
+	}
+
 requeue_req:
 	/* queue a request */
-	req = dev->rx_req;
 	req->length = count;
 	dev->rx_done = 0;
 	ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
@@ -335,12 +515,15 @@ requeue_req:
 
 		DBG(cdev, "rx %p %d\n", req, req->actual);
 		xfer = (req->actual < count) ? req->actual : count;
-		if (copy_to_user(buf, req->buf, xfer))
+		r = xfer;
+		if (!use_sg && copy_to_user(buf, req->buf, xfer))
 			r = -EFAULT;
 	} else
 		r = -EIO;
 
 done:
+	if (use_sg)
+		adb_req_unpin(req);
 	_unlock(&dev->read_excl);
 	DBG(cdev, "adb_read returning %d\n", r);
 	return r;
@@ -354,12 +537,16 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 	struct usb_request *req = 0;
 	int r = count, xfer;
 	int ret;
+	int use_sg;
 
 	DBG(cdev, "adb_write(%d)\n", count);
 
 	if (_lock(&dev->write_excl))
 		return -EBUSY;
 
+	/* send whole pages straight from the user buffer */
+	use_sg = dev->cdev->gadget->sg_supported && count >= PAGE_SIZE;
+
 	while (count > 0) {
 		if (dev->error) {
 			DBG(cdev, "adb_write dev->error\n");
@@ -378,17 +565,22 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		if (req != 0) {
-			if (count > BULK_BUFFER_SIZE)
-				xfer = BULK_BUFFER_SIZE;
+			if (count > dev->xfer_size)
+				xfer = dev->xfer_size;
 			else
 				xfer = count;
-			if (copy_from_user(req->buf, buf, xfer)) {
-				r = -EFAULT;
+			if (use_sg)
+				ret = adb_req_pin(req, buf, xfer, 0);
+			else
+				ret = copy_from_user(req->buf, buf, xfer) ?
+					-EFAULT : 0;
+			if (ret < 0) {
+				r = ret;
 				break;
 			}
 
 			req->length = xfer;
-			ret = usb_ep_queue(dev->ep_in, req, GFP_ATOMIC);
+			ret = adb_queue_tx(dev, req);
 			if (ret < 0) {
 				DBG(cdev, "adb_write: xfer error %d\n", ret);
 				dev->error = 1;
@@ -404,8 +596,20 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 	}
 
-	if (req)
+	if (req) {
+		adb_req_unpin(req);
 		req_put(dev, &dev->tx_idle, req);
+	}
+
+	/* the caller may reuse its buffer once we return, and the requests
+	 * coming back drop their pages as they complete
+	 */
+	if (use_sg) {
+		ret = wait_event_interruptible(dev->write_wq,
+				dev->tx_queued == 0 || dev->error);
+		if (ret < 0 && r >= 0)
+			r = ret;
+	}
 
 	_unlock(&dev->write_excl);
 	DBG(cdev, "adb_write returning %d\n", r);
@@ -509,6 +713,50 @@ static struct miscdevice adb_enable_device = {
 	.fops = &adb_enable_fops,
 };
 
+/* transfer statistics, in the function's usb_composite class device */
+#define ADB_STAT_ATTR(field, format)					\
+static ssize_t adb_show_##field(struct device *d,			\
+		struct device_attribute *attr, char *buf)		\
+{									\
+	struct adb_dev *dev = func_to_dev(dev_get_drvdata(d));		\
+	unsigned long flags;						\
+	ssize_t n;							\
+									\
+	spin_lock_irqsave(&dev->lock, flags);				\
+	n = sprintf(buf, format "\n", dev->field);			\
+	spin_unlock_irqrestore(&dev->lock, flags);			\
+	return n;							\
+}									\
+static DEVICE_ATTR(field, S_IRUGO, adb_show_##field, NULL)
+
+ADB_STAT_ATTR(xfer_size, "%u");
+ADB_STAT_ATTR(tx_req_count, "%d");
+ADB_STAT_ATTR(rx_bytes, "%llu");
+ADB_STAT_ATTR(tx_bytes, "%llu");
+ADB_STAT_ATTR(rx_requests, "%lu");
+ADB_STAT_ATTR(tx_requests, "%lu");
+ADB_STAT_ATTR(sg_requests, "%lu");
+ADB_STAT_ATTR(tx_queued, "%d");
+ADB_STAT_ATTR(tx_queued_max, "%d");
+
+static struct attribute *adb_attrs[] = {
+	&dev_attr_xfer_size.attr,
+	&dev_attr_tx_req_count.attr,
+	&dev_attr_rx_bytes.attr,
+	&dev_attr_tx_bytes.attr,
+	&dev_attr_rx_requests.attr,
+	&dev_attr_tx_requests.attr,
+	&dev_attr_sg_requests.attr,
+	&dev_attr_tx_queued.attr,
+	&dev_attr_tx_queued_max.attr,
+	NULL,
+};
+
+static struct attribute_group adb_attr_group = {
+	.name = "statistics",
+	.attrs = adb_attrs,
+};
+
 static int
 adb_function_bind(struct usb_configuration *c, struct usb_function *f)
 {
@@ -552,16 +800,18 @@ adb_function_unbind(struct usb_configuration *c, struct usb_function *f)
 	struct adb_dev	*dev = func_to_dev(f);
 	struct usb_request *req;
 
+	sysfs_remove_group(&f->dev->kobj, &adb_attr_group);
+
 	spin_lock_irq(&dev->lock);
+	dev->online = 0;
+	dev->error = 1;
+	spin_unlock_irq(&dev->lock);
 
+	/* unpinning may sleep, free the requests without the lock held */
 	adb_request_free(dev->rx_req, dev->ep_out);
 	while ((req = req_get(dev, &dev->tx_idle)))
 		adb_request_free(req, dev->ep_in);
 
-	dev->online = 0;
-	dev->error = 1;
-	spin_unlock_irq(&dev->lock);
-
 	misc_deregister(&adb_device);
 	misc_deregister(&adb_enable_device);
 	kfree(_adb_dev);
@@ -662,6 +912,9 @@ static int adb_bind_config(struct usb_configuration *c)
 	if (ret)
 		goto err3;
 
+	if (sysfs_create_group(&dev->function.dev->kobj, &adb_attr_group))
+		printk(KERN_ERR "adb: could not create statistics in sysfs\n");
+
 	return 0;
 
 err3:
@@ -30,6 +30,8 @@
 #include <linux/file.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/pagemap.h>
+#include <linux/scatterlist.h>
 
 #include <linux/usb.h>
 #include <linux/usb_usual.h>
@@ -38,8 +40,13 @@
 #include <linux/usb/f_mtp.h>
 
 #define BULK_BUFFER_SIZE           16384
+#define RX_BUFFER_SIZE             65536
 #define INTR_BUFFER_SIZE           28
 
+/* page cache pages sent by one tx request in send_file_work() */
+#define TX_PAGES_MAX               16
+#define TX_PAGES_SIZE              (TX_PAGES_MAX * PAGE_SIZE)
+
 /* String IDs */
 #define INTERFACE_STRING_INDEX	0
 
@@ -51,7 +58,7 @@
 #define STATE_ERROR                 4   /* error from completion routine */
 
 /* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
+#define TX_REQ_MAX 8
 #define RX_REQ_MAX 2
 
 /* ID for Microsoft MTP OS String */
@@ -270,6 +277,15 @@ struct mtp_device_status {
 	__le16	wCode;
 };
 
+/* Pages a tx request is sending, hung off req->context.  One more entry
+ * than TX_PAGES_MAX as a transfer need not start on a page boundary.
+ */
+struct mtp_tx_pages {
+	struct scatterlist sg[TX_PAGES_MAX + 1];
+	struct page *pages[TX_PAGES_MAX + 1];
+	int count;
+};
+
 /* temporary variable used between mtp_open() and mtp_gadget_bind() */
 static struct mtp_dev *_mtp_dev;
 
@@ -290,13 +306,47 @@ static struct usb_request *mtp_request_new(struct usb_ep *ep, int buffer_size)
 		usb_ep_free_request(ep, req);
 		return NULL;
 	}
+	req->context = NULL;
+
+	return req;
+}
+
+/* tx requests can also send page cache pages */
+static struct usb_request *mtp_tx_request_new(struct usb_ep *ep,
+		int buffer_size)
+{
+	struct usb_request *req = mtp_request_new(ep, buffer_size);
+	if (!req)
+		return NULL;
+
+	req->context = kzalloc(sizeof(struct mtp_tx_pages), GFP_KERNEL);
+	if (!req->context) {
+		kfree(req->buf);
+		usb_ep_free_request(ep, req);
+		return NULL;
+	}
 
 	return req;
 }
 
+/* drop the pages a tx request sent, once the controller is done with them */
+static void mtp_tx_release_pages(struct usb_request *req)
+{
+	struct mtp_tx_pages *tx = req->context;
+
+	if (tx) {
+		while (tx->count > 0)
+			page_cache_release(tx->pages[--tx->count]);
+	}
+	req->sg = NULL;
+	req->num_sgs = 0;
+}
+
 static void mtp_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
+		mtp_tx_release_pages(req);
+		kfree(req->context);
 		kfree(req->buf);
 		usb_ep_free_request(ep, req);
 	}
@@ -352,6 +402,8 @@ static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
+	/* don't keep the file's pages around in an idle request */
+	mtp_tx_release_pages(req);
 	req_put(dev, &dev->tx_idle, req);
 
 	wake_up(&dev->write_wq);
@@ -429,14 +481,14 @@ static int __init create_bulk_endpoints(struct mtp_dev *dev,
 
 	/* now allocate requests for our endpoints */
 	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, BULK_BUFFER_SIZE);
+		req = mtp_tx_request_new(dev->ep_in, BULK_BUFFER_SIZE);
 		if (!req)
 			goto fail;
 		req->complete = mtp_complete_in;
 		req_put(dev, &dev->tx_idle, req);
 	}
 	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, BULK_BUFFER_SIZE);
+		req = mtp_request_new(dev->ep_out, RX_BUFFER_SIZE);
 		if (!req)
 			goto fail;
 		req->complete = mtp_complete_out;
@@ -624,6 +676,89 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/* Can send_file_work() hand the page cache pages of this file to the
+ * controller?  Only when reading it through the page cache is all its
+ * read method would have done.
+ */
+static int mtp_can_send_pages(struct mtp_dev *dev, struct file *filp)
+{
+	struct address_space *mapping = filp->f_mapping;
+
+	return dev->cdev->gadget->sg_supported &&
+		filp->f_op->aio_read == generic_file_aio_read &&
+		!(filp->f_flags & O_DIRECT) &&
+		mapping->a_ops->readpage;
+}
+
+/* Get the page cache page at index, reading it in if needed, with
+ * readahead sized for the rest of the transfer as in a normal read.
+ */
+static struct page *mtp_get_page(struct file *filp, pgoff_t index,
+		unsigned long remaining)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct page *page;
+
+	page = find_get_page(mapping, index);
+	if (!page) {
+		page_cache_sync_readahead(mapping, &filp->f_ra, filp,
+				index, remaining);
+		page = find_get_page(mapping, index);
+	}
+	if (page && PageReadahead(page))
+		page_cache_async_readahead(mapping, &filp->f_ra, filp,
+				page, index, remaining);
+	if (page && PageUptodate(page))
+		return page;
+	if (page)
+		page_cache_release(page);
+
+	return read_mapping_page(mapping, index, filp);
+}
+
+/* Point req at the page cache pages holding xfer bytes of the file at
+ * offset.  Returns xfer, 0 if the range is not all inside the file so
+ * that the caller copies it instead, or an error.
+ */
+static int mtp_fill_tx_pages(struct usb_request *req, struct file *filp,
+		loff_t offset, int xfer, int64_t count)
+{
+	struct mtp_tx_pages *tx = req->context;
+	struct page *page;
+	pgoff_t index = offset >> PAGE_CACHE_SHIFT;
+	unsigned long remaining;
+	unsigned int off = offset & ~PAGE_CACHE_MASK;
+	unsigned int len;
+	int left = xfer;
+
+	if (offset + xfer > i_size_read(filp->f_mapping->host))
+		return 0;
+
+	remaining = (count + off + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	sg_init_table(tx->sg, TX_PAGES_MAX + 1);
+	while (left > 0) {
+		page = mtp_get_page(filp, index, remaining);
+		if (IS_ERR(page)) {
+			mtp_tx_release_pages(req);
+			return PTR_ERR(page);
+		}
+
+		len = min_t(unsigned int, left, PAGE_CACHE_SIZE - off);
+		sg_set_page(&tx->sg[tx->count], page, len, off);
+		tx->pages[tx->count++] = page;
+
+		left -= len;
+		off = 0;
+		index++;
+		remaining--;
+	}
+	sg_mark_end(&tx->sg[tx->count - 1]);
+
+	req->sg = tx->sg;
+	req->num_sgs = tx->count;
+	return xfer;
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data) {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, send_file_work);
@@ -635,6 +770,7 @@ static void send_file_work(struct work_struct *data) {
 	int xfer, ret;
 	int r = 0;
 	int sendZLP = 0;
+	int send_pages;
 
 	/* read our parameters */
 	smp_rmb();
@@ -642,7 +778,13 @@ static void send_file_work(struct work_struct *data) {
 	offset = dev->xfer_file_offset;
 	count = dev->xfer_file_length;
 
-	DBG(cdev, "send_file_work(%lld %lld)\n", offset, count);
+	/* Send straight from the page cache where we can, in requests of
+	 * TX_PAGES_SIZE so that only the last one may end in a short packet.
+	 */
+	send_pages = mtp_can_send_pages(dev, filp);
+
+	DBG(cdev, "send_file_work(%lld %lld)%s\n", offset, count,
+		send_pages ? " from page cache" : "");
 
 	/* we need to send a zero length packet to signal the end of transfer
 	 * if the transfer size is aligned to a packet boundary.
@@ -670,14 +812,29 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > BULK_BUFFER_SIZE)
-			xfer = BULK_BUFFER_SIZE;
-		else
-			xfer = count;
-		ret = vfs_read(filp, req->buf, xfer, &offset);
-		if (ret < 0) {
-			r = ret;
-			break;
+		ret = 0;
+		if (send_pages && count > 0) {
+			xfer = (count > TX_PAGES_SIZE) ? TX_PAGES_SIZE : count;
+			ret = mtp_fill_tx_pages(req, filp, offset, xfer, count);
+			if (ret < 0) {
+				r = ret;
+				break;
+			}
+			/* copy from here on if the file is shorter */
+			if (ret == 0)
+				send_pages = 0;
+			offset += ret;
+		}
+		if (ret == 0) {
+			if (count > BULK_BUFFER_SIZE)
+				xfer = BULK_BUFFER_SIZE;
+			else
+				xfer = count;
+			ret = vfs_read(filp, req->buf, xfer, &offset);
+			if (ret < 0) {
+				r = ret;
+				break;
+			}
 		}
 		xfer = ret;
 
@@ -696,8 +853,12 @@ static void send_file_work(struct work_struct *data) {
 		req = 0;
 	}
 
-	if (req)
+	if (req) {
+		mtp_tx_release_pages(req);
 		req_put(dev, &dev->tx_idle, req);
+	}
+	if (send_pages)
+		file_accessed(filp);
 
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
@@ -731,8 +892,8 @@ static void receive_file_work(struct work_struct *data)
 			read_req = dev->rx_req[cur_buf];
 			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
 
-			read_req->length = (count > BULK_BUFFER_SIZE
-					? BULK_BUFFER_SIZE : count);
+			read_req->length = (count > RX_BUFFER_SIZE
+					? RX_BUFFER_SIZE : count);
 			dev->rx_done = 0;
 			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
 			if (ret < 0) {
@@ -173,7 +173,14 @@ static void done(struct fsl_ep *ep, struct fsl_req *req, int status)
 		dma_pool_free(udc->td_pool, curr_td, curr_td->td_dma);
 	}
 
-	if (req->mapped) {
+	if (req->req.num_sgs) {
+		dma_unmap_sg(ep->udc->gadget.dev.parent,
+			req->req.sg, req->req.num_sgs,
+			ep_is_in(ep)
+				? DMA_TO_DEVICE
+				: DMA_FROM_DEVICE);
+		req->mapped = 0;
+	} else if (req->mapped) {
 		dma_unmap_single(ep->udc->gadget.dev.parent,
 			req->req.dma, req->req.length,
 			ep_is_in(ep)
@@ -792,6 +799,49 @@ out:
 	return;
 }
 
+/* Point the five buffer pointers of a dTD at the data of a scatterlist
+ * request, starting at req.actual.  Only the first pointer may have an
+ * offset, the controller moves on to the next one at each 4K boundary;
+ * struct usb_request requires the entries to be made of whole pages but
+ * for the first and last, so every boundary starts a new pointer. */
+static void fsl_fill_dtd_sg(struct fsl_req *req, struct ep_td_struct *dtd,
+		unsigned length)
+{
+	struct scatterlist *sg = req->sg_cur;
+	unsigned off = req->sg_off;
+	u32 ptr[5] = { 0 };
+	u32 addr;
+	unsigned chunk;
+	int i;
+
+	for (i = 0; i < 5 && sg; i++) {
+		addr = sg_dma_address(sg) + off;
+		ptr[i] = addr;
+		off += 0x1000 - (addr & 0xfff);
+		if (off >= sg_dma_len(sg)) {
+			sg = sg_next(sg);
+			off = 0;
+		}
+	}
+
+	dtd->buff_ptr0 = cpu_to_le32(ptr[0]);
+	dtd->buff_ptr1 = cpu_to_le32(ptr[1]);
+	dtd->buff_ptr2 = cpu_to_le32(ptr[2]);
+	dtd->buff_ptr3 = cpu_to_le32(ptr[3]);
+	dtd->buff_ptr4 = cpu_to_le32(ptr[4]);
+
+	/* advance the cursor past this dTD */
+	while (length && req->sg_cur) {
+		chunk = min(length, sg_dma_len(req->sg_cur) - req->sg_off);
+		req->sg_off += chunk;
+		length -= chunk;
+		if (req->sg_off == sg_dma_len(req->sg_cur)) {
+			req->sg_cur = sg_next(req->sg_cur);
+			req->sg_off = 0;
+		}
+	}
+}
+
 /* Fill in the dTD structure
  * @req: request that the transfer belongs to
  * @length: return actually data length of the dTD
@@ -819,12 +869,16 @@ static struct ep_td_struct *fsl_build_dtd(struct fsl_req *req, unsigned *length,
 	dtd->size_ioc_sts = cpu_to_le32(swap_temp);
 
 	/* Init all of buffer page pointers */
-	swap_temp = (u32) (req->req.dma + req->req.actual);
-	dtd->buff_ptr0 = cpu_to_le32(swap_temp);
-	dtd->buff_ptr1 = cpu_to_le32(swap_temp + 0x1000);
-	dtd->buff_ptr2 = cpu_to_le32(swap_temp + 0x2000);
-	dtd->buff_ptr3 = cpu_to_le32(swap_temp + 0x3000);
-	dtd->buff_ptr4 = cpu_to_le32(swap_temp + 0x4000);
+	if (req->req.num_sgs) {
+		fsl_fill_dtd_sg(req, dtd, *length);
+	} else {
+		swap_temp = (u32) (req->req.dma + req->req.actual);
+		dtd->buff_ptr0 = cpu_to_le32(swap_temp);
+		dtd->buff_ptr1 = cpu_to_le32(swap_temp + 0x1000);
+		dtd->buff_ptr2 = cpu_to_le32(swap_temp + 0x2000);
+		dtd->buff_ptr3 = cpu_to_le32(swap_temp + 0x3000);
+		dtd->buff_ptr4 = cpu_to_le32(swap_temp + 0x4000);
+	}
 
 	req->req.actual += *length;
 
@@ -902,7 +956,8 @@ fsl_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	int status;
 
 	/* catch various bogus parameters */
-	if (!_req || !req->req.complete || !req->req.buf
+	if (!_req || !req->req.complete
+			|| (!req->req.buf && !req->req.num_sgs)
 			|| !list_empty(&req->queue)) {
 		VDBG("%s, bad params", __func__);
 		return -EINVAL;
@@ -933,7 +988,14 @@ fsl_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	req->ep = ep;
 
 	/* map virtual address to hardware */
-	if (req->req.dma == DMA_ADDR_INVALID) {
+	if (req->req.num_sgs) {
+		if (!dma_map_sg(udc->gadget.dev.parent, req->req.sg,
+				req->req.num_sgs, dir))
+			return -ENOMEM;
+		req->sg_cur = req->req.sg;
+		req->sg_off = 0;
+		req->mapped = 1;
+	} else if (req->req.dma == DMA_ADDR_INVALID) {
 		req->req.dma = dma_map_single(udc->gadget.dev.parent,
 					req->req.buf, req->req.length, dir);
 		req->mapped = 1;
@@ -976,7 +1038,11 @@ fsl_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	return 0;
 
 err_unmap:
-	if (req->mapped) {
+	if (req->req.num_sgs) {
+		dma_unmap_sg(udc->gadget.dev.parent, req->req.sg,
+			req->req.num_sgs, dir);
+		req->mapped = 0;
+	} else if (req->mapped) {
 		dma_unmap_single(udc->gadget.dev.parent,
 			req->req.dma, req->req.length, dir);
 		req->req.dma = DMA_ADDR_INVALID;
@@ -2827,6 +2893,7 @@ static int __init fsl_udc_probe(struct platform_device *pdev)
 	/* Setup gadget structure */
 	udc_controller->gadget.ops = &fsl_gadget_ops;
 	udc_controller->gadget.is_dualspeed = 1;
+	udc_controller->gadget.sg_supported = 1;
 	udc_controller->gadget.ep0 = &udc_controller->eps[0].ep;
 	INIT_LIST_HEAD(&udc_controller->gadget.ep_list);
 	udc_controller->gadget.speed = USB_SPEED_UNKNOWN;
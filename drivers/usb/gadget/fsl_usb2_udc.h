@@ -582,6 +582,10 @@ struct fsl_req {
 	struct ep_td_struct *head, *tail;	/* For dTD List
 						   cpu endian Virtual addr */
 	unsigned int dtd_count;
+
+	/* position of req.actual in req.sg while building dTDs */
+	struct scatterlist *sg_cur;
+	unsigned int sg_off;
 };
 
 #define REQ_UNCOMPLETE			1
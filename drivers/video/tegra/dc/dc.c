@@ -46,6 +46,7 @@
 #include <mach/mc.h>
 #include <linux/nvhost.h>
 #include <mach/latency_allowance.h>
+#include <mach/emc_qos.h>
 
 #include "dc_reg.h"
 #include "dc_priv.h"
@@ -424,11 +425,15 @@ static int dbg_dc_stats_show(struct seq_file *s, void *unused)
 		"underflows: %llu\n"
 		"underflows_a: %llu\n"
 		"underflows_b: %llu\n"
-		"underflows_c: %llu\n",
+		"underflows_c: %llu\n"
+		"flips: %llu\n"
+		"flips_fence_wait: %llu\n",
 		dc->stats.underflows,
 		dc->stats.underflows_a,
 		dc->stats.underflows_b,
-		dc->stats.underflows_c);
+		dc->stats.underflows_c,
+		dc->stats.flips,
+		dc->stats.flips_fence_wait);
 	mutex_unlock(&dc->lock);
 
 	return 0;
@@ -757,22 +762,23 @@ static void tegra_dc_set_scaling_filter(struct tegra_dc *dc)
 	}
 }
 
+/* windows A, B, C for first and second display */
+static const enum tegra_la_id la_id_tab[2][3] = {
+	/* first display */
+	{ TEGRA_LA_DISPLAY_0A, TEGRA_LA_DISPLAY_0B,
+		TEGRA_LA_DISPLAY_0C },
+	/* second display */
+	{ TEGRA_LA_DISPLAY_0AB, TEGRA_LA_DISPLAY_0BB,
+		TEGRA_LA_DISPLAY_0CB },
+};
+/* window B V-filter tap for first and second display. */
+static const enum tegra_la_id vfilter_tab[2] = {
+	TEGRA_LA_DISPLAY_1B, TEGRA_LA_DISPLAY_1BB,
+};
+
 static void tegra_dc_set_latency_allowance(struct tegra_dc *dc,
 	struct tegra_dc_win *w)
 {
-	/* windows A, B, C for first and second display */
-	static const enum tegra_la_id la_id_tab[2][3] = {
-		/* first display */
-		{ TEGRA_LA_DISPLAY_0A, TEGRA_LA_DISPLAY_0B,
-			TEGRA_LA_DISPLAY_0C },
-		/* second display */
-		{ TEGRA_LA_DISPLAY_0AB, TEGRA_LA_DISPLAY_0BB,
-			TEGRA_LA_DISPLAY_0CB },
-	};
-	/* window B V-filter tap for first and second display. */
-	static const enum tegra_la_id vfilter_tab[2] = {
-		TEGRA_LA_DISPLAY_1B, TEGRA_LA_DISPLAY_1BB,
-	};
 	unsigned long bw;
 
 	BUG_ON(dc->ndev->id >= ARRAY_SIZE(la_id_tab));
@@ -940,6 +946,14 @@ static void tegra_dc_program_bandwidth(struct tegra_dc *dc)
 {
 	unsigned i;
 
+	/* raise the QoS request before dropping our own emc floor */
+	if (dc->emc_bw != dc->new_emc_bw) {
+		dc->emc_bw = dc->new_emc_bw;
+		tegra_emc_qos_request(dc->emc_qos,
+			(dc->emc_bw == ULONG_MAX) ? TEGRA_EMC_QOS_BW_MAX :
+			dc->emc_bw / 1000, 0);
+	}
+
 	if (dc->emc_clk_rate != dc->new_emc_clk_rate) {
 		dc->emc_clk_rate = dc->new_emc_clk_rate;
 		clk_set_rate(dc->emc_clk, dc->emc_clk_rate);
@@ -955,6 +969,7 @@ static void tegra_dc_program_bandwidth(struct tegra_dc *dc)
 static int tegra_dc_set_dynamic_emc(struct tegra_dc_win *windows[], int n)
 {
 	unsigned long new_rate;
+	unsigned long new_bw;
 	struct tegra_dc *dc;
 
 	if (!use_dynamic_emc)
@@ -963,11 +978,19 @@ static int tegra_dc_set_dynamic_emc(struct tegra_dc_win *windows[], int n)
 	dc = windows[0]->dc;
 
 	/* calculate the new rate based on this POST */
-	new_rate = tegra_dc_get_bandwidth(windows, n);
-	new_rate = EMC_BW_TO_FREQ(new_rate);
+	new_bw = tegra_dc_get_bandwidth(windows, n);
+	new_rate = EMC_BW_TO_FREQ(new_bw);
 
-	if (tegra_dc_has_multiple_dc())
+	if (tegra_dc_has_multiple_dc()) {
 		new_rate = ULONG_MAX;
+		new_bw = ULONG_MAX;
+	}
+
+	/* the bandwidth goes to the QoS governor, which picks the rate */
+	if (dc->emc_qos) {
+		dc->new_emc_bw = new_bw;
+		new_rate = 0;
+	}
 
 	dc->new_emc_clk_rate = new_rate;
 
@@ -1022,23 +1045,15 @@ static inline u32 compute_initial_dda(fixed20_12 in)
 }
 
 /* does not support updating windows on multiple dcs in one call */
-int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n)
+/* must be called with dc->lock held and the dc enabled */
+static void _tegra_dc_update_windows(struct tegra_dc *dc,
+				     struct tegra_dc_win *windows[], int n)
 {
-	struct tegra_dc *dc;
 	unsigned long update_mask = GENERAL_ACT_REQ;
 	unsigned long val;
 	bool update_blend = false;
 	int i;
 
-	dc = windows[0]->dc;
-
-	mutex_lock(&dc->lock);
-
-	if (!dc->enabled) {
-		mutex_unlock(&dc->lock);
-		return -EFAULT;
-	}
-
 	if (no_vsync)
 		tegra_dc_writel(dc, WRITE_MUX_ACTIVE | READ_MUX_ACTIVE, DC_CMD_STATE_ACCESS);
 	else
@@ -1211,6 +1226,22 @@ int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n)
 
 	if (dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE)
 		tegra_dc_writel(dc, NC_HOST_TRIG, DC_CMD_STATE_CONTROL);
+}
+
+int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n)
+{
+	struct tegra_dc *dc;
+
+	dc = windows[0]->dc;
+
+	mutex_lock(&dc->lock);
+
+	if (!dc->enabled) {
+		mutex_unlock(&dc->lock);
+		return -EFAULT;
+	}
+
+	_tegra_dc_update_windows(dc, windows, n);
 
 	mutex_unlock(&dc->lock);
 
@@ -1283,6 +1314,282 @@ int tegra_dc_sync_windows(struct tegra_dc_win *windows[], int n)
 }
 EXPORT_SYMBOL(tegra_dc_sync_windows);
 
+/*
+ * Flip queue
+ *
+ * Flips are programmed in the order they were queued, one at a time.  In
+ * continuous mode the vblank interrupt kicks the flip worker once the
+ * previous flip has been latched; the worker reads back the fences of the
+ * flip at the head of the queue and, when they have all been reached,
+ * writes the new state right after vblank so the hardware takes it at the
+ * next frame.  The interrupt leaves the fences alone, reading a syncpt back
+ * needs host1x powered up and that can't be done from there.
+ * One-shot panels have no free running vblank; there, and while flushing,
+ * the worker waits for the fences and for the update itself.
+ */
+
+#define TEGRA_DC_FLIP_FENCE_TIMEOUT_MS	500
+
+static int tegra_dc_flip_windows(struct tegra_dc *dc,
+				 struct tegra_dc_flip *flip,
+				 struct tegra_dc_win *wins[])
+{
+	int i;
+
+	if (flip->flags & TEGRA_DC_FLIP_BLEND) {
+		for (i = 0; i < DC_N_WINDOWS; i++)
+			wins[i] = &dc->windows[i];
+		return DC_N_WINDOWS;
+	}
+
+	for (i = 0; i < flip->nr_win; i++)
+		wins[i] = &dc->windows[flip->win[i].idx];
+
+	return flip->nr_win;
+}
+
+/* reads the syncpts back from host1x when needed, worker only */
+static bool tegra_dc_flip_fences_done(struct tegra_dc *dc,
+				      struct tegra_dc_flip *flip)
+{
+	struct nvhost_syncpt *sp = &dc->ndev->host->syncpt;
+	int i;
+
+	for (i = 0; i < flip->nr_fences; i++) {
+		struct tegra_dc_flip_fence *fence = &flip->fences[i];
+
+		if (nvhost_syncpt_min_cmp(sp, fence->id, fence->thresh))
+			continue;
+
+		nvhost_syncpt_read(sp, fence->id);
+		if (!nvhost_syncpt_min_cmp(sp, fence->id, fence->thresh))
+			return false;
+	}
+
+	return true;
+}
+
+/* fences reached, or given up on as a blocking wait would have */
+static bool tegra_dc_flip_ready(struct tegra_dc *dc,
+				struct tegra_dc_flip *flip)
+{
+	if (tegra_dc_flip_fences_done(dc, flip))
+		return true;
+
+	return ktime_to_ms(ktime_sub(ktime_get(), flip->queued)) >=
+		TEGRA_DC_FLIP_FENCE_TIMEOUT_MS;
+}
+
+/* copy the staged window state of a flip into the dc, dc->lock held */
+static void tegra_dc_flip_apply(struct tegra_dc *dc,
+				struct tegra_dc_flip *flip)
+{
+	int i;
+
+	for (i = 0; i < flip->nr_win; i++) {
+		const struct tegra_dc_win *src = &flip->win[i];
+		struct tegra_dc_win *win = &dc->windows[src->idx];
+
+		win->flags = src->flags;
+		win->fmt = src->fmt;
+		win->phys_addr = src->phys_addr;
+		win->phys_addr_u = src->phys_addr_u;
+		win->phys_addr_v = src->phys_addr_v;
+		win->stride = src->stride;
+		win->stride_uv = src->stride_uv;
+		win->x = src->x;
+		win->y = src->y;
+		win->w = src->w;
+		win->h = src->h;
+		win->out_x = src->out_x;
+		win->out_y = src->out_y;
+		win->out_w = src->out_w;
+		win->out_h = src->out_h;
+		win->z = src->z;
+		win->cur_handle = src->cur_handle;
+	}
+
+	if (flip->flags & TEGRA_DC_FLIP_BLEND) {
+		for (i = 0; i < DC_N_WINDOWS; i++) {
+			struct tegra_dc_win *win = &dc->windows[i];
+
+			win->z = flip->blend.z[i];
+			win->flags &= ~TEGRA_WIN_BLEND_FLAGS_MASK;
+			win->flags |= flip->blend.flags[i];
+		}
+	}
+}
+
+/* flip.lock held */
+static void tegra_dc_flip_retire(struct tegra_dc *dc,
+				 struct tegra_dc_flip *flip)
+{
+	flip->latched = ktime_get();
+	list_add_tail(&flip->list, &dc->flip.done);
+}
+
+/* flip.lock held */
+static bool tegra_dc_flip_sync(struct tegra_dc *dc)
+{
+#ifdef CONFIG_TEGRA_FPGA_PLATFORM
+	/* no interrupts to latch on */
+	return true;
+#else
+	return dc->flip.flushing || no_vsync || !dc->enabled ||
+		(dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE);
+#endif
+}
+
+static void tegra_dc_flip_enable_vblank(struct tegra_dc *dc)
+{
+	u32 val;
+
+	mutex_lock(&dc->lock);
+	if (dc->enabled) {
+		val = tegra_dc_readl(dc, DC_CMD_INT_ENABLE);
+		val |= V_BLANK_INT;
+		tegra_dc_writel(dc, val, DC_CMD_INT_ENABLE);
+	}
+	mutex_unlock(&dc->lock);
+}
+
+static void tegra_dc_flip_worker(struct work_struct *work)
+{
+	struct tegra_dc *dc = container_of(work, struct tegra_dc, flip.work);
+	struct nvhost_syncpt *sp = &dc->ndev->host->syncpt;
+	struct tegra_dc_win *wins[DC_N_WINDOWS];
+	struct tegra_dc_flip *flip, *active, *tmp;
+	unsigned long flags;
+	LIST_HEAD(done);
+	bool sync;
+	int i, n;
+
+	for (;;) {
+		spin_lock_irqsave(&dc->flip.lock, flags);
+		sync = tegra_dc_flip_sync(dc);
+		active = dc->flip.active;
+		flip = NULL;
+		if (!active && !list_empty(&dc->flip.pending))
+			flip = list_first_entry(&dc->flip.pending,
+						struct tegra_dc_flip, list);
+		spin_unlock_irqrestore(&dc->flip.lock, flags);
+
+		if (active) {
+			if (!sync)
+				break;
+
+			/* don't wait for the interrupt to retire it */
+			n = tegra_dc_flip_windows(dc, active, wins);
+			tegra_dc_sync_windows(wins, n);
+
+			spin_lock_irqsave(&dc->flip.lock, flags);
+			if (dc->flip.active == active) {
+				tegra_dc_flip_retire(dc, active);
+				dc->flip.active = NULL;
+			}
+			spin_unlock_irqrestore(&dc->flip.lock, flags);
+			continue;
+		}
+
+		if (!flip)
+			break;
+
+		if (sync) {
+			for (i = 0; i < flip->nr_fences; i++)
+				nvhost_syncpt_wait_timeout(sp,
+					flip->fences[i].id,
+					flip->fences[i].thresh,
+					msecs_to_jiffies(
+						TEGRA_DC_FLIP_FENCE_TIMEOUT_MS),
+					NULL);
+		} else if (!tegra_dc_flip_ready(dc, flip)) {
+			/* the vblank interrupt will kick us again */
+			dc->stats.flips_fence_wait++;
+			tegra_dc_flip_enable_vblank(dc);
+			break;
+		}
+
+		spin_lock_irqsave(&dc->flip.lock, flags);
+		list_del(&flip->list);
+		spin_unlock_irqrestore(&dc->flip.lock, flags);
+
+		mutex_lock(&dc->lock);
+		tegra_dc_flip_apply(dc, flip);
+		n = tegra_dc_flip_windows(dc, flip, wins);
+		if (dc->enabled) {
+			_tegra_dc_update_windows(dc, wins, n);
+			dc->stats.flips++;
+		} else {
+			flip->err = -EFAULT;
+		}
+		flip->programmed = ktime_get();
+		mutex_unlock(&dc->lock);
+
+		if (!flip->err && sync)
+			tegra_dc_sync_windows(wins, n);
+
+		spin_lock_irqsave(&dc->flip.lock, flags);
+		if (flip->err || sync)
+			tegra_dc_flip_retire(dc, flip);
+		else
+			dc->flip.active = flip;
+		spin_unlock_irqrestore(&dc->flip.lock, flags);
+	}
+
+	spin_lock_irqsave(&dc->flip.lock, flags);
+	list_splice_init(&dc->flip.done, &done);
+	spin_unlock_irqrestore(&dc->flip.lock, flags);
+
+	list_for_each_entry_safe(flip, tmp, &done, list) {
+		list_del(&flip->list);
+		flip->complete(flip);
+	}
+}
+
+/*
+ * Queue an atomic window update.  Returns immediately; flip->complete() is
+ * called from the flip worker once the new state has been latched, after
+ * which the caller owns the flip again.
+ */
+int tegra_dc_queue_flip(struct tegra_dc *dc, struct tegra_dc_flip *flip)
+{
+	unsigned long flags;
+
+	if (WARN_ON(!flip->complete || flip->nr_win > DC_N_WINDOWS ||
+		    flip->nr_fences > DC_N_WINDOWS))
+		return -EINVAL;
+
+	flip->err = 0;
+	flip->queued = ktime_get();
+	flip->programmed = ktime_set(0, 0);
+	flip->latched = ktime_set(0, 0);
+
+	spin_lock_irqsave(&dc->flip.lock, flags);
+	list_add_tail(&flip->list, &dc->flip.pending);
+	spin_unlock_irqrestore(&dc->flip.lock, flags);
+
+	queue_work(dc->flip.wq, &dc->flip.work);
+
+	return 0;
+}
+
+/* program and retire everything queued so far */
+void tegra_dc_flush_flips(struct tegra_dc *dc)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dc->flip.lock, flags);
+	dc->flip.flushing = true;
+	spin_unlock_irqrestore(&dc->flip.lock, flags);
+
+	queue_work(dc->flip.wq, &dc->flip.work);
+	flush_workqueue(dc->flip.wq);
+
+	spin_lock_irqsave(&dc->flip.lock, flags);
+	dc->flip.flushing = false;
+	spin_unlock_irqrestore(&dc->flip.lock, flags);
+}
+
 static unsigned long tegra_dc_clk_get_rate(struct tegra_dc *dc)
 {
 #ifdef CONFIG_TEGRA_SILICON_PLATFORM
@@ -1549,6 +1856,7 @@ static int tegra_dc_program_mode(struct tegra_dc *dc, struct tegra_dc_mode *mode
 
 	/* use default EMC rate when switching modes */
 	dc->new_emc_clk_rate = tegra_dc_get_default_emc_clk_rate(dc);
+	dc->new_emc_bw = 0;
 	tegra_dc_program_bandwidth(dc);
 
 	tegra_dc_writel(dc, 0x0, DC_DISP_DISP_TIMING_OPTIONS);
@@ -1935,6 +2243,47 @@ static void tegra_dc_vblank(struct work_struct *work)
 }
 
 #ifndef CONFIG_TEGRA_FPGA_PLATFORM
+static bool tegra_dc_flip_busy(struct tegra_dc *dc)
+{
+	bool busy;
+
+	spin_lock(&dc->flip.lock);
+	busy = dc->flip.active || !list_empty(&dc->flip.pending);
+	spin_unlock(&dc->flip.lock);
+
+	return busy;
+}
+
+/* retire the active flip once latched and kick the next one if it's ready */
+static void tegra_dc_flip_irq(struct tegra_dc *dc)
+{
+	struct tegra_dc_win *wins[DC_N_WINDOWS];
+	struct tegra_dc_flip *flip;
+	bool kick = false;
+	int n;
+
+	spin_lock(&dc->flip.lock);
+
+	flip = dc->flip.active;
+	if (flip) {
+		n = tegra_dc_flip_windows(dc, flip, wins);
+		if (tegra_dc_windows_are_clean(wins, n)) {
+			tegra_dc_flip_retire(dc, flip);
+			dc->flip.active = NULL;
+			kick = true;
+		}
+	}
+
+	/* the worker checks the fences, they can't be read back from here */
+	if (!dc->flip.active && !list_empty(&dc->flip.pending))
+		kick = true;
+
+	spin_unlock(&dc->flip.lock);
+
+	if (kick)
+		queue_work(dc->flip.wq, &dc->flip.work);
+}
+
 static void tegra_dc_underflow_handler(struct tegra_dc *dc)
 {
 	u32 val, i;
@@ -1944,6 +2293,16 @@ static void tegra_dc_underflow_handler(struct tegra_dc *dc)
 		if (dc->underflow_mask & (WIN_A_UF_INT << i)) {
 			dc->windows[i].underflows++;
 
+			/* let the LA tuning tighten this window's client */
+			if (dc->ndev->id < ARRAY_SIZE(la_id_tab) &&
+			    i < ARRAY_SIZE(*la_id_tab)) {
+				tegra_latency_allowance_underflow(
+					la_id_tab[dc->ndev->id][i]);
+				if (i == 1)
+					tegra_latency_allowance_underflow(
+						vfilter_tab[dc->ndev->id]);
+			}
+
 #ifdef CONFIG_ARCH_TEGRA_2x_SOC
 			if (dc->windows[i].underflows > 4)
 				schedule_work(&dc->reset_work);
@@ -1953,9 +2312,9 @@ static void tegra_dc_underflow_handler(struct tegra_dc *dc)
 		}
 	}
 
-	if (!dc->underflow_mask) {
-		/* If we have no underflow to check, go ahead
-		   and disable the interrupt */
+	if (!dc->underflow_mask && !tegra_dc_flip_busy(dc)) {
+		/* If we have no underflow to check and no flip
+		   waiting on vblank, go ahead and disable the interrupt */
 		val = tegra_dc_readl(dc, DC_CMD_INT_ENABLE);
 		if (dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE)
 			val &= ~FRAME_END_INT;
@@ -2023,6 +2382,9 @@ static void tegra_dc_one_shot_irq(struct tegra_dc *dc, unsigned long status)
 		/* Sync up windows. */
 		tegra_dc_trigger_windows(dc);
 
+		/* Retire any latched flip. */
+		tegra_dc_flip_irq(dc);
+
 		/* Schedule any additional bottom-half vblank actvities. */
 		schedule_work(&dc->vblank_work);
 
@@ -2042,6 +2404,9 @@ static void tegra_dc_continuous_irq(struct tegra_dc *dc, unsigned long status)
 		/* Check underflow */
 		tegra_dc_underflow_handler(dc);
 
+		/* Latch the next queued flip. */
+		tegra_dc_flip_irq(dc);
+
 		/* Schedule any additional bottom-half vblank actvities. */
 		schedule_work(&dc->vblank_work);
 
@@ -2669,6 +3034,7 @@ static int tegra_dc_probe(struct nvhost_device *ndev)
 	 */
 	dc->emc_clk_rate = tegra_dc_get_default_emc_clk_rate(dc);
 	clk_set_rate(emc_clk, dc->emc_clk_rate);
+	dc->emc_qos = tegra_emc_qos_register(dev_name(&ndev->dev));
 
 	if (dc->pdata->flags & TEGRA_DC_FLAG_ENABLED)
 		dc->enabled = true;
@@ -2681,6 +3047,17 @@ static int tegra_dc_probe(struct nvhost_device *ndev)
 #endif
 	INIT_WORK(&dc->vblank_work, tegra_dc_vblank);
 
+	spin_lock_init(&dc->flip.lock);
+	INIT_LIST_HEAD(&dc->flip.pending);
+	INIT_LIST_HEAD(&dc->flip.done);
+	INIT_WORK(&dc->flip.work, tegra_dc_flip_worker);
+	dc->flip.wq = create_singlethread_workqueue(dev_name(&ndev->dev));
+	if (!dc->flip.wq) {
+		dev_err(&ndev->dev, "can't create flip workqueue\n");
+		ret = -ENOMEM;
+		goto err_put_emc_clk;
+	}
+
 	dc->n_windows = DC_N_WINDOWS;
 	for (i = 0; i < dc->n_windows; i++) {
 		dc->windows[i].idx = i;
@@ -2725,7 +3102,7 @@ static int tegra_dc_probe(struct nvhost_device *ndev)
 			dev_name(&ndev->dev), dc)) {
 		dev_err(&ndev->dev, "request_irq %d failed\n", irq);
 		ret = -EBUSY;
-		goto err_put_emc_clk;
+		goto err_destroy_flip_wq;
 	}
 
 	/* hack to balance enable_irq calls in _tegra_dc_enable() */
@@ -2777,7 +3154,10 @@ static int tegra_dc_probe(struct nvhost_device *ndev)
 
 err_free_irq:
 	free_irq(irq, dc);
+err_destroy_flip_wq:
+	destroy_workqueue(dc->flip.wq);
 err_put_emc_clk:
+	tegra_emc_qos_unregister(dc->emc_qos);
 	clk_put(emc_clk);
 err_put_clk:
 	clk_put(clk);
@@ -2822,6 +3202,8 @@ static int tegra_dc_remove(struct nvhost_device *ndev)
 	switch_dev_unregister(&dc->modeset_switch);
 #endif
 	free_irq(dc->irq, dc);
+	destroy_workqueue(dc->flip.wq);
+	tegra_emc_qos_unregister(dc->emc_qos);
 	clk_put(dc->emc_clk);
 	clk_put(dc->clk);
 	iounmap(dc->base);
@@ -19,7 +19,10 @@
 #define __DRIVERS_VIDEO_TEGRA_DC_DC_PRIV_H
 
 #include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/completion.h>
 #include <linux/switch.h>
@@ -46,12 +49,47 @@
 #endif
 
 struct tegra_dc;
+struct tegra_emc_qos_client;
 
 struct tegra_dc_blend {
 	unsigned z[DC_N_WINDOWS];
 	unsigned flags[DC_N_WINDOWS];
 };
 
+/*
+ * An atomic update of one or more windows, queued with tegra_dc_queue_flip()
+ * and latched by the vblank interrupt once all of its fences have been
+ * reached.  win[] holds the staged window state; win[i].idx selects the
+ * hardware window it is applied to.
+ */
+#define TEGRA_DC_FLIP_BLEND		(1 << 0) /* apply blend to all windows */
+
+struct tegra_dc_flip_fence {
+	u32			id;
+	u32			thresh;
+};
+
+struct tegra_dc_flip {
+	struct list_head	list;
+	u32			flags;
+
+	int			nr_win;
+	struct tegra_dc_win	win[DC_N_WINDOWS];
+	struct tegra_dc_blend	blend;
+
+	int			nr_fences;
+	struct tegra_dc_flip_fence fences[DC_N_WINDOWS];
+
+	/* filled in by the dc before complete() is called */
+	int			err;
+	ktime_t			queued;
+	ktime_t			programmed;
+	ktime_t			latched;
+
+	/* called from process context once the flip is on screen */
+	void			(*complete)(struct tegra_dc_flip *flip);
+};
+
 struct tegra_dc_out_ops {
 	/* initialize output.  dc clocks are not on at this point */
 	int (*init)(struct tegra_dc *dc);
@@ -83,6 +121,10 @@ struct tegra_dc {
 	struct clk			*emc_clk;
 	int				emc_clk_rate;
 	int				new_emc_clk_rate;
+	/* dynamic emc bandwidth, bytes/s, when the QoS governor is used */
+	struct tegra_emc_qos_client	*emc_qos;
+	unsigned long			emc_bw;
+	unsigned long			new_emc_bw;
 
 	bool				connected;
 	bool				enabled;
@@ -125,11 +167,24 @@ struct tegra_dc {
 
 	struct work_struct		vblank_work;
 
+	struct {
+		spinlock_t		lock;
+		struct list_head	pending;
+		struct list_head	done;
+		/* programmed, waiting for the hardware to latch it */
+		struct tegra_dc_flip	*active;
+		bool			flushing;
+		struct workqueue_struct	*wq;
+		struct work_struct	work;
+	} flip;
+
 	struct {
 		u64			underflows;
 		u64			underflows_a;
 		u64			underflows_b;
 		u64			underflows_c;
+		u64			flips;
+		u64			flips_fence_wait;
 	} stats;
 
 	struct tegra_dc_ext		*ext;
@@ -208,6 +263,8 @@ bool tegra_dc_stats_get(struct tegra_dc *dc);
 /* defined in dc.c, used by overlay.c */
 unsigned int tegra_dc_has_multiple_dc(void);
 unsigned long tegra_dc_get_bandwidth(struct tegra_dc_win *wins[], int n);
+int tegra_dc_queue_flip(struct tegra_dc *dc, struct tegra_dc_flip *flip);
+void tegra_dc_flush_flips(struct tegra_dc *dc);
 
 /* defined in dc.c, used by dc_sysfs.c */
 u32 tegra_dc_read_checksum_latched(struct tegra_dc *dc);
@@ -27,12 +27,14 @@
 #include <linux/spinlock.h>
 #include <linux/tegra_overlay.h>
 #include <linux/uaccess.h>
+#include <linux/wait.h>
 #include <drm/drm_fixed.h>
 
 #include <asm/atomic.h>
 
 #include <mach/dc.h>
 #include <mach/fb.h>
+#include <mach/emc_qos.h>
 #include <linux/nvhost.h>
 
 #include "dc_priv.h"
@@ -42,6 +44,12 @@
 /* Minimum extra shot for DIDIM if n shot is enabled. */
 #define TEGRA_DC_DIDIM_MIN_SHOT	1
 
+/* Flips a client may have queued ahead of the display. */
+#define TEGRA_OVERLAY_MAX_PENDING_FLIPS	3
+
+/* Completed flips whose timestamps can still be queried. */
+#define TEGRA_OVERLAY_FLIP_HISTORY	16
+
 DEFINE_MUTEX(tegra_flip_lock);
 
 struct overlay_client;
@@ -72,6 +80,16 @@ struct tegra_overlay_info {
 	struct mutex		lock;
 	struct workqueue_struct	*flip_wq;
 
+	/* last handle queued on each window, unpinned by the next flip */
+	struct nvmap_handle_ref	*cur_handle[DC_N_WINDOWS];
+
+	atomic_t		nr_pending;
+	wait_queue_head_t	flip_wait;
+
+	/* protected by lock */
+	struct tegra_overlay_flip_times	history[TEGRA_OVERLAY_FLIP_HISTORY];
+	unsigned		history_next;
+
 	/* Big enough for tegra_dc%u when %u < 10 */
 	char			name[10];
 };
@@ -98,6 +116,7 @@ struct tegra_overlay_flip_data {
 	struct tegra_overlay_info	*overlay;
 	struct nvmap_handle_ref		*unpin_handles[TEGRA_FB_FLIP_N_WINDOWS];
 	struct tegra_overlay_flip_win	win[TEGRA_FB_FLIP_N_WINDOWS];
+	struct tegra_dc_flip		flip;
 };
 
 static void tegra_overlay_flip_worker(struct work_struct *work);
@@ -218,14 +237,6 @@ static int tegra_overlay_set_windowattr(struct tegra_overlay_info *overlay,
 	win->stride = flip_win->attr.stride;
 	win->stride_uv = flip_win->attr.stride_uv;
 
-	if ((s32)flip_win->attr.pre_syncpt_id >= 0) {
-		nvhost_syncpt_wait_timeout(&overlay->ndev->host->syncpt,
-					   flip_win->attr.pre_syncpt_id,
-					   flip_win->attr.pre_syncpt_val,
-					   msecs_to_jiffies(500),
-					   NULL);
-	}
-
 	/* Store the blend state incase we need to reorder later */
 	overlay->blend.z[win->idx] = win->z;
 	overlay->blend.flags[win->idx] = win->flags & TEGRA_WIN_BLEND_FLAGS_MASK;
@@ -235,17 +246,13 @@ static int tegra_overlay_set_windowattr(struct tegra_overlay_info *overlay,
 
 /* overlay policy for premult is dst alpha, which needs reassignment */
 /* of blend settings for the DC */
-static void tegra_overlay_blend_reorder(struct tegra_dc_blend *blend,
-					struct tegra_dc_win *windows[])
+static void tegra_overlay_blend_reorder(const struct tegra_dc_blend *blend,
+					struct tegra_dc_blend *out)
 {
 	int idx, below;
 
-	/* Copy across the original blend state to each window */
-	for (idx = 0; idx < DC_N_WINDOWS; idx++) {
-		windows[idx]->z = blend->z[idx];
-		windows[idx]->flags &= ~TEGRA_WIN_BLEND_FLAGS_MASK;
-		windows[idx]->flags |= blend->flags[idx];
-	}
+	/* Copy across the original blend state */
+	*out = *blend;
 
 	/* Find a window with PreMult */
 	for (idx = 0; idx < DC_N_WINDOWS; idx++) {
@@ -266,30 +273,25 @@ static void tegra_overlay_blend_reorder(struct tegra_dc_blend *blend,
 		return;
 
 	/* Switch the flags and the ordering */
-	windows[idx]->z = blend->z[below];
-	windows[idx]->flags &= ~TEGRA_WIN_BLEND_FLAGS_MASK;
-	windows[idx]->flags |= blend->flags[below];
-	windows[below]->z = blend->z[idx];
-	windows[below]->flags &= ~TEGRA_WIN_BLEND_FLAGS_MASK;
-	windows[below]->flags |= blend->flags[idx];
+	out->z[idx] = blend->z[below];
+	out->flags[idx] = blend->flags[below];
+	out->z[below] = blend->z[idx];
+	out->flags[below] = blend->flags[idx];
 }
 
+/* called from the dc flip worker, must not take tegra_flip_lock */
 static int tegra_overlay_flip_didim(struct tegra_overlay_flip_data *data)
 {
-	mutex_lock(&tegra_flip_lock);
 	INIT_WORK(&data->work, tegra_overlay_flip_worker);
 
 	queue_work(data->overlay->flip_wq, &data->work);
 
-	mutex_unlock(&tegra_flip_lock);
-
 	return 0;
 }
 
-static void tegra_overlay_n_shot(struct tegra_overlay_flip_data *data,
-			struct nvmap_handle_ref **unpin_handles, int *nr_unpin)
+/* returns true if the flip was queued again for DIDIM */
+static bool tegra_overlay_n_shot(struct tegra_overlay_flip_data *data)
 {
-	int i;
 	struct tegra_overlay_info *overlay = data->overlay;
 	u32 didim_delay = overlay->dc->out->sd_settings->hw_update_delay;
 	u32 didim_enable = overlay->dc->out->sd_settings->enable;
@@ -305,13 +307,7 @@ static void tegra_overlay_n_shot(struct tegra_overlay_flip_data *data,
 		if (overlay->n_shot && didim_enable) {
 			tegra_overlay_flip_didim(data);
 			mutex_unlock(&overlay->lock);
-			return;
-		} else {
-			*nr_unpin = data->nr_unpin;
-			for (i = 0; i < *nr_unpin; i++)
-				unpin_handles[i] = data->unpin_handles[i];
-			tegra_dc_incr_syncpt_min(overlay->dc, 0,
-						data->syncpt_max);
+			return true;
 		}
 	} else {
 		overlay->overlay_ref--;
@@ -321,44 +317,90 @@ static void tegra_overlay_n_shot(struct tegra_overlay_flip_data *data,
 			overlay->n_shot = TEGRA_DC_DIDIM_MIN_SHOT + didim_delay;
 
 		if (overlay->n_shot && didim_enable) {
-			data->nr_unpin = *nr_unpin;
 			data->didim_work = true;
-			for (i = 0; i < *nr_unpin; i++)
-				data->unpin_handles[i] = unpin_handles[i];
 			tegra_overlay_flip_didim(data);
 			mutex_unlock(&overlay->lock);
-			return;
-		} else {
-			tegra_dc_incr_syncpt_min(overlay->dc, 0,
-						data->syncpt_max);
+			return true;
 		}
 	}
 
+	tegra_dc_incr_syncpt_min(overlay->dc, 0, data->syncpt_max);
+
 	mutex_unlock(&overlay->lock);
 
+	return false;
+}
+
+static void tegra_overlay_flip_done(struct tegra_overlay_info *overlay,
+				    struct tegra_overlay_flip_data *data)
+{
+	struct tegra_overlay_flip_times *t;
+
+	mutex_lock(&overlay->lock);
+	t = &overlay->history[overlay->history_next];
+	overlay->history_next = (overlay->history_next + 1) %
+		TEGRA_OVERLAY_FLIP_HISTORY;
+	t->post_syncpt_val = data->syncpt_max;
+	t->err = data->flip.err;
+	t->queued_ns = ktime_to_ns(data->flip.queued);
+	t->programmed_ns = ktime_to_ns(data->flip.programmed);
+	t->latched_ns = ktime_to_ns(data->flip.latched);
+	mutex_unlock(&overlay->lock);
+
+	atomic_dec(&overlay->nr_pending);
+	wake_up(&overlay->flip_wait);
+}
+
+/* called by the dc once the flip has been latched */
+static void tegra_overlay_flip_complete(struct tegra_dc_flip *flip)
+{
+	struct tegra_overlay_flip_data *data =
+		container_of(flip, struct tegra_overlay_flip_data, flip);
+	struct tegra_overlay_info *overlay = data->overlay;
+	int i;
+
+	if (!data->didim_work)
+		tegra_overlay_flip_done(overlay, data);
+
+	if ((overlay->dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE) &&
+		(overlay->dc->out->flags & TEGRA_DC_OUT_N_SHOT_MODE)) {
+		if (tegra_overlay_n_shot(data))
+			return;
+	} else {
+		tegra_dc_incr_syncpt_min(overlay->dc, 0, data->syncpt_max);
+	}
+
 	/* unpin and deref previous front buffers */
-	for (i = 0; i < *nr_unpin; i++) {
-		nvmap_unpin(overlay->overlay_nvmap, unpin_handles[i]);
-		nvmap_free(overlay->overlay_nvmap, unpin_handles[i]);
+	for (i = 0; i < data->nr_unpin; i++) {
+		nvmap_unpin(overlay->overlay_nvmap, data->unpin_handles[i]);
+		nvmap_free(overlay->overlay_nvmap, data->unpin_handles[i]);
 	}
 
 	kfree(data);
 }
 
+/*
+ * Stages the window state of a flip and hands it to the dc flip queue.
+ * Waiting for the pre-fences and for the update happens there, so this
+ * never blocks and several flips can be in flight.
+ */
 static void tegra_overlay_flip_worker(struct work_struct *work)
 {
 	struct tegra_overlay_flip_data *data =
 		container_of(work, struct tegra_overlay_flip_data, work);
 	struct tegra_overlay_info *overlay = data->overlay;
+	struct tegra_dc_flip *flip = &data->flip;
 	struct tegra_dc_win *win;
-	struct tegra_dc_win *wins[TEGRA_FB_FLIP_N_WINDOWS];
-	struct nvmap_handle_ref *unpin_handles[TEGRA_FB_FLIP_N_WINDOWS];
-	int i, nr_win = 0, nr_unpin = 0;
+	int i, err;
 
-	data = container_of(work, struct tegra_overlay_flip_data, work);
+	flip->flags = 0;
+	flip->nr_win = 0;
+	flip->nr_fences = 0;
+	flip->complete = tegra_overlay_flip_complete;
 
 	for (i = 0; i < TEGRA_FB_FLIP_N_WINDOWS; i++) {
 		struct tegra_overlay_flip_win *flip_win = &data->win[i];
+		struct tegra_dc_win *staged;
 		int idx = flip_win->attr.index;
 
 		if (idx == -1)
@@ -369,55 +411,37 @@ static void tegra_overlay_flip_worker(struct work_struct *work)
 		if (!win)
 			continue;
 
-		if (win->flags && win->cur_handle && !data->didim_work)
-				unpin_handles[nr_unpin++] = win->cur_handle;
-
-		tegra_overlay_set_windowattr(overlay, win, &data->win[i]);
-
-		wins[nr_win++] = win;
-
-#if 0
-		if (flip_win->attr.pre_syncpt_id < 0)
-			continue;
-		printk("%08x %08x\n",
-		       flip_win->attr.pre_syncpt_id,
-		       flip_win->attr.pre_syncpt_val);
+		if (!data->didim_work) {
+			if (overlay->cur_handle[idx])
+				data->unpin_handles[data->nr_unpin++] =
+					overlay->cur_handle[idx];
+			overlay->cur_handle[idx] = flip_win->handle;
+		}
 
-		nvhost_syncpt_wait_timeout(&overlay->ndev->host->syncpt,
-					   flip_win->attr.pre_syncpt_id,
-					   flip_win->attr.pre_syncpt_val,
-					   msecs_to_jiffies(500));
-#endif
+		staged = &flip->win[flip->nr_win++];
+		staged->idx = win->idx;
+		staged->dc = win->dc;
+		tegra_overlay_set_windowattr(overlay, staged, flip_win);
+
+		if (flip_win->handle &&
+		    (s32)flip_win->attr.pre_syncpt_id >= 0) {
+			flip->fences[flip->nr_fences].id =
+				flip_win->attr.pre_syncpt_id;
+			flip->fences[flip->nr_fences].thresh =
+				flip_win->attr.pre_syncpt_val;
+			flip->nr_fences++;
+		}
 	}
 
 	if (data->flags & TEGRA_OVERLAY_FLIP_FLAG_BLEND_REORDER) {
-		struct tegra_dc_win *dcwins[DC_N_WINDOWS];
-
-		for (i = 0; i < DC_N_WINDOWS; i++)
-			dcwins[i] = tegra_dc_get_window(overlay->dc, i);
-
-		tegra_overlay_blend_reorder(&overlay->blend, dcwins);
-		tegra_dc_update_windows(dcwins, DC_N_WINDOWS);
-		tegra_dc_sync_windows(dcwins, DC_N_WINDOWS);
-	} else {
-		tegra_dc_update_windows(wins, nr_win);
-		/* TODO: implement swapinterval here */
-		tegra_dc_sync_windows(wins, nr_win);
+		tegra_overlay_blend_reorder(&overlay->blend, &flip->blend);
+		flip->flags |= TEGRA_DC_FLIP_BLEND;
 	}
 
-	if ((overlay->dc->out->flags & TEGRA_DC_OUT_ONE_SHOT_MODE) &&
-		(overlay->dc->out->flags & TEGRA_DC_OUT_N_SHOT_MODE)) {
-		tegra_overlay_n_shot(data, unpin_handles, &nr_unpin);
-	} else {
-		tegra_dc_incr_syncpt_min(overlay->dc, 0, data->syncpt_max);
-
-		/* unpin and deref previous front buffers */
-		for (i = 0; i < nr_unpin; i++) {
-			nvmap_unpin(overlay->overlay_nvmap, unpin_handles[i]);
-			nvmap_free(overlay->overlay_nvmap, unpin_handles[i]);
-		}
-
-		kfree(data);
+	err = tegra_dc_queue_flip(overlay->dc, flip);
+	if (err) {
+		flip->err = err;
+		tegra_overlay_flip_complete(flip);
 	}
 }
 
@@ -433,6 +457,10 @@ static int tegra_overlay_flip(struct tegra_overlay_info *overlay,
 	if (WARN_ON(!overlay->ndev))
 		return -EFAULT;
 
+	/* don't let a client queue more than a few frames ahead */
+	wait_event(overlay->flip_wait, atomic_read(&overlay->nr_pending) <
+		   TEGRA_OVERLAY_MAX_PENDING_FLIPS);
+
 	mutex_lock(&tegra_flip_lock);
 	mutex_lock(&overlay->dc->lock);
 	if (!overlay->dc->enabled) {
@@ -482,6 +510,7 @@ static int tegra_overlay_flip(struct tegra_overlay_info *overlay,
 	syncpt_max = tegra_dc_incr_syncpt_max(overlay->dc, 0);
 	data->syncpt_max = syncpt_max;
 
+	atomic_inc(&overlay->nr_pending);
 	queue_work(overlay->flip_wq, &data->work);
 
 	args->post_syncpt_val = syncpt_max;
@@ -507,6 +536,7 @@ surf_err:
 static void tegra_overlay_set_emc_freq(struct tegra_overlay_info *dev)
 {
 	unsigned long new_rate;
+	unsigned long new_bw;
 	int i;
 	struct tegra_dc_win *win;
 	struct tegra_dc_win *wins[DC_N_WINDOWS];
@@ -516,11 +546,22 @@ static void tegra_overlay_set_emc_freq(struct tegra_overlay_info *dev)
 		wins[i] = win;
 	}
 
-	new_rate = tegra_dc_get_bandwidth(wins, dev->dc->n_windows);
-	new_rate = EMC_BW_TO_FREQ(new_rate);
+	new_bw = tegra_dc_get_bandwidth(wins, dev->dc->n_windows);
+	new_rate = EMC_BW_TO_FREQ(new_bw);
 
-	if (tegra_dc_has_multiple_dc())
+	if (tegra_dc_has_multiple_dc()) {
 		new_rate = ULONG_MAX;
+		new_bw = ULONG_MAX;
+	}
+
+	if (dev->dc->emc_qos) {
+		dev->dc->emc_bw = new_bw;
+		dev->dc->new_emc_bw = new_bw;
+		tegra_emc_qos_request(dev->dc->emc_qos,
+			(new_bw == ULONG_MAX) ? TEGRA_EMC_QOS_BW_MAX :
+			new_bw / 1000, 0);
+		return;
+	}
 
 	clk_set_rate(dev->dc->emc_clk, new_rate);
 }
@@ -686,6 +727,38 @@ static int tegra_overlay_ioctl_flip(struct overlay_client *client,
 	return 0;
 }
 
+static int tegra_overlay_ioctl_get_flip_times(struct overlay_client *client,
+					      void __user *arg)
+{
+	struct tegra_overlay_info *overlay = client->dev;
+	struct tegra_overlay_flip_times times;
+	int i, err = -ENOENT;
+
+	if (copy_from_user(&times, arg, sizeof(times)))
+		return -EFAULT;
+
+	mutex_lock(&overlay->lock);
+	for (i = 0; i < TEGRA_OVERLAY_FLIP_HISTORY; i++) {
+		struct tegra_overlay_flip_times *t = &overlay->history[i];
+
+		if (t->queued_ns &&
+		    t->post_syncpt_val == times.post_syncpt_val) {
+			times = *t;
+			err = 0;
+			break;
+		}
+	}
+	mutex_unlock(&overlay->lock);
+
+	if (err)
+		return err;
+
+	if (copy_to_user(arg, &times, sizeof(times)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static int tegra_overlay_ioctl_set_nvmap_fd(struct overlay_client *client,
 					    void __user *arg)
 {
@@ -802,6 +875,9 @@ static long tegra_overlay_ioctl(struct file *filp, unsigned int cmd,
 	case TEGRA_OVERLAY_IOCTL_SET_NVMAP_FD:
 		err = tegra_overlay_ioctl_set_nvmap_fd(client, uarg);
 		break;
+	case TEGRA_OVERLAY_IOCTL_GET_FLIP_TIMES:
+		err = tegra_overlay_ioctl_get_flip_times(client, uarg);
+		break;
 	default:
 		return -ENOTTY;
 	}
@@ -864,6 +940,8 @@ struct tegra_overlay_info *tegra_overlay_register(struct nvhost_device *ndev,
 	mutex_init(&dev->lock);
 	dev->overlay_ref = 0;
 	dev->n_shot = 0;
+	atomic_set(&dev->nr_pending, 0);
+	init_waitqueue_head(&dev->flip_wait);
 
 	dev->dc = dc;
 
@@ -884,6 +962,9 @@ void tegra_overlay_unregister(struct tegra_overlay_info *info)
 {
 	misc_deregister(&info->dev);
 
+	tegra_overlay_disable(info);
+	destroy_workqueue(info->flip_wq);
+
 	kfree(info);
 }
 
@@ -892,7 +973,10 @@ void tegra_overlay_disable(struct tegra_overlay_info *overlay_info)
 	mutex_lock(&tegra_flip_lock);
 	mutex_lock(&overlay_info->lock);
 	overlay_info->n_shot = 0;
-	flush_workqueue(overlay_info->flip_wq);
 	mutex_unlock(&overlay_info->lock);
+
+	/* flip completions take overlay_info->lock, don't hold it here */
+	flush_workqueue(overlay_info->flip_wq);
+	tegra_dc_flush_flips(overlay_info->dc);
 	mutex_unlock(&tegra_flip_lock);
 }
@@ -23,6 +23,7 @@
 #define _NVHOST_CHIP_SUPPORT_H_
 
 #include <linux/types.h>
+#include <linux/errno.h>
 struct output;
 struct nvhost_waitchk;
 struct nvhost_userctx_timeout;
@@ -96,6 +97,7 @@ struct nvhost_chip_support {
 		void (*reset)(struct push_buffer *);
 		int (*init)(struct push_buffer *);
 		void (*destroy)(struct push_buffer *);
+		int (*grow)(struct push_buffer *, u32 size);
 		void (*push_to)(struct push_buffer *,
 				struct nvmap_client *,
 				struct nvmap_handle *,
@@ -168,5 +170,17 @@ struct nvhost_chip_support {
 
 int nvhost_init_t20_support(struct nvhost_master *host);
 int nvhost_init_t30_support(struct nvhost_master *host);
+#ifdef CONFIG_TEGRA_GRHOST_SIM
+int nvhost_init_sim_support(struct nvhost_master *host);
+void nvhost_deinit_sim_support(struct nvhost_master *host);
+#else
+static inline int nvhost_init_sim_support(struct nvhost_master *host)
+{
+	return -ENODEV;
+}
+static inline void nvhost_deinit_sim_support(struct nvhost_master *host)
+{
+}
+#endif
 
 #endif /* _NVHOST_CHIP_SUPPORT_H_ */
@@ -125,6 +125,9 @@ void nvhost_debug_init(struct nvhost_master *master)
 			&nvhost_debug_force_timeout_val);
 	debugfs_create_u32("force_timeout_channel", S_IRUGO|S_IWUSR, de,
 			&nvhost_debug_force_timeout_channel);
+
+	debugfs_create_u32("intr_coalesce_us", S_IRUGO|S_IWUSR, de,
+			&master->intr.coalesce_us);
 }
 #else
 void nvhost_debug_init(struct nvhost_master *master)
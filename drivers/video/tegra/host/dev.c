@@ -44,6 +44,7 @@
 #include <mach/hardware.h>
 
 #include "debug.h"
+#include "nvhost_sync.h"
 
 #define DRIVER_NAME "tegra_grhost"
 #define IFACE_NAME "nvhost"
@@ -573,6 +574,44 @@ static int nvhost_ioctl_ctrl_syncpt_waitex(
 					args->thresh, timeout, &args->value);
 }
 
+static int nvhost_ioctl_ctrl_sync_fence_create(
+	struct nvhost_ctrl_userctx *ctx,
+	struct nvhost_ctrl_sync_fence_create_args *args)
+{
+	struct nvhost_ctrl_sync_fence_info pts[NVHOST_SYNC_MAX_PTS];
+	int fd;
+
+	if (!args->num_pts || args->num_pts > NVHOST_SYNC_MAX_PTS)
+		return -EINVAL;
+
+	if (copy_from_user(pts, args->pts, args->num_pts * sizeof(*pts)))
+		return -EFAULT;
+
+	trace_nvhost_ioctl_ctrl_sync_fence_create(args->num_pts,
+	  pts[0].id, pts[0].thresh);
+	fd = nvhost_sync_fence_create(ctx->dev, pts, args->num_pts);
+	if (fd < 0)
+		return fd;
+
+	args->fence_fd = fd;
+	return 0;
+}
+
+static int nvhost_ioctl_ctrl_sync_fence_merge(
+	struct nvhost_ctrl_userctx *ctx,
+	struct nvhost_ctrl_sync_fence_merge_args *args)
+{
+	int fd;
+
+	trace_nvhost_ioctl_ctrl_sync_fence_merge(args->fd1, args->fd2);
+	fd = nvhost_sync_fence_merge(ctx->dev, args->fd1, args->fd2);
+	if (fd < 0)
+		return fd;
+
+	args->fence_fd = fd;
+	return 0;
+}
+
 static int nvhost_ioctl_ctrl_module_mutex(
 	struct nvhost_ctrl_userctx *ctx,
 	struct nvhost_ctrl_module_mutex_args *args)
@@ -679,6 +718,12 @@ static long nvhost_ctrlctl(struct file *filp,
 	case NVHOST_IOCTL_CTRL_SYNCPT_WAITEX:
 		err = nvhost_ioctl_ctrl_syncpt_waitex(priv, (void *)buf);
 		break;
+	case NVHOST_IOCTL_CTRL_SYNC_FENCE_CREATE:
+		err = nvhost_ioctl_ctrl_sync_fence_create(priv, (void *)buf);
+		break;
+	case NVHOST_IOCTL_CTRL_SYNC_FENCE_MERGE:
+		err = nvhost_ioctl_ctrl_sync_fence_merge(priv, (void *)buf);
+		break;
 	default:
 		err = -ENOTTY;
 		break;
@@ -785,6 +830,8 @@ fail:
 
 static void nvhost_remove_chip_support(struct nvhost_master *host)
 {
+	/* the software model runs off these, stop it first */
+	nvhost_deinit_sim_support(host);
 
 	kfree(host->channels);
 	host->channels = 0;
@@ -811,10 +858,33 @@ static void nvhost_remove_chip_support(struct nvhost_master *host)
 	host->cpuaccess.lock_counts = 0;
 }
 
+enum {
+	NVHOST_HW,
+	NVHOST_SIM,
+};
+
+static const struct platform_device_id nvhost_id_table[] = {
+#ifdef CONFIG_TEGRA_GRHOST_SIM
+	/* the software model takes the place of the hardware host */
+	{ "tegra_grhost_sim", NVHOST_SIM },
+#else
+	{ DRIVER_NAME, NVHOST_HW },
+#endif
+	{ },
+};
+
+static inline bool nvhost_is_sim(struct platform_device *pdev)
+{
+	return platform_get_device_id(pdev)->driver_data == NVHOST_SIM;
+}
+
 static int __devinit nvhost_init_chip_support(struct nvhost_master *host)
 {
 	int err;
-	switch (tegra_get_chipid()) {
+
+	if (nvhost_is_sim(host->pdev))
+		err = nvhost_init_sim_support(host);
+	else switch (tegra_get_chipid()) {
 	case TEGRA_CHIPID_TEGRA2:
 		err = nvhost_init_t20_support(host);
 		break;
@@ -875,16 +945,24 @@ struct nvhost_moduledesc hostdesc = {
 static int __devinit nvhost_probe(struct platform_device *pdev)
 {
 	struct nvhost_master *host;
-	struct resource *regs, *intr0, *intr1;
+	struct resource *regs = NULL, *intr0, *intr1;
+	u32 irq_gen = 0, irq_sync = 0;
 	int i, err;
 
-	regs = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	intr0 = platform_get_resource(pdev, IORESOURCE_IRQ, 0);
-	intr1 = platform_get_resource(pdev, IORESOURCE_IRQ, 1);
+	/* the software model has no registers or interrupts */
+	if (!nvhost_is_sim(pdev)) {
+		regs = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+		intr0 = platform_get_resource(pdev, IORESOURCE_IRQ, 0);
+		intr1 = platform_get_resource(pdev, IORESOURCE_IRQ, 1);
 
-	if (!regs || !intr0 || !intr1) {
-		dev_err(&pdev->dev, "missing required platform resources\n");
-		return -ENXIO;
+		if (!regs || !intr0 || !intr1) {
+			dev_err(&pdev->dev,
+				"missing required platform resources\n");
+			return -ENXIO;
+		}
+
+		irq_sync = intr0->start;
+		irq_gen = intr1->start;
 	}
 
 	host = kzalloc(sizeof(*host), GFP_KERNEL);
@@ -900,18 +978,22 @@ static int __devinit nvhost_probe(struct platform_device *pdev)
 		goto fail;
 	}
 
-	host->reg_mem = request_mem_region(regs->start,
+	if (regs) {
+		host->reg_mem = request_mem_region(regs->start,
 					resource_size(regs), pdev->name);
-	if (!host->reg_mem) {
-		dev_err(&pdev->dev, "failed to get host register memory\n");
-		err = -ENXIO;
-		goto fail;
-	}
-	host->aperture = ioremap(regs->start, resource_size(regs));
-	if (!host->aperture) {
-		dev_err(&pdev->dev, "failed to remap host registers\n");
-		err = -ENXIO;
-		goto fail;
+		if (!host->reg_mem) {
+			dev_err(&pdev->dev,
+				"failed to get host register memory\n");
+			err = -ENXIO;
+			goto fail;
+		}
+		host->aperture = ioremap(regs->start, resource_size(regs));
+		if (!host->aperture) {
+			dev_err(&pdev->dev,
+				"failed to remap host registers\n");
+			err = -ENXIO;
+			goto fail;
+		}
 	}
 
 	err = nvhost_init_chip_support(host);
@@ -934,7 +1016,7 @@ static int __devinit nvhost_probe(struct platform_device *pdev)
 	if (err)
 		goto fail;
 
-	err = nvhost_intr_init(&host->intr, intr1->start, intr0->start);
+	err = nvhost_intr_init(&host->intr, irq_gen, irq_sync);
 	if (err)
 		goto fail;
 
@@ -1003,6 +1085,7 @@ static struct platform_driver nvhost_driver = {
 	.remove = __exit_p(nvhost_remove),
 	.suspend = nvhost_suspend,
 	.resume = nvhost_resume,
+	.id_table = nvhost_id_table,
 	.driver = {
 		.owner = THIS_MODULE,
 		.name = DRIVER_NAME
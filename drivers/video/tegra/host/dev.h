@@ -52,6 +52,7 @@ struct nvhost_master {
 	u32 nb_modules;
 
 	u32 sync_queue_size;
+	u32 sync_queue_max_size;
 
 	struct nvhost_chip_support op;
 };
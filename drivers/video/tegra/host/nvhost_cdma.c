@@ -32,8 +32,11 @@
  * TODO:
  *   stats
  *     - for figuring out what to optimize further
- *   resizable push buffer & sync queue
- *     - some channels hardly need any, some channels (3d) could use more
+ *
+ * The push buffer and sync queue start small and are grown (up to a chip
+ * specific limit) the next time the channel goes idle after a submitter
+ * had to wait for space in them, so only channels with deep submission
+ * queues (3d) pay for the extra memory.
  */
 
 /* Sync Queue
@@ -82,18 +85,12 @@ static void reset_sync_queue(struct sync_queue *queue)
  */
 static unsigned int sync_queue_space(struct sync_queue *queue)
 {
-	struct nvhost_cdma *cdma;
-	struct nvhost_master *host;
-
 	unsigned int read = queue->read;
 	unsigned int write = queue->write;
 	u32 size;
 
-	cdma = container_of(queue, struct nvhost_cdma, sync_queue);
-	host = cdma_to_dev(cdma);
-
-	BUG_ON(read  > (host->sync_queue_size - SYNC_QUEUE_MIN_ENTRY));
-	BUG_ON(write > (host->sync_queue_size - SYNC_QUEUE_MIN_ENTRY));
+	BUG_ON(read  > (queue->size - SYNC_QUEUE_MIN_ENTRY));
+	BUG_ON(write > (queue->size - SYNC_QUEUE_MIN_ENTRY));
 
 	/*
 	 * We can use all of the space up to the end of the buffer, unless the
@@ -103,7 +100,7 @@ static unsigned int sync_queue_space(struct sync_queue *queue)
 	if (read > write) {
 		size = (read - 1) - write;
 	} else {
-		size = host->sync_queue_size - write;
+		size = queue->size - write;
 
 		/*
 		 * If the read position is zero, it gets complicated. We can't
@@ -165,14 +162,9 @@ static void add_to_sync_queue(struct sync_queue *queue,
 			      u32 first_get,
 			      struct nvhost_userctx_timeout *timeout)
 {
-	struct nvhost_cdma *cdma;
-	struct nvhost_master *host;
 	u32 size, write = queue->write;
 	u32 *p = queue->buffer + write;
 
-	cdma = container_of(queue, struct nvhost_cdma, sync_queue);
-	host = cdma_to_dev(cdma);
-
 	BUG_ON(sync_point_id == NVSYNCPT_INVALID);
 	BUG_ON(sync_queue_space(queue) < nr_handles);
 
@@ -180,7 +172,7 @@ static void add_to_sync_queue(struct sync_queue *queue,
 	size += entry_size(nr_handles);
 
 	write += size;
-	BUG_ON(write > host->sync_queue_size);
+	BUG_ON(write > queue->size);
 
 	p[SQ_IDX_SYNCPT_ID] = sync_point_id;
 	p[SQ_IDX_SYNCPT_VAL] = sync_point_value;
@@ -201,7 +193,7 @@ static void add_to_sync_queue(struct sync_queue *queue,
 	}
 
 	/* If there's not enough room for another entry, wrap to the start. */
-	if ((write + SYNC_QUEUE_MIN_ENTRY) > host->sync_queue_size) {
+	if ((write + SYNC_QUEUE_MIN_ENTRY) > queue->size) {
 		/*
 		 * It's an error for the read position to be zero, as that
 		 * would mean we emptied the queue while adding something.
@@ -218,15 +210,11 @@ static void add_to_sync_queue(struct sync_queue *queue,
  */
 static u32 *sync_queue_head(struct sync_queue *queue)
 {
-	struct nvhost_cdma *cdma = container_of(queue,
-						struct nvhost_cdma,
-						sync_queue);
-	struct nvhost_master *host = cdma_to_dev(cdma);
 	u32 read = queue->read;
 	u32 write = queue->write;
 
-	BUG_ON(read  > (host->sync_queue_size - SYNC_QUEUE_MIN_ENTRY));
-	BUG_ON(write > (host->sync_queue_size - SYNC_QUEUE_MIN_ENTRY));
+	BUG_ON(read  > (queue->size - SYNC_QUEUE_MIN_ENTRY));
+	BUG_ON(write > (queue->size - SYNC_QUEUE_MIN_ENTRY));
 
 	if (read == write)
 		return NULL;
@@ -239,10 +227,6 @@ static u32 *sync_queue_head(struct sync_queue *queue)
 static void
 dequeue_sync_queue_head(struct sync_queue *queue)
 {
-	struct nvhost_cdma *cdma = container_of(queue,
-						struct nvhost_cdma,
-						sync_queue);
-	struct nvhost_master *host = cdma_to_dev(cdma);
 	u32 read = queue->read;
 	u32 size;
 
@@ -252,10 +236,10 @@ dequeue_sync_queue_head(struct sync_queue *queue)
 	size += entry_size(queue->buffer[read + SQ_IDX_NUM_HANDLES]);
 
 	read += size;
-	BUG_ON(read > host->sync_queue_size);
+	BUG_ON(read > queue->size);
 
 	/* If there's not enough room for another entry, wrap to the start. */
-	if ((read + SYNC_QUEUE_MIN_ENTRY) > host->sync_queue_size)
+	if ((read + SYNC_QUEUE_MIN_ENTRY) > queue->size)
 		read = 0;
 	queue->read = read;
 }
@@ -284,6 +268,34 @@ static unsigned int cdma_status(struct nvhost_cdma *cdma, enum cdma_event event)
 	}
 }
 
+static void update_cdma(struct nvhost_cdma *cdma);
+
+/**
+ * If the oldest outstanding submit has already completed in hardware
+ * (its completion interrupt just hasn't been serviced yet), retire it
+ * and everything after it that has also completed.
+ * Returns true if anything was retired.
+ * Must be called with the cdma lock held.
+ */
+static bool reclaim_completed(struct nvhost_cdma *cdma)
+{
+	struct nvhost_syncpt *sp = &cdma_to_dev(cdma)->syncpt;
+	u32 *sync = sync_queue_head(&cdma->sync_queue);
+	u32 id, val;
+
+	if (!sync || !cdma->running)
+		return false;
+
+	id = sync[SQ_IDX_SYNCPT_ID];
+	val = sync[SQ_IDX_SYNCPT_VAL];
+	if (!nvhost_syncpt_min_cmp(sp, id, val) &&
+	    (s32)(nvhost_syncpt_update_min(sp, id) - val) < 0)
+		return false;
+
+	update_cdma(cdma);
+	return true;
+}
+
 /**
  * Sleep (if necessary) until the requested event happens
  *   - CDMA_EVENT_SYNC_QUEUE_EMPTY : sync queue is completely empty.
@@ -300,6 +312,16 @@ unsigned int nvhost_cdma_wait(struct nvhost_cdma *cdma, enum cdma_event event)
 		if (space)
 			return space;
 
+		/* don't wait on an interrupt for work that's already done */
+		if (event != CDMA_EVENT_SYNC_QUEUE_EMPTY &&
+		    reclaim_completed(cdma))
+			continue;
+
+		if (event == CDMA_EVENT_PUSH_BUFFER_SPACE)
+			cdma->pb_starved = true;
+		else if (event == CDMA_EVENT_SYNC_QUEUE_SPACE)
+			cdma->sq_starved = true;
+
 		trace_nvhost_wait_cdma(cdma_to_channel(cdma)->desc->name,
 				event);
 
@@ -442,15 +464,12 @@ static void update_cdma(struct nvhost_cdma *cdma)
 
 static u32 *advance_next_entry(struct nvhost_cdma *cdma, u32 *read)
 {
-	struct nvhost_master *host;
 	u32 ridx;
 
-	host = cdma_to_dev(cdma);
-
 	/* move sync_queue read ptr to next entry */
 	ridx = (read - cdma->sync_queue.buffer);
 	ridx += (SQ_IDX_HANDLES + entry_size(read[SQ_IDX_NUM_HANDLES]));
-	if ((ridx + SYNC_QUEUE_MIN_ENTRY) > host->sync_queue_size)
+	if ((ridx + SYNC_QUEUE_MIN_ENTRY) > cdma->sync_queue.size)
 		ridx = 0;
 
 	/* return sync_queue entry */
@@ -616,8 +635,12 @@ int nvhost_cdma_init(struct nvhost_cdma *cdma)
 	cdma->running = false;
 	cdma->torndown = false;
 
+	cdma->pb_starved = false;
+	cdma->sq_starved = false;
+
 	/* allocate sync queue memory */
-	cdma->sync_queue.buffer = kzalloc(cdma_to_dev(cdma)->sync_queue_size
+	cdma->sync_queue.size = cdma_to_dev(cdma)->sync_queue_size;
+	cdma->sync_queue.buffer = kzalloc(cdma->sync_queue.size
 					  * sizeof(u32), GFP_KERNEL);
 	if (!cdma->sync_queue.buffer)
 		return -ENOMEM;
@@ -644,6 +667,57 @@ void nvhost_cdma_deinit(struct nvhost_cdma *cdma)
 	cdma_op(cdma).timeout_destroy(cdma);
 }
 
+/**
+ * Grow the sync queue and/or push buffer if a previous submit had to wait
+ * for space in them. Only done while nothing is in flight, so that no
+ * entries or slots need to be carried over.
+ * Must be called with the cdma lock held.
+ */
+static void grow_cdma(struct nvhost_cdma *cdma)
+{
+	struct nvhost_master *host = cdma_to_dev(cdma);
+	struct sync_queue *queue = &cdma->sync_queue;
+	struct push_buffer *pb = &cdma->push_buffer;
+
+	if (!(cdma->sq_starved || cdma->pb_starved))
+		return;
+	if (sync_queue_head(queue))
+		return;
+
+	if (cdma->sq_starved && queue->size < host->sync_queue_max_size) {
+		u32 size = min(queue->size * 2, host->sync_queue_max_size);
+		u32 *buffer = kzalloc(size * sizeof(u32), GFP_KERNEL);
+
+		if (buffer) {
+			kfree(queue->buffer);
+			queue->buffer = buffer;
+			queue->size = size;
+			reset_sync_queue(queue);
+			dev_dbg(&host->pdev->dev, "%s: %s sync queue %d words\n",
+				__func__, cdma_to_channel(cdma)->desc->name,
+				size);
+		}
+	}
+	cdma->sq_starved = false;
+
+	if (cdma->pb_starved && pb->size < pb->max_size &&
+	    cdma_pb_op(cdma).grow) {
+		/* command DMA fetches from the old buffer, so stop it first;
+		 * it is restarted on the new buffer by nvhost_cdma_begin */
+		if (cdma->running) {
+			BUG_ON(!cdma_op(cdma).stop);
+			mutex_unlock(&cdma->lock);
+			cdma_op(cdma).stop(cdma);
+			mutex_lock(&cdma->lock);
+		}
+		if (!cdma_pb_op(cdma).grow(pb, pb->size * 2))
+			dev_dbg(&host->pdev->dev, "%s: %s push buffer %d bytes\n",
+				__func__, cdma_to_channel(cdma)->desc->name,
+				pb->size);
+	}
+	cdma->pb_starved = false;
+}
+
 /**
  * Begin a cdma submit
  */
@@ -680,6 +754,7 @@ int nvhost_cdma_begin(struct nvhost_cdma *cdma,
 			}
 		}
 	}
+	grow_cdma(cdma);
 	if (!cdma->running) {
 		BUG_ON(!cdma_op(cdma).start);
 		cdma_op(cdma).start(cdma);
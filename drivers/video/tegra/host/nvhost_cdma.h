@@ -59,6 +59,8 @@ struct push_buffer {
 	u32 phys;			/* physical address of pushbuffer */
 	u32 fence;			/* index we've written */
 	u32 cur;			/* index to write to */
+	u32 size;			/* size in bytes, a power of two */
+	u32 max_size;			/* size it may grow to */
 	struct nvmap_client_handle *nvmap;
 					/* nvmap handle for each opcode pair */
 };
@@ -86,6 +88,7 @@ enum sync_queue_idx {
 struct sync_queue {
 	unsigned int read;		    /* read position within buffer */
 	unsigned int write;		    /* write position within buffer */
+	unsigned int size;		    /* size of buffer in words */
 	u32 *buffer;                        /* queue data */
 };
 
@@ -120,6 +123,8 @@ struct nvhost_cdma {
 	struct buffer_timeout timeout;	/* channel's timeout state/wq */
 	bool running;
 	bool torndown;
+	bool pb_starved;		/* submit waited for pb space */
+	bool sq_starved;		/* submit waited for sync queue space */
 };
 
 #define cdma_to_channel(cdma) container_of(cdma, struct nvhost_channel, cdma)
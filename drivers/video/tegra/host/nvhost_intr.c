@@ -21,10 +21,12 @@
  */
 
 #include "nvhost_intr.h"
+#include "nvhost_sync.h"
 #include "dev.h"
 #include <linux/interrupt.h>
 #include <linux/slab.h>
 #include <linux/irq.h>
+#include <linux/delay.h>
 #include <trace/events/nvhost.h>
 
 
@@ -34,6 +36,7 @@
 /*** Wait list management ***/
 
 struct nvhost_waitlist {
+	struct rb_node node;
 	struct list_head list;
 	struct kref refcount;
 	u32 thresh;
@@ -57,38 +60,58 @@ static void waiter_release(struct kref *kref)
 
 /**
  * add a waiter to a waiter queue, sorted by threshold
+ * waiters with equal thresholds are kept in submission order
  * returns true if it was added at the head of the queue
  */
 static bool add_waiter_to_queue(struct nvhost_waitlist *waiter,
-				struct list_head *queue)
+				struct rb_root *queue)
 {
-	struct nvhost_waitlist *pos;
+	struct rb_node **p = &queue->rb_node;
+	struct rb_node *parent = NULL;
 	u32 thresh = waiter->thresh;
+	bool head = true;
 
-	list_for_each_entry_reverse(pos, queue, list)
-		if ((s32)(pos->thresh - thresh) <= 0) {
-			list_add(&waiter->list, &pos->list);
-			return false;
+	while (*p) {
+		struct nvhost_waitlist *pos =
+			rb_entry(*p, struct nvhost_waitlist, node);
+
+		parent = *p;
+		if ((s32)(thresh - pos->thresh) < 0) {
+			p = &parent->rb_left;
+		} else {
+			p = &parent->rb_right;
+			head = false;
 		}
+	}
+
+	rb_link_node(&waiter->node, parent, p);
+	rb_insert_color(&waiter->node, queue);
+	return head;
+}
+
+static inline struct nvhost_waitlist *first_waiter(struct rb_root *queue)
+{
+	struct rb_node *first = rb_first(queue);
 
-	list_add(&waiter->list, queue);
-	return true;
+	return first ? rb_entry(first, struct nvhost_waitlist, node) : NULL;
 }
 
 /**
  * run through a waiter queue for a single sync point ID
  * and gather all completed waiters into lists by actions
  */
-static void remove_completed_waiters(struct list_head *head, u32 sync,
+static void remove_completed_waiters(struct rb_root *queue, u32 sync,
 			struct list_head completed[NVHOST_INTR_ACTION_COUNT])
 {
 	struct list_head *dest;
-	struct nvhost_waitlist *waiter, *next, *prev;
+	struct nvhost_waitlist *waiter, *prev;
 
-	list_for_each_entry_safe(waiter, next, head, list) {
+	while ((waiter = first_waiter(queue)) != NULL) {
 		if ((s32)(waiter->thresh - sync) > 0)
 			break;
 
+		rb_erase(&waiter->node, queue);
+
 		dest = completed + waiter->action;
 
 		/* consolidate submit cleanups */
@@ -103,21 +126,18 @@ static void remove_completed_waiters(struct list_head *head, u32 sync,
 		}
 
 		/* PENDING->REMOVED or CANCELLED->HANDLED */
-		if (atomic_inc_return(&waiter->state) == WLS_HANDLED || !dest) {
-			list_del(&waiter->list);
+		if (atomic_inc_return(&waiter->state) == WLS_HANDLED || !dest)
 			kref_put(&waiter->refcount, waiter_release);
-		} else {
-			list_move_tail(&waiter->list, dest);
-		}
+		else
+			list_add_tail(&waiter->list, dest);
 	}
 }
 
-void reset_threshold_interrupt(struct nvhost_intr *intr,
-			       struct list_head *head,
+static void reset_threshold_interrupt(struct nvhost_intr *intr,
+			       struct rb_root *queue,
 			       unsigned int id)
 {
-	u32 thresh = list_first_entry(head,
-				struct nvhost_waitlist, list)->thresh;
+	u32 thresh = first_waiter(queue)->thresh;
 	BUG_ON(!(intr_op(intr).set_syncpt_threshold &&
 		 intr_op(intr).enable_syncpt_intr));
 
@@ -171,6 +191,11 @@ static void action_wakeup_interruptible(struct nvhost_waitlist *waiter)
 	wake_up_interruptible(wq);
 }
 
+static void action_signal_sync_pt(struct nvhost_waitlist *waiter)
+{
+	nvhost_sync_pt_signal(waiter->data);
+}
+
 typedef void (*action_handler)(struct nvhost_waitlist *waiter);
 
 static action_handler action_handlers[NVHOST_INTR_ACTION_COUNT] = {
@@ -179,6 +204,7 @@ static action_handler action_handlers[NVHOST_INTR_ACTION_COUNT] = {
 	action_ctxrestore,
 	action_wakeup,
 	action_wakeup_interruptible,
+	action_signal_sync_pt,
 };
 
 static void run_handlers(struct list_head completed[NVHOST_INTR_ACTION_COUNT])
@@ -215,11 +241,11 @@ static int process_wait_list(struct nvhost_intr *intr,
 
 	spin_lock(&syncpt->lock);
 
-	remove_completed_waiters(&syncpt->wait_head, threshold, completed);
+	remove_completed_waiters(&syncpt->wait_tree, threshold, completed);
 
-	empty = list_empty(&syncpt->wait_head);
+	empty = RB_EMPTY_ROOT(&syncpt->wait_tree);
 	if (!empty)
-		reset_threshold_interrupt(intr, &syncpt->wait_head,
+		reset_threshold_interrupt(intr, &syncpt->wait_tree,
 					  syncpt->id);
 
 	spin_unlock(&syncpt->lock);
@@ -229,6 +255,27 @@ static int process_wait_list(struct nvhost_intr *intr,
 	return empty;
 }
 
+/**
+ * If the previous threshold interrupt on this sync point was serviced
+ * less than coalesce_us ago, hold off for the rest of that window. The
+ * hard irq handler has already masked the threshold interrupt, so any
+ * increments arriving meanwhile are folded into this one wakeup.
+ */
+static void coalesce_syncpt_intr(struct nvhost_intr *intr,
+				 struct nvhost_intr_syncpt *syncpt)
+{
+	u32 window = intr->coalesce_us;
+	s64 elapsed;
+
+	if (window) {
+		elapsed = ktime_us_delta(ktime_get(), syncpt->last_irq);
+		if (elapsed >= 0 && elapsed < window)
+			usleep_range(window - (u32)elapsed, window);
+	}
+
+	syncpt->last_irq = ktime_get();
+}
+
 /*** host syncpt interrupt service functions ***/
 /**
  * Sync point threshold interrupt service thread function
@@ -241,6 +288,8 @@ irqreturn_t nvhost_syncpt_thresh_fn(int irq, void *dev_id)
 	struct nvhost_intr *intr = intr_syncpt_to_intr(syncpt);
 	struct nvhost_master *dev = intr_to_dev(intr);
 
+	coalesce_syncpt_intr(intr, syncpt);
+
 	(void)process_wait_list(intr, syncpt,
 				nvhost_syncpt_update_min(&dev->syncpt, id));
 
@@ -312,9 +361,9 @@ int nvhost_intr_add_action(struct nvhost_intr *intr, u32 id, u32 thresh,
 		spin_lock(&syncpt->lock);
 	}
 
-	queue_was_empty = list_empty(&syncpt->wait_head);
+	queue_was_empty = RB_EMPTY_ROOT(&syncpt->wait_tree);
 
-	if (add_waiter_to_queue(waiter, &syncpt->wait_head)) {
+	if (add_waiter_to_queue(waiter, &syncpt->wait_tree)) {
 		/* added at head of list - new threshold value */
 		intr_op(intr).set_syncpt_threshold(intr, id, thresh);
 
@@ -361,6 +410,7 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 	mutex_init(&intr->mutex);
 	intr->host_general_irq = irq_gen;
 	intr->host_general_irq_requested = false;
+	intr->coalesce_us = 0;
 
 	for (id = 0, syncpt = intr->syncpt;
 	     id < nb_pts;
@@ -370,7 +420,8 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 		syncpt->irq = irq_sync + id;
 		syncpt->irq_requested = 0;
 		spin_lock_init(&syncpt->lock);
-		INIT_LIST_HEAD(&syncpt->wait_head);
+		syncpt->wait_tree = RB_ROOT;
+		syncpt->last_irq = ktime_set(0, 0);
 		snprintf(syncpt->thresh_irq_name,
 			sizeof(syncpt->thresh_irq_name),
 			"host_sp_%02d", id);
@@ -417,16 +468,19 @@ void nvhost_intr_stop(struct nvhost_intr *intr)
 	for (id = 0, syncpt = intr->syncpt;
 	     id < nb_pts;
 	     ++id, ++syncpt) {
-		struct nvhost_waitlist *waiter, *next;
-		list_for_each_entry_safe(waiter, next, &syncpt->wait_head, list) {
+		struct rb_node *node, *next;
+		for (node = rb_first(&syncpt->wait_tree); node; node = next) {
+			struct nvhost_waitlist *waiter =
+				rb_entry(node, struct nvhost_waitlist, node);
+			next = rb_next(node);
 			if (atomic_cmpxchg(&waiter->state, WLS_CANCELLED, WLS_HANDLED)
 				== WLS_CANCELLED) {
-				list_del(&waiter->list);
+				rb_erase(node, &syncpt->wait_tree);
 				kref_put(&waiter->refcount, waiter_release);
 			}
 		}
 
-		if (!list_empty(&syncpt->wait_head)) {  /* output diagnostics */
+		if (!RB_EMPTY_ROOT(&syncpt->wait_tree)) {  /* output diagnostics */
 			printk(KERN_DEBUG "%s id=%d\n", __func__, id);
 			BUG_ON(1);
 		}
@@ -26,6 +26,8 @@
 #include <linux/kthread.h>
 #include <linux/semaphore.h>
 #include <linux/interrupt.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
 
 struct nvhost_channel;
 
@@ -60,6 +62,12 @@ enum nvhost_intr_action {
 	 */
 	NVHOST_INTR_ACTION_WAKEUP_INTERRUPTIBLE,
 
+	/**
+	 * Signal a sync fence point.
+	 * 'data' points to a sync fence point
+	 */
+	NVHOST_INTR_ACTION_SIGNAL_SYNC_PT,
+
 	NVHOST_INTR_ACTION_COUNT
 };
 
@@ -71,7 +79,8 @@ struct nvhost_intr_syncpt {
 	u8 irq_requested;
 	u16 irq;
 	spinlock_t lock;
-	struct list_head wait_head;
+	struct rb_root wait_tree;
+	ktime_t last_irq;
 	char thresh_irq_name[12];
 };
 
@@ -80,6 +89,7 @@ struct nvhost_intr {
 	struct mutex mutex;
 	int host_general_irq;
 	bool host_general_irq_requested;
+	u32 coalesce_us;
 };
 #define intr_to_dev(x) container_of(x, struct nvhost_master, intr)
 #define intr_op(intr) (intr_to_dev(intr)->op.intr)
@@ -0,0 +1,337 @@
+/*
+ * drivers/video/tegra/host/nvhost_sync.c
+ *
+ * Tegra Graphics Host Syncpoint Fences
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/nvhost_ioctl.h>
+
+#include "nvhost_sync.h"
+#include "dev.h"
+
+/*** Fence objects ***/
+
+struct nvhost_sync_fence;
+
+struct nvhost_sync_pt {
+	struct nvhost_sync_fence *fence;
+	u32 id;
+	u32 thresh;
+	void *ref;
+	atomic_t signalled;
+};
+
+struct nvhost_sync_fence {
+	struct nvhost_master *host;
+	wait_queue_head_t wq;
+	atomic_t pending;
+	u32 num_pts;
+	struct nvhost_sync_pt pts[0];
+};
+
+static const struct file_operations nvhost_sync_fence_fops;
+
+static struct nvhost_sync_fence *fence_alloc(struct nvhost_master *host,
+				struct nvhost_ctrl_sync_fence_info *info,
+				u32 num_pts)
+{
+	struct nvhost_sync_fence *fence;
+	u32 i;
+
+	fence = kzalloc(sizeof(*fence) +
+			num_pts * sizeof(struct nvhost_sync_pt), GFP_KERNEL);
+	if (!fence)
+		return NULL;
+
+	fence->host = host;
+	init_waitqueue_head(&fence->wq);
+	atomic_set(&fence->pending, 0);
+	fence->num_pts = num_pts;
+
+	for (i = 0; i < num_pts; i++) {
+		struct nvhost_sync_pt *pt = &fence->pts[i];
+		pt->fence = fence;
+		pt->id = info[i].id;
+		pt->thresh = info[i].thresh;
+		atomic_set(&pt->signalled, 1);
+	}
+
+	return fence;
+}
+
+/**
+ * Cancel all outstanding waiters of a fence, dropping the host
+ * references held on behalf of points that never signalled.
+ */
+static void fence_disarm(struct nvhost_sync_fence *fence)
+{
+	struct nvhost_master *host = fence->host;
+	u32 i;
+
+	for (i = 0; i < fence->num_pts; i++) {
+		struct nvhost_sync_pt *pt = &fence->pts[i];
+
+		if (!pt->ref)
+			continue;
+
+		/* once the ref is dropped the handler can no longer run */
+		nvhost_intr_put_ref(&host->intr, pt->ref);
+		pt->ref = NULL;
+
+		if (!atomic_xchg(&pt->signalled, 1))
+			nvhost_module_idle(&host->mod);
+	}
+}
+
+/**
+ * Schedule a signal for every point that has not been reached yet.
+ * Host is kept powered while any point is outstanding, so that the
+ * threshold interrupts stay armed.
+ */
+static int fence_arm(struct nvhost_sync_fence *fence)
+{
+	struct nvhost_master *host = fence->host;
+	struct nvhost_syncpt *sp = &host->syncpt;
+	u32 i;
+	int err;
+
+	for (i = 0; i < fence->num_pts; i++) {
+		struct nvhost_sync_pt *pt = &fence->pts[i];
+		void *waiter;
+
+		/* first check cache */
+		if (nvhost_syncpt_min_cmp(sp, pt->id, pt->thresh))
+			continue;
+
+		nvhost_module_busy(&host->mod);
+
+		/* then the register */
+		if ((s32)(nvhost_syncpt_update_min(sp, pt->id)
+				- pt->thresh) >= 0) {
+			nvhost_module_idle(&host->mod);
+			continue;
+		}
+
+		waiter = nvhost_intr_alloc_waiter();
+		if (!waiter) {
+			nvhost_module_idle(&host->mod);
+			err = -ENOMEM;
+			goto fail;
+		}
+
+		atomic_set(&pt->signalled, 0);
+		atomic_inc(&fence->pending);
+
+		err = nvhost_intr_add_action(&host->intr, pt->id, pt->thresh,
+					NVHOST_INTR_ACTION_SIGNAL_SYNC_PT, pt,
+					waiter,
+					&pt->ref);
+		if (err) {
+			pt->ref = NULL;
+			atomic_set(&pt->signalled, 1);
+			atomic_dec(&fence->pending);
+			nvhost_module_idle(&host->mod);
+			goto fail;
+		}
+	}
+
+	return 0;
+
+fail:
+	fence_disarm(fence);
+	return err;
+}
+
+static int fence_install(struct nvhost_sync_fence *fence)
+{
+	int err;
+	int fd;
+
+	err = fence_arm(fence);
+	if (err) {
+		kfree(fence);
+		return err;
+	}
+
+	fd = anon_inode_getfd("nvhost_fence", &nvhost_sync_fence_fops,
+			fence, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fence_disarm(fence);
+		kfree(fence);
+	}
+
+	return fd;
+}
+
+void nvhost_sync_pt_signal(void *data)
+{
+	struct nvhost_sync_pt *pt = data;
+	struct nvhost_sync_fence *fence = pt->fence;
+
+	if (atomic_xchg(&pt->signalled, 1))
+		return;
+
+	nvhost_module_idle(&fence->host->mod);
+
+	if (atomic_dec_and_test(&fence->pending))
+		wake_up_interruptible_all(&fence->wq);
+}
+
+/*** File operations ***/
+
+static int nvhost_sync_fence_release(struct inode *inode, struct file *filp)
+{
+	struct nvhost_sync_fence *fence = filp->private_data;
+
+	filp->private_data = NULL;
+	fence_disarm(fence);
+	kfree(fence);
+	return 0;
+}
+
+static unsigned int nvhost_sync_fence_poll(struct file *filp,
+					poll_table *wait)
+{
+	struct nvhost_sync_fence *fence = filp->private_data;
+
+	poll_wait(filp, &fence->wq, wait);
+
+	return atomic_read(&fence->pending) ? 0 : POLLIN | POLLRDNORM;
+}
+
+static const struct file_operations nvhost_sync_fence_fops = {
+	.owner = THIS_MODULE,
+	.release = nvhost_sync_fence_release,
+	.poll = nvhost_sync_fence_poll,
+};
+
+static struct nvhost_sync_fence *fence_fget(int fd, struct file **filp)
+{
+	struct file *file = fget(fd);
+
+	if (!file)
+		return NULL;
+
+	if (file->f_op != &nvhost_sync_fence_fops) {
+		fput(file);
+		return NULL;
+	}
+
+	*filp = file;
+	return file->private_data;
+}
+
+/*** Main API ***/
+
+int nvhost_sync_fence_create(struct nvhost_master *host,
+			struct nvhost_ctrl_sync_fence_info *pts,
+			u32 num_pts)
+{
+	struct nvhost_syncpt *sp = &host->syncpt;
+	struct nvhost_sync_fence *fence;
+	u32 i;
+
+	if (!num_pts || num_pts > NVHOST_SYNC_MAX_PTS)
+		return -EINVAL;
+
+	for (i = 0; i < num_pts; i++) {
+		if (pts[i].id >= sp->nb_pts)
+			return -EINVAL;
+		if (!nvhost_syncpt_check_max(sp, pts[i].id, pts[i].thresh)) {
+			dev_dbg(&host->pdev->dev,
+				"fence on %d (%s) for (%d) wouldn't be met (max %d)\n",
+				pts[i].id, syncpt_op(sp).name(sp, pts[i].id),
+				pts[i].thresh,
+				nvhost_syncpt_read_max(sp, pts[i].id));
+			return -EINVAL;
+		}
+	}
+
+	fence = fence_alloc(host, pts, num_pts);
+	if (!fence)
+		return -ENOMEM;
+
+	return fence_install(fence);
+}
+
+int nvhost_sync_fence_merge(struct nvhost_master *host, int fd1, int fd2)
+{
+	struct nvhost_ctrl_sync_fence_info pts[NVHOST_SYNC_MAX_PTS];
+	struct nvhost_sync_fence *a, *b, *fence;
+	struct file *fa, *fb;
+	u32 num_pts, i, j;
+	int err;
+
+	a = fence_fget(fd1, &fa);
+	if (!a)
+		return -EINVAL;
+	b = fence_fget(fd2, &fb);
+	if (!b) {
+		fput(fa);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < a->num_pts; i++) {
+		pts[i].id = a->pts[i].id;
+		pts[i].thresh = a->pts[i].thresh;
+	}
+	num_pts = a->num_pts;
+
+	for (i = 0; i < b->num_pts; i++) {
+		struct nvhost_sync_pt *pt = &b->pts[i];
+
+		/* one point per sync point: keep the later threshold */
+		for (j = 0; j < num_pts; j++) {
+			if (pts[j].id != pt->id)
+				continue;
+			if ((s32)(pt->thresh - pts[j].thresh) > 0)
+				pts[j].thresh = pt->thresh;
+			break;
+		}
+		if (j < num_pts)
+			continue;
+
+		if (num_pts == NVHOST_SYNC_MAX_PTS) {
+			err = -E2BIG;
+			goto out;
+		}
+		pts[num_pts].id = pt->id;
+		pts[num_pts].thresh = pt->thresh;
+		num_pts++;
+	}
+
+	fence = fence_alloc(host, pts, num_pts);
+	if (!fence) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	err = fence_install(fence);
+
+out:
+	fput(fb);
+	fput(fa);
+	return err;
+}
@@ -0,0 +1,55 @@
+/*
+ * drivers/video/tegra/host/nvhost_sync.h
+ *
+ * Tegra Graphics Host Syncpoint Fences
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __NVHOST_SYNC_H
+#define __NVHOST_SYNC_H
+
+#include <linux/types.h>
+
+struct nvhost_master;
+struct nvhost_ctrl_sync_fence_info;
+
+/* upper bound on the number of points a single (merged) fence may hold */
+#define NVHOST_SYNC_MAX_PTS 32
+
+/**
+ * Create a fence file descriptor from an array of (id, thresh) pairs.
+ * The fd becomes readable (POLLIN) once every point has been reached.
+ * Returns the new fd or a negative error code.
+ */
+int nvhost_sync_fence_create(struct nvhost_master *host,
+			struct nvhost_ctrl_sync_fence_info *pts,
+			u32 num_pts);
+
+/**
+ * Create a fence that signals when both fd1 and fd2 have signalled.
+ * Points on the same sync point are collapsed to the later threshold.
+ */
+int nvhost_sync_fence_merge(struct nvhost_master *host, int fd1, int fd2);
+
+/**
+ * Called from the interrupt thread when a fence point's threshold
+ * has been reached. 'data' is the point passed to nvhost_intr_add_action().
+ */
+void nvhost_sync_pt_signal(void *data);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * drivers/video/tegra/host/sim/bench_sim.c
+ *
+ * Tegra Graphics Host Software Model Submit Benchmark
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "../dev.h"
+
+#include "sim.h"
+
+/*
+ * Runs null kickoff submits through the full channel submit path and
+ * reports submit-to-complete latency and sustained jobs/sec.
+ *
+ *   echo "<chid> <jobs> <incrs>" > /d/tegra_host/sim_bench
+ *   cat /d/tegra_host/sim_bench
+ *
+ * Latency is measured with one job in flight at a time; throughput with
+ * all jobs queued back to back and only the last one waited for.
+ */
+
+#define SIM_BENCH_DEFAULT_CHID 2	/* gr2d */
+#define SIM_BENCH_DEFAULT_JOBS 1000
+#define SIM_BENCH_MAX_INCRS 64
+#define SIM_BENCH_WAIT_MS 1000
+
+struct sim_bench_result {
+	int err;
+	u32 chid;
+	u32 jobs;
+	u32 incrs;
+	s64 lat_min_ns;
+	s64 lat_max_ns;
+	s64 lat_total_ns;
+	s64 burst_ns;
+};
+
+static struct nvhost_master *bench_host;
+static DEFINE_MUTEX(bench_lock);
+static struct sim_bench_result bench_result = { .err = -ENODATA };
+
+static int sim_bench_submit(struct nvhost_channel *ch, u32 syncpt_id,
+			    u32 incrs, u32 *syncval)
+{
+	struct nvhost_userctx_timeout timeout = {
+		.timeout = 0,
+		.syncpt_id = syncpt_id,
+	};
+
+	return channel_op(ch).submit(ch, NULL, ch->dev->nvmap,
+			NULL, NULL, NULL, NULL, 0,
+			NULL, 0,
+			syncpt_id, incrs,
+			&timeout, syncval, true);
+}
+
+static int sim_bench_wait(struct nvhost_channel *ch, u32 syncpt_id,
+			  u32 syncval)
+{
+	return nvhost_syncpt_wait_timeout(&ch->dev->syncpt, syncpt_id,
+			syncval, msecs_to_jiffies(SIM_BENCH_WAIT_MS), NULL);
+}
+
+static int sim_bench_run(struct nvhost_master *host,
+			 struct sim_bench_result *r)
+{
+	struct nvhost_syncpt *sp = &host->syncpt;
+	struct nvhost_channel *ch;
+	unsigned long syncpts;
+	u32 syncpt_id, syncval = 0;
+	ktime_t start;
+	s64 ns;
+	u32 i;
+	int err = 0;
+
+	if (r->chid >= host->nb_channels || !r->jobs ||
+	    !r->incrs || r->incrs > SIM_BENCH_MAX_INCRS)
+		return -EINVAL;
+
+	/* first host managed sync point of the channel */
+	syncpts = host->channels[r->chid].desc->syncpts & ~sp->client_managed;
+	if (!syncpts)
+		return -EINVAL;
+	syncpt_id = __ffs(syncpts);
+
+	ch = nvhost_getchannel(&host->channels[r->chid]);
+	if (!ch)
+		return -EBUSY;
+
+	r->lat_min_ns = LLONG_MAX;
+	r->lat_max_ns = 0;
+	r->lat_total_ns = 0;
+
+	for (i = 0; i < r->jobs; i++) {
+		start = ktime_get();
+		err = sim_bench_submit(ch, syncpt_id, r->incrs, &syncval);
+		if (!err)
+			err = sim_bench_wait(ch, syncpt_id, syncval);
+		if (err)
+			goto out;
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		r->lat_min_ns = min(r->lat_min_ns, ns);
+		r->lat_max_ns = max(r->lat_max_ns, ns);
+		r->lat_total_ns += ns;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < r->jobs; i++) {
+		err = sim_bench_submit(ch, syncpt_id, r->incrs, &syncval);
+		if (err)
+			goto out;
+	}
+	err = sim_bench_wait(ch, syncpt_id, syncval);
+	r->burst_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+out:
+	nvhost_putchannel(ch, NULL);
+	return err;
+}
+
+static int sim_bench_show(struct seq_file *s, void *unused)
+{
+	struct sim_bench_result *r = &bench_result;
+	u64 avg, rate;
+
+	mutex_lock(&bench_lock);
+
+	if (r->err) {
+		seq_printf(s, "error %d\n", r->err);
+		goto out;
+	}
+
+	avg = div_u64(r->lat_total_ns, r->jobs);
+	rate = r->burst_ns ?
+		div64_u64((u64)r->jobs * NSEC_PER_SEC, r->burst_ns) : 0;
+
+	seq_printf(s, "channel %u (%s), %u jobs of %u incrs\n",
+		r->chid, bench_host->channels[r->chid].desc->name,
+		r->jobs, r->incrs);
+	seq_printf(s, "latency us: min %lld avg %llu max %lld\n",
+		div_s64(r->lat_min_ns, NSEC_PER_USEC),
+		div_u64(avg, NSEC_PER_USEC),
+		div_s64(r->lat_max_ns, NSEC_PER_USEC));
+	seq_printf(s, "throughput: %llu jobs/sec\n", rate);
+
+out:
+	mutex_unlock(&bench_lock);
+	return 0;
+}
+
+static int sim_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sim_bench_show, inode->i_private);
+}
+
+static ssize_t sim_bench_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct sim_bench_result r = {
+		.chid = SIM_BENCH_DEFAULT_CHID,
+		.jobs = SIM_BENCH_DEFAULT_JOBS,
+		.incrs = 1,
+	};
+	char kbuf[32];
+	size_t len = min(count, sizeof(kbuf) - 1);
+
+	if (copy_from_user(kbuf, buf, len))
+		return -EFAULT;
+	kbuf[len] = 0;
+
+	if (sscanf(kbuf, "%u %u %u", &r.chid, &r.jobs, &r.incrs) < 1)
+		return -EINVAL;
+
+	mutex_lock(&bench_lock);
+	r.err = sim_bench_run(bench_host, &r);
+	bench_result = r;
+	mutex_unlock(&bench_lock);
+
+	return r.err ? r.err : count;
+}
+
+static const struct file_operations sim_bench_fops = {
+	.open		= sim_bench_open,
+	.read		= seq_read,
+	.write		= sim_bench_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void nvhost_sim_bench_init(struct nvhost_master *host, struct dentry *de)
+{
+	bench_host = host;
+	debugfs_create_file("sim_bench", S_IRUGO|S_IWUSR, de,
+			    host, &sim_bench_fops);
+}
@@ -0,0 +1,455 @@
+/*
+ * drivers/video/tegra/host/sim/cdma_sim.c
+ *
+ * Tegra Graphics Host Software Model Command DMA
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/kthread.h>
+#include <linux/bitops.h>
+
+#include "../dev.h"
+#include "../nvhost_cdma.h"
+#include "../t20/t20.h"
+#include "../../nvmap/nvmap.h"
+
+#include "sim.h"
+
+/*
+ * The fetcher walks the push buffer from DMAGET to DMAPUT in a kernel
+ * thread, the same way the host1x command processor does, and executes
+ * the host class methods that matter to software: sync point increments,
+ * sync point waits and wait base increments. Methods of the engine
+ * classes complete immediately.
+ */
+
+enum {
+	SIM_OP_INCR,
+	SIM_OP_NONINCR,
+	SIM_OP_MASK
+};
+
+#define cdma_to_sim(cdma) \
+	(&nvhost_sim->channels[cdma_to_channel(cdma)->chid])
+
+/*** sync point waits and module locks ***/
+
+/* host waits compare the low 24 bits of the sync point */
+static bool sim_wait_done(struct nvhost_sim *sim, u32 id, u32 thresh)
+{
+	u32 val = nvhost_sim_syncpt_read(sim, id);
+	return ((val - thresh) & 0xffffff) < 0x800000;
+}
+
+static void sim_wait_syncpt(struct nvhost_sim_channel *sch, u32 id, u32 thresh)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+
+	if (id >= NV_HOST1X_SYNCPT_NB_PTS)
+		return;
+
+	sch->nr_waits++;
+	sch->wait_id = id;
+	sch->wait_thresh = thresh;
+	sch->waiting = true;
+	wait_event(sim->syncpt_wq,
+		sim_wait_done(sim, id, thresh) || kthread_should_stop());
+	sch->waiting = false;
+}
+
+static void sim_acquire_mlock(struct nvhost_sim_channel *sch, u32 idx)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+
+	if (idx >= NV_HOST1X_SYNC_MLOCK_NUM)
+		return;
+
+	wait_event(sim->syncpt_wq,
+		!test_and_set_bit(idx, &sim->mlocks) || kthread_should_stop());
+}
+
+static void sim_release_mlock(struct nvhost_sim_channel *sch, u32 idx)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+
+	if (idx >= NV_HOST1X_SYNC_MLOCK_NUM)
+		return;
+
+	clear_bit(idx, &sim->mlocks);
+	smp_mb__after_clear_bit();
+	wake_up_all(&sim->syncpt_wq);
+}
+
+/*** opcode interpreter ***/
+
+static void sim_method(struct nvhost_sim_channel *sch, u32 offset, u32 data)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+	unsigned long flags;
+	u32 id, base;
+
+	/* every class has INCR_SYNCPT at method 0 */
+	if (offset == NV_CLASS_HOST_INCR_SYNCPT) {
+		id = data & 0xff;
+		if (id < NV_HOST1X_SYNCPT_NB_PTS)
+			nvhost_sim_syncpt_incr(sim, id);
+		return;
+	}
+
+	if (sch->class != NV_HOST1X_CLASS_ID)
+		return;
+
+	switch (offset) {
+	case NV_CLASS_HOST_WAIT_SYNCPT:
+		sim_wait_syncpt(sch, data >> 24, data & 0xffffff);
+		break;
+
+	case NV_CLASS_HOST_WAIT_SYNCPT_BASE:
+		base = (data >> 16) & 0xff;
+		if (base >= NV_HOST1X_SYNCPT_NB_BASES)
+			break;
+		sim_wait_syncpt(sch, data >> 24,
+				sim->base[base] + (data & 0xffff));
+		break;
+
+	case NV_CLASS_HOST_INCR_SYNCPT_BASE:
+		base = data >> 24;
+		if (base >= NV_HOST1X_SYNCPT_NB_BASES)
+			break;
+		spin_lock_irqsave(&sim->lock, flags);
+		sim->base[base] += data & 0xffffff;
+		spin_unlock_irqrestore(&sim->lock, flags);
+		break;
+	}
+}
+
+static void sim_data(struct nvhost_sim_channel *sch, u32 word)
+{
+	u32 bit;
+
+	switch (sch->opcode) {
+	case SIM_OP_INCR:
+		sim_method(sch, sch->offset++, word);
+		break;
+	case SIM_OP_NONINCR:
+		sim_method(sch, sch->offset, word);
+		break;
+	case SIM_OP_MASK:
+		bit = __ffs(sch->mask);
+		sch->mask &= ~BIT(bit);
+		sim_method(sch, sch->offset + bit, word);
+		break;
+	}
+	sch->count--;
+}
+
+/* Execute one command stream word. RESTART and GATHER are handled by
+ * the push buffer fetcher and ignored here. */
+static void sim_exec(struct nvhost_sim_channel *sch, u32 word)
+{
+	if (sch->count) {
+		sim_data(sch, word);
+		return;
+	}
+
+	sch->nr_ops++;
+
+	switch (word >> 28) {
+	case 0x0:
+		sch->class = word >> 6 & 0x3ff;
+		sch->offset = word >> 16 & 0xfff;
+		sch->mask = word & 0x3f;
+		sch->count = hweight8(sch->mask);
+		sch->opcode = SIM_OP_MASK;
+		break;
+
+	case 0x1:
+		sch->offset = word >> 16 & 0xfff;
+		sch->count = word & 0xffff;
+		sch->opcode = SIM_OP_INCR;
+		break;
+
+	case 0x2:
+		sch->offset = word >> 16 & 0xfff;
+		sch->count = word & 0xffff;
+		sch->opcode = SIM_OP_NONINCR;
+		break;
+
+	case 0x3:
+		sch->offset = word >> 16 & 0xfff;
+		sch->mask = word & 0xffff;
+		sch->count = hweight16(sch->mask);
+		sch->opcode = SIM_OP_MASK;
+		break;
+
+	case 0x4:
+		sim_method(sch, word >> 16 & 0xfff, word & 0xffff);
+		break;
+
+	case 0xe:
+		if ((word >> 24 & 0xf) == 0)
+			sim_acquire_mlock(sch, word & 0xff);
+		else if ((word >> 24 & 0xf) == 1)
+			sim_release_mlock(sch, word & 0xff);
+		break;
+	}
+}
+
+/**
+ * Execute a gather. The buffer is found through the nvmap handle stashed
+ * for the push buffer slot, as the debug dump does it.
+ */
+static void sim_gather(struct nvhost_sim_channel *sch, struct push_buffer *pb,
+		       u32 slot_addr, u32 phys_addr)
+{
+	struct nvmap_client_handle *nvmap = &pb->nvmap[(slot_addr - pb->phys)/8];
+	struct nvmap_handle_ref ref = {.handle = nvmap->handle};
+	u32 op = sch->gather_op;
+	u32 words = op & 0x3fff;
+	u32 *map_addr, *p, pin_addr, i;
+
+	sch->gather_op = 0;
+	sch->nr_gathers++;
+
+	if (WARN_ONCE(!nvmap->handle,
+			"nvhost_sim: gather at 0x%08x has no handle\n",
+			phys_addr))
+		return;
+
+	map_addr = nvmap_mmap(&ref);
+	if (!map_addr)
+		return;
+
+	/* pinned for as long as the gather runs, as the hardware has it */
+	pin_addr = nvmap_pin(nvmap->client, &ref);
+	p = map_addr + (phys_addr - pin_addr) / 4;
+
+	if (op & BIT(15)) {
+		/* words are data for a single method */
+		u32 offset = op >> 16 & 0xfff;
+		for (i = 0; i < words; i++) {
+			sim_method(sch, offset, p[i]);
+			if (op & BIT(14))
+				offset++;
+		}
+	} else {
+		for (i = 0; i < words; i++)
+			sim_exec(sch, p[i]);
+	}
+
+	nvmap_unpin(nvmap->client, &ref);
+	nvmap_munmap(&ref, map_addr);
+}
+
+/* Fetch and execute the push buffer word at DMAGET */
+static void sim_fetch(struct nvhost_sim_channel *sch)
+{
+	struct push_buffer *pb = &sch->cdma->push_buffer;
+	u32 addr = sch->get;
+	u32 word = pb->mapped[(addr - pb->phys) >> 2];
+
+	sch->get = addr + 4;
+
+	if (sch->gather_op) {
+		sim_gather(sch, pb, addr, word);
+		return;
+	}
+
+	if (!sch->count) {
+		switch (word >> 28) {
+		case 0x5:
+			sch->nr_ops++;
+			sch->get = (word & 0x0fffffff) << 4;
+			return;
+		case 0x6:
+			sch->nr_ops++;
+			sch->gather_op = word;
+			return;
+		}
+	}
+
+	sim_exec(sch, word);
+}
+
+static bool sim_channel_pending(struct nvhost_sim_channel *sch)
+{
+	return sch->running && sch->get != ACCESS_ONCE(sch->put);
+}
+
+static int sim_fetcher(void *data)
+{
+	struct nvhost_sim_channel *sch = data;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(sch->wq,
+			sim_channel_pending(sch) || kthread_should_stop());
+
+		mutex_lock(&sch->lock);
+		while (sim_channel_pending(sch) && !kthread_should_stop()) {
+			/* pairs with the wmb in sim_cdma_kick */
+			smp_rmb();
+			sim_fetch(sch);
+		}
+		mutex_unlock(&sch->lock);
+	}
+
+	return 0;
+}
+
+int nvhost_sim_channel_init(struct nvhost_sim_channel *sch,
+			    struct nvhost_channel *ch)
+{
+	sch->cdma = &ch->cdma;
+	mutex_init(&sch->lock);
+	init_waitqueue_head(&sch->wq);
+
+	sch->thread = kthread_run(sim_fetcher, sch, "nvhost_sim/%d", ch->chid);
+	if (IS_ERR(sch->thread)) {
+		int err = PTR_ERR(sch->thread);
+		sch->thread = NULL;
+		return err;
+	}
+
+	return 0;
+}
+
+/*** cdma ops ***/
+
+static void sim_cdma_start(struct nvhost_cdma *cdma)
+{
+	struct nvhost_sim_channel *sch = cdma_to_sim(cdma);
+
+	if (cdma->running)
+		return;
+
+	BUG_ON(!cdma_pb_op(cdma).putptr);
+	cdma->last_put = cdma_pb_op(cdma).putptr(&cdma->push_buffer);
+
+	/* reset GET to PUT and clear the parser */
+	mutex_lock(&sch->lock);
+	sch->get = cdma->last_put;
+	sch->put = cdma->last_put;
+	sch->class = 0;
+	sch->count = 0;
+	sch->gather_op = 0;
+	sch->running = true;
+	mutex_unlock(&sch->lock);
+
+	cdma->running = true;
+}
+
+static void sim_cdma_kick(struct nvhost_cdma *cdma)
+{
+	struct nvhost_sim_channel *sch = cdma_to_sim(cdma);
+	u32 put;
+
+	BUG_ON(!cdma_pb_op(cdma).putptr);
+
+	put = cdma_pb_op(cdma).putptr(&cdma->push_buffer);
+
+	if (put != cdma->last_put) {
+		wmb();
+		sch->put = put;
+		cdma->last_put = put;
+		wake_up(&sch->wq);
+	}
+}
+
+static void sim_cdma_stop(struct nvhost_cdma *cdma)
+{
+	struct nvhost_sim_channel *sch = cdma_to_sim(cdma);
+
+	mutex_lock(&cdma->lock);
+	if (cdma->running) {
+		nvhost_cdma_wait(cdma, CDMA_EVENT_SYNC_QUEUE_EMPTY);
+		mutex_lock(&sch->lock);
+		sch->running = false;
+		mutex_unlock(&sch->lock);
+		cdma->running = false;
+	}
+	mutex_unlock(&cdma->lock);
+}
+
+/*
+ * Submit timeouts are detected, but there is no teardown: the fetcher
+ * stays blocked wherever the stream stopped making progress.
+ */
+static void sim_cdma_timeout_handler(struct work_struct *work)
+{
+	struct nvhost_cdma *cdma;
+	struct nvhost_master *dev;
+	struct nvhost_syncpt *sp;
+
+	cdma = container_of(to_delayed_work(work), struct nvhost_cdma,
+			    timeout.wq);
+	dev = cdma_to_dev(cdma);
+	sp = &dev->syncpt;
+
+	mutex_lock(&cdma->lock);
+	if (cdma->timeout.ctx_timeout)
+		dev_warn(&dev->pdev->dev,
+			"%s: timeout: %d (%s) thresh %d, done %d\n",
+			__func__,
+			cdma->timeout.syncpt_id,
+			syncpt_op(sp).name(sp, cdma->timeout.syncpt_id),
+			cdma->timeout.syncpt_val,
+			nvhost_syncpt_update_min(sp, cdma->timeout.syncpt_id));
+	mutex_unlock(&cdma->lock);
+}
+
+static int sim_cdma_timeout_init(struct nvhost_cdma *cdma, u32 syncpt_id)
+{
+	if (syncpt_id == NVSYNCPT_INVALID)
+		return -EINVAL;
+
+	INIT_DELAYED_WORK(&cdma->timeout.wq, sim_cdma_timeout_handler);
+	cdma->timeout.initialized = true;
+
+	return 0;
+}
+
+static void sim_cdma_timeout_destroy(struct nvhost_cdma *cdma)
+{
+	if (cdma->timeout.initialized)
+		cancel_delayed_work(&cdma->timeout.wq);
+	cdma->timeout.initialized = false;
+}
+
+int nvhost_init_sim_cdma_support(struct nvhost_master *host)
+{
+	int err;
+
+	/* push buffer and sync queue management is memory only */
+	err = nvhost_init_t20_cdma_support(host);
+	if (err)
+		return err;
+
+	host->op.cdma.start = sim_cdma_start;
+	host->op.cdma.stop = sim_cdma_stop;
+	host->op.cdma.kick = sim_cdma_kick;
+
+	host->op.cdma.timeout_init = sim_cdma_timeout_init;
+	host->op.cdma.timeout_destroy = sim_cdma_timeout_destroy;
+	host->op.cdma.timeout_teardown_begin = NULL;
+	host->op.cdma.timeout_teardown_end = NULL;
+	host->op.cdma.timeout_cpu_incr = NULL;
+	host->op.cdma.timeout_pb_incr = NULL;
+	host->op.cdma.timeout_clear_ctxsave = NULL;
+
+	return 0;
+}
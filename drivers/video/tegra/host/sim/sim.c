@@ -0,0 +1,558 @@
+/*
+ * drivers/video/tegra/host/sim/sim.c
+ *
+ * Tegra Graphics Host Software Model
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/bitops.h>
+#include <linux/kthread.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+
+#include "../dev.h"
+#include "../debug.h"
+#include "../nvhost_cdma.h"
+#include "../t20/t20.h"
+#include "../t20/syncpt_t20.h"
+
+#include "sim.h"
+
+/*
+ * Software model of host1x. Sync points, wait bases, module locks and
+ * threshold interrupts live in memory, and each channel has a kernel
+ * thread standing in for its command DMA fetcher. Everything above the
+ * chip support ops (cdma, sync queue, intr, channels, user interface)
+ * runs unmodified, so it can be exercised without Tegra hardware.
+ *
+ * There is a single simulated host; its state is reachable from here.
+ */
+struct nvhost_sim *nvhost_sim;
+
+#define NVMODMUTEX_2D_FULL   (1)
+#define NVMODMUTEX_2D_SIMPLE (2)
+#define NVMODMUTEX_2D_SB_A   (3)
+#define NVMODMUTEX_2D_SB_B   (4)
+#define NVMODMUTEX_3D        (5)
+#define NVMODMUTEX_DISPLAYA  (6)
+#define NVMODMUTEX_DISPLAYB  (7)
+#define NVMODMUTEX_VI        (8)
+#define NVMODMUTEX_DSI       (9)
+
+/* same layout as t20, but with no clocks or power partitions behind it */
+static const struct nvhost_channeldesc nvhost_sim_channelmap[] = {
+{
+	/* channel 0 */
+	.name	       = "display",
+	.syncpts       = BIT(NVSYNCPT_DISP0_A) | BIT(NVSYNCPT_DISP1_A) |
+			 BIT(NVSYNCPT_DISP0_B) | BIT(NVSYNCPT_DISP1_B) |
+			 BIT(NVSYNCPT_DISP0_C) | BIT(NVSYNCPT_DISP1_C) |
+			 BIT(NVSYNCPT_VBLANK0) | BIT(NVSYNCPT_VBLANK1),
+	.modulemutexes = BIT(NVMODMUTEX_DISPLAYA) | BIT(NVMODMUTEX_DISPLAYB),
+	.module        = {
+			NVHOST_MODULE_NO_POWERGATING,
+			NVHOST_DEFAULT_POWERDOWN_DELAY,
+			},
+},
+{
+	/* channel 1 */
+	.name	       = "gr3d",
+	.syncpts       = BIT(NVSYNCPT_3D),
+	.waitbases     = BIT(NVWAITBASE_3D),
+	.modulemutexes = BIT(NVMODMUTEX_3D),
+	.class	       = NV_GRAPHICS_3D_CLASS_ID,
+	.module        = {
+			NVHOST_MODULE_NO_POWERGATING,
+			NVHOST_DEFAULT_POWERDOWN_DELAY,
+			},
+},
+{
+	/* channel 2 */
+	.name	       = "gr2d",
+	.syncpts       = BIT(NVSYNCPT_2D_0) | BIT(NVSYNCPT_2D_1),
+	.waitbases     = BIT(NVWAITBASE_2D_0) | BIT(NVWAITBASE_2D_1),
+	.modulemutexes = BIT(NVMODMUTEX_2D_FULL) | BIT(NVMODMUTEX_2D_SIMPLE) |
+			 BIT(NVMODMUTEX_2D_SB_A) | BIT(NVMODMUTEX_2D_SB_B),
+	.module        = {
+			NVHOST_MODULE_NO_POWERGATING,
+			.powerdown_delay = 0,
+			}
+},
+{
+	/* channel 3 */
+	.name	 = "isp",
+	.syncpts = 0,
+	.module         = {
+			NVHOST_MODULE_NO_POWERGATING,
+			NVHOST_DEFAULT_POWERDOWN_DELAY,
+			},
+},
+{
+	/* channel 4 */
+	.name	       = "vi",
+	.syncpts       = BIT(NVSYNCPT_CSI_VI_0) | BIT(NVSYNCPT_CSI_VI_1) |
+			 BIT(NVSYNCPT_VI_ISP_0) | BIT(NVSYNCPT_VI_ISP_1) |
+			 BIT(NVSYNCPT_VI_ISP_2) | BIT(NVSYNCPT_VI_ISP_3) |
+			 BIT(NVSYNCPT_VI_ISP_4),
+	.modulemutexes = BIT(NVMODMUTEX_VI),
+	.exclusive     = true,
+	.module        = {
+			NVHOST_MODULE_NO_POWERGATING,
+			NVHOST_DEFAULT_POWERDOWN_DELAY,
+			}
+},
+{
+	/* channel 5 */
+	.name	       = "mpe",
+	.syncpts       = BIT(NVSYNCPT_MPE) | BIT(NVSYNCPT_MPE_EBM_EOF) |
+			 BIT(NVSYNCPT_MPE_WR_SAFE),
+	.waitbases     = BIT(NVWAITBASE_MPE),
+	.class	       = NV_VIDEO_ENCODE_MPEG_CLASS_ID,
+	.exclusive     = true,
+	.module        = {
+			NVHOST_MODULE_NO_POWERGATING,
+			NVHOST_DEFAULT_POWERDOWN_DELAY,
+			},
+},
+{
+	/* channel 6 */
+	.name	       = "dsi",
+	.syncpts       = BIT(NVSYNCPT_DSI),
+	.modulemutexes = BIT(NVMODMUTEX_DSI),
+	.module        = {
+			NVHOST_MODULE_NO_POWERGATING,
+			NVHOST_DEFAULT_POWERDOWN_DELAY,
+			},
+}};
+
+/*** sync points ***/
+
+static bool sim_thresh_reached(struct nvhost_sim *sim, u32 id)
+{
+	return (sim->intr_enabled & BIT(id)) &&
+		(s32)(sim->syncpt[id] - sim->thresh[id]) >= 0;
+}
+
+/* Raise the threshold interrupt if it is due. Called with sim->lock held. */
+static void sim_check_thresh(struct nvhost_sim *sim, u32 id)
+{
+	if (sim_thresh_reached(sim, id)) {
+		/* masked until the interrupt thread re-arms it */
+		sim->intr_enabled &= ~BIT(id);
+		queue_work(sim->intr_wq, &sim->intr[id].work);
+	}
+}
+
+void nvhost_sim_syncpt_incr(struct nvhost_sim *sim, u32 id)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->syncpt[id]++;
+	sim_check_thresh(sim, id);
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	wake_up_all(&sim->syncpt_wq);
+}
+
+u32 nvhost_sim_syncpt_read(struct nvhost_sim *sim, u32 id)
+{
+	smp_rmb();
+	return ACCESS_ONCE(sim->syncpt[id]);
+}
+
+static void sim_syncpt_reset(struct nvhost_syncpt *sp, u32 id)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+	unsigned long flags;
+
+	smp_rmb();
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->syncpt[id] = atomic_read(&sp->min_val[id]);
+	sim_check_thresh(sim, id);
+	spin_unlock_irqrestore(&sim->lock, flags);
+
+	wake_up_all(&sim->syncpt_wq);
+}
+
+static void sim_syncpt_reset_wait_base(struct nvhost_syncpt *sp, u32 id)
+{
+	nvhost_sim->base[id] = sp->base_val[id];
+}
+
+static void sim_syncpt_read_wait_base(struct nvhost_syncpt *sp, u32 id)
+{
+	sp->base_val[id] = nvhost_sim->base[id];
+}
+
+static u32 sim_syncpt_update_min(struct nvhost_syncpt *sp, u32 id)
+{
+	u32 old, live;
+
+	do {
+		smp_rmb();
+		old = (u32)atomic_read(&sp->min_val[id]);
+		live = nvhost_sim_syncpt_read(nvhost_sim, id);
+	} while ((u32)atomic_cmpxchg(&sp->min_val[id], old, live) != old);
+
+	BUG_ON(!nvhost_syncpt_check_max(sp, id, live));
+
+	return live;
+}
+
+static void sim_syncpt_cpu_incr(struct nvhost_syncpt *sp, u32 id)
+{
+	struct nvhost_master *dev = syncpt_to_dev(sp);
+	BUG_ON(!nvhost_module_powered(&dev->mod));
+	BUG_ON(!client_managed(id) && nvhost_syncpt_min_eq_max(sp, id));
+	nvhost_sim_syncpt_incr(nvhost_sim, id);
+}
+
+static int nvhost_init_sim_syncpt_support(struct nvhost_master *host)
+{
+	int err;
+
+	/* names, counts and the wait check are shared with t20 */
+	err = nvhost_init_t20_syncpt_support(host);
+	if (err)
+		return err;
+
+	host->sync_aperture = NULL;
+
+	host->op.syncpt.reset = sim_syncpt_reset;
+	host->op.syncpt.reset_wait_base = sim_syncpt_reset_wait_base;
+	host->op.syncpt.read_wait_base = sim_syncpt_read_wait_base;
+	host->op.syncpt.update_min = sim_syncpt_update_min;
+	host->op.syncpt.cpu_incr = sim_syncpt_cpu_incr;
+
+	return 0;
+}
+
+/*** threshold interrupts ***/
+
+/* plays the part of the threaded irq handler */
+static void sim_intr_work(struct work_struct *work)
+{
+	struct nvhost_sim_intr *si =
+		container_of(work, struct nvhost_sim_intr, work);
+	struct nvhost_intr *intr = &nvhost_sim->host->intr;
+
+	nvhost_syncpt_thresh_fn(0, intr->syncpt + si->id);
+}
+
+static void sim_intr_init_host_sync(struct nvhost_intr *intr)
+{
+}
+
+static void sim_intr_set_host_clocks_per_usec(struct nvhost_intr *intr,
+					      u32 cpm)
+{
+}
+
+static void sim_intr_set_syncpt_threshold(struct nvhost_intr *intr,
+					  u32 id, u32 thresh)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->thresh[id] = thresh;
+	sim_check_thresh(sim, id);
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+static void sim_intr_enable_syncpt_intr(struct nvhost_intr *intr, u32 id)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->intr_enabled |= BIT(id);
+	sim_check_thresh(sim, id);
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+static void sim_intr_disable_all_syncpt_intrs(struct nvhost_intr *intr)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+	unsigned long flags;
+
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->intr_enabled = 0;
+	spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+/* there are no read/write timeouts to report */
+static int sim_intr_request_host_general_irq(struct nvhost_intr *intr)
+{
+	intr->host_general_irq_requested = true;
+	return 0;
+}
+
+static void sim_intr_free_host_general_irq(struct nvhost_intr *intr)
+{
+	intr->host_general_irq_requested = false;
+}
+
+/*
+ * Threshold interrupts are delivered from sim->intr_wq, so there is no
+ * irq to request. irq_requested is left clear so that nvhost_intr_stop()
+ * has nothing to free.
+ */
+static int sim_request_syncpt_irq(struct nvhost_intr_syncpt *syncpt)
+{
+	return 0;
+}
+
+static int nvhost_init_sim_intr_support(struct nvhost_master *host)
+{
+	host->op.intr.init_host_sync = sim_intr_init_host_sync;
+	host->op.intr.set_host_clocks_per_usec =
+		sim_intr_set_host_clocks_per_usec;
+	host->op.intr.set_syncpt_threshold = sim_intr_set_syncpt_threshold;
+	host->op.intr.enable_syncpt_intr = sim_intr_enable_syncpt_intr;
+	host->op.intr.disable_all_syncpt_intrs =
+		sim_intr_disable_all_syncpt_intrs;
+	host->op.intr.request_host_general_irq =
+		sim_intr_request_host_general_irq;
+	host->op.intr.free_host_general_irq =
+		sim_intr_free_host_general_irq;
+	host->op.intr.request_syncpt_irq = sim_request_syncpt_irq;
+
+	return 0;
+}
+
+/*** module locks ***/
+
+static int sim_cpuaccess_mutex_try_lock(struct nvhost_cpuaccess *ctx,
+					unsigned int idx)
+{
+	/* nonzero when the lock is already taken, as the register reads */
+	return test_and_set_bit(idx, &nvhost_sim->mlocks);
+}
+
+static void sim_cpuaccess_mutex_unlock(struct nvhost_cpuaccess *ctx,
+				       unsigned int idx)
+{
+	clear_bit(idx, &nvhost_sim->mlocks);
+	smp_mb__after_clear_bit();
+	wake_up_all(&nvhost_sim->syncpt_wq);
+}
+
+static int nvhost_init_sim_cpuaccess_support(struct nvhost_master *host)
+{
+	/* no module register apertures to map */
+	host->nb_modules = 0;
+
+	host->op.cpuaccess.mutex_try_lock = sim_cpuaccess_mutex_try_lock;
+	host->op.cpuaccess.mutex_unlock = sim_cpuaccess_mutex_unlock;
+
+	return 0;
+}
+
+/*** channels ***/
+
+static int sim_channel_init(struct nvhost_channel *ch,
+			    struct nvhost_master *dev, int index)
+{
+	ch->dev = dev;
+	ch->chid = index;
+	ch->desc = nvhost_sim_channelmap + index;
+	mutex_init(&ch->reflock);
+	mutex_init(&ch->submitlock);
+
+	/* no hardware contexts to save or restore */
+	ch->aperture = NULL;
+
+	return nvhost_sim_channel_init(&nvhost_sim->channels[index], ch);
+}
+
+static int sim_channel_read_3d_reg(struct nvhost_channel *channel,
+				   struct nvhost_hwctx *hwctx,
+				   struct nvhost_userctx_timeout *timeout,
+				   u32 offset,
+				   u32 *value)
+{
+	return -ENODEV;
+}
+
+static int nvhost_init_sim_channel_support(struct nvhost_master *host)
+{
+	int err;
+
+	BUILD_BUG_ON(NVHOST_SIM_NUMCHANNELS !=
+		     ARRAY_SIZE(nvhost_sim_channelmap));
+
+	/* submit only talks to cdma and intr */
+	err = nvhost_init_t20_channel_support(host);
+	if (err)
+		return err;
+
+	host->op.channel.init = sim_channel_init;
+	host->op.channel.read3dreg = sim_channel_read_3d_reg;
+
+	return 0;
+}
+
+/*** debug ***/
+
+static void sim_debug_show_channel_cdma(struct nvhost_master *m,
+					struct output *o, int chid)
+{
+	struct nvhost_channel *channel = m->channels + chid;
+	struct nvhost_sim_channel *sch = &nvhost_sim->channels[chid];
+
+	nvhost_debug_output(o, "%d-%s (%d): ", chid,
+			    channel->mod.name,
+			    atomic_read(&channel->mod.refcount));
+
+	if (!sch->running || !channel->cdma.push_buffer.mapped) {
+		nvhost_debug_output(o, "inactive\n\n");
+		return;
+	}
+
+	if (sch->waiting)
+		nvhost_debug_output(o, "waiting on syncpt %d val %d\n",
+			sch->wait_id, sch->wait_thresh);
+	else
+		nvhost_debug_output(o, "active class %02x\n", sch->class);
+
+	nvhost_debug_output(o, "DMAPUT %08x, DMAGET %08x, "
+			"ops %u, gathers %u, waits %u\n\n",
+			sch->put, sch->get,
+			sch->nr_ops, sch->nr_gathers, sch->nr_waits);
+}
+
+/* the fetcher executes in place, there is no FIFO */
+static void sim_debug_show_channel_fifo(struct nvhost_master *m,
+					struct output *o, int chid)
+{
+}
+
+static void sim_debug_show_mlocks(struct nvhost_master *m, struct output *o)
+{
+	int i;
+
+	nvhost_debug_output(o, "---- mlocks ----\n");
+	for (i = 0; i < NV_HOST1X_NB_MLOCKS; i++)
+		nvhost_debug_output(o, "%d: %s\n", i,
+			test_bit(i, &nvhost_sim->mlocks) ?
+			"locked" : "unlocked");
+	nvhost_debug_output(o, "\n");
+}
+
+static void sim_debug_init(struct dentry *de)
+{
+	nvhost_sim_bench_init(nvhost_sim->host, de);
+}
+
+static int nvhost_init_sim_debug_support(struct nvhost_master *host)
+{
+	host->op.debug.debug_init = sim_debug_init;
+	host->op.debug.show_channel_cdma = sim_debug_show_channel_cdma;
+	host->op.debug.show_channel_fifo = sim_debug_show_channel_fifo;
+	host->op.debug.show_mlocks = sim_debug_show_mlocks;
+
+	return 0;
+}
+
+/*** init ***/
+
+int nvhost_init_sim_support(struct nvhost_master *host)
+{
+	struct nvhost_sim *sim;
+	int i, err;
+
+	sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+	if (!sim)
+		return -ENOMEM;
+
+	sim->host = host;
+	spin_lock_init(&sim->lock);
+	init_waitqueue_head(&sim->syncpt_wq);
+
+	sim->intr_wq = alloc_workqueue("nvhost_sim",
+				WQ_HIGHPRI | WQ_NON_REENTRANT, 0);
+	if (!sim->intr_wq) {
+		kfree(sim);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < NV_HOST1X_SYNCPT_NB_PTS; i++) {
+		INIT_WORK(&sim->intr[i].work, sim_intr_work);
+		sim->intr[i].id = i;
+	}
+
+	nvhost_sim = sim;
+
+	/* don't worry about cleaning up on failure... "remove" does it. */
+	err = nvhost_init_sim_channel_support(host);
+	if (err)
+		return err;
+	err = nvhost_init_sim_cdma_support(host);
+	if (err)
+		return err;
+	err = nvhost_init_sim_debug_support(host);
+	if (err)
+		return err;
+	err = nvhost_init_sim_syncpt_support(host);
+	if (err)
+		return err;
+	err = nvhost_init_sim_intr_support(host);
+	if (err)
+		return err;
+	err = nvhost_init_sim_cpuaccess_support(host);
+	if (err)
+		return err;
+	return 0;
+}
+
+/* stops the fetchers and the interrupt workqueue, then frees the model */
+void nvhost_deinit_sim_support(struct nvhost_master *host)
+{
+	struct nvhost_sim *sim = nvhost_sim;
+	unsigned long flags;
+	int i;
+
+	if (!sim || sim->host != host)
+		return;
+
+	for (i = 0; i < NVHOST_SIM_NUMCHANNELS; i++) {
+		if (sim->channels[i].thread)
+			kthread_stop(sim->channels[i].thread);
+	}
+
+	/* no more threshold interrupts, then drain the ones queued */
+	spin_lock_irqsave(&sim->lock, flags);
+	sim->intr_enabled = 0;
+	spin_unlock_irqrestore(&sim->lock, flags);
+	destroy_workqueue(sim->intr_wq);
+
+	nvhost_sim = NULL;
+	kfree(sim);
+}
+
+static int __init nvhost_sim_device_init(void)
+{
+	struct platform_device *pdev;
+
+	pdev = platform_device_register_simple(NVHOST_SIM_DEVICE_NAME,
+					       -1, NULL, 0);
+	return IS_ERR(pdev) ? PTR_ERR(pdev) : 0;
+}
+arch_initcall(nvhost_sim_device_init);
@@ -0,0 +1,117 @@
+/*
+ * drivers/video/tegra/host/sim/sim.h
+ *
+ * Tegra Graphics Host Software Model
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#ifndef _NVHOST_SIM_H_
+#define _NVHOST_SIM_H_
+
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "../t20/hardware_t20.h"
+
+#define NVHOST_SIM_DEVICE_NAME "tegra_grhost_sim"
+
+/* channel 7 is reserved for the host, as on t20 */
+#define NVHOST_SIM_NUMCHANNELS (NV_HOST1X_CHANNELS - 1)
+
+struct dentry;
+struct nvhost_master;
+struct nvhost_channel;
+struct nvhost_cdma;
+
+/*
+ * Command DMA fetcher of one simulated channel. get/put are push buffer
+ * addresses, exactly as DMAGET/DMAPUT would hold them.
+ */
+struct nvhost_sim_channel {
+	struct nvhost_cdma *cdma;
+	struct task_struct *thread;
+	struct mutex lock;		/* held while executing opcodes */
+	wait_queue_head_t wq;		/* fetcher sleeps here for work */
+	bool running;
+	u32 get;
+	u32 put;
+
+	/* opcode parser state */
+	u32 class;
+	u32 offset;
+	u32 mask;
+	u32 count;
+	u32 opcode;
+	u32 gather_op;
+
+	/* sync point the fetcher is blocked on, for debug dumps */
+	bool waiting;
+	u32 wait_id;
+	u32 wait_thresh;
+
+	/* statistics */
+	u32 nr_ops;
+	u32 nr_gathers;
+	u32 nr_waits;
+};
+
+struct nvhost_sim_intr {
+	struct work_struct work;
+	u32 id;
+};
+
+struct nvhost_sim {
+	struct nvhost_master *host;
+
+	/* sync point state, the equivalent of the host1x sync registers */
+	spinlock_t lock;
+	u32 syncpt[NV_HOST1X_SYNCPT_NB_PTS];
+	u32 base[NV_HOST1X_SYNCPT_NB_BASES];
+	u32 thresh[NV_HOST1X_SYNCPT_NB_PTS];
+	u32 intr_enabled;
+	unsigned long mlocks;
+	wait_queue_head_t syncpt_wq;	/* WAIT_SYNCPT in the fetchers */
+
+	/* threshold "interrupts" are delivered from this workqueue */
+	struct workqueue_struct *intr_wq;
+	struct nvhost_sim_intr intr[NV_HOST1X_SYNCPT_NB_PTS];
+
+	struct nvhost_sim_channel channels[NVHOST_SIM_NUMCHANNELS];
+};
+
+extern struct nvhost_sim *nvhost_sim;
+
+void nvhost_sim_syncpt_incr(struct nvhost_sim *sim, u32 id);
+u32 nvhost_sim_syncpt_read(struct nvhost_sim *sim, u32 id);
+
+int nvhost_sim_channel_init(struct nvhost_sim_channel *sch,
+			    struct nvhost_channel *ch);
+int nvhost_init_sim_cdma_support(struct nvhost_master *host);
+
+#ifdef CONFIG_TEGRA_GRHOST_SIM_BENCH
+void nvhost_sim_bench_init(struct nvhost_master *host, struct dentry *de);
+#else
+static inline void nvhost_sim_bench_init(struct nvhost_master *host,
+					 struct dentry *de)
+{
+}
+#endif
+
+#endif /* _NVHOST_SIM_H_ */
@@ -43,7 +43,7 @@ static void t20_cdma_timeout_handler(struct work_struct *work);
  */
 static void t20_push_buffer_reset(struct push_buffer *pb)
 {
-	pb->fence = PUSH_BUFFER_SIZE - 8;
+	pb->fence = pb->size - 8;
 	pb->cur = 0;
 }
 
@@ -59,11 +59,16 @@ static int t20_push_buffer_init(struct push_buffer *pb)
 	pb->phys = 0;
 	pb->nvmap = NULL;
 
+	if (!pb->size) {
+		pb->size = PUSH_BUFFER_SIZE;
+		pb->max_size = PUSH_BUFFER_MAX_SIZE;
+	}
+
 	BUG_ON(!cdma_pb_op(cdma).reset);
 	cdma_pb_op(cdma).reset(pb);
 
 	/* allocate and map pushbuffer memory */
-	pb->mem = nvmap_alloc(nvmap, PUSH_BUFFER_SIZE + 4, 32,
+	pb->mem = nvmap_alloc(nvmap, pb->size + 4, 32,
 			      NVMAP_HANDLE_WRITE_COMBINE);
 	if (IS_ERR_OR_NULL(pb->mem)) {
 		pb->mem = NULL;
@@ -81,14 +86,14 @@ static int t20_push_buffer_init(struct push_buffer *pb)
 	}
 
 	/* memory for storing nvmap client and handles for each opcode pair */
-	pb->nvmap = kzalloc(PUSH_BUFFER_SIZE/2 *
+	pb->nvmap = kzalloc(pb->size/2 *
 				sizeof(struct nvmap_client_handle),
 			GFP_KERNEL);
 	if (!pb->nvmap)
 		goto fail;
 
 	/* put the restart at the end of pushbuffer memory */
-	*(pb->mapped + (PUSH_BUFFER_SIZE >> 2)) = nvhost_opcode_restart(pb->phys);
+	*(pb->mapped + (pb->size >> 2)) = nvhost_opcode_restart(pb->phys);
 
 	return 0;
 
@@ -121,6 +126,34 @@ static void t20_push_buffer_destroy(struct push_buffer *pb)
 	pb->nvmap = 0;
 }
 
+/**
+ * Replace an empty push buffer with a larger one. On failure the
+ * current push buffer is left in place.
+ */
+static int t20_push_buffer_grow(struct push_buffer *pb, u32 size)
+{
+	struct push_buffer old = *pb;
+	struct push_buffer grown;
+	int err;
+
+	BUG_ON(size & (size - 1));
+
+	pb->size = size;
+	err = t20_push_buffer_init(pb);
+	if (err) {
+		*pb = old;
+		return err;
+	}
+
+	/* release the old memory through the embedded push buffer */
+	grown = *pb;
+	*pb = old;
+	t20_push_buffer_destroy(pb);
+	*pb = grown;
+
+	return 0;
+}
+
 /**
  * Push two words to the push buffer
  * Caller must ensure push buffer is not full
@@ -136,7 +169,7 @@ static void t20_push_buffer_push_to(struct push_buffer *pb,
 	*(p++) = op2;
 	pb->nvmap[cur/8].client = client;
 	pb->nvmap[cur/8].handle = handle;
-	pb->cur = (cur + 8) & (PUSH_BUFFER_SIZE - 1);
+	pb->cur = (cur + 8) & (pb->size - 1);
 }
 
 /**
@@ -145,7 +178,7 @@ static void t20_push_buffer_push_to(struct push_buffer *pb,
  */
 static void t20_push_buffer_pop_from(struct push_buffer *pb, unsigned int slots)
 {
-	pb->fence = (pb->fence + slots * 8) & (PUSH_BUFFER_SIZE - 1);
+	pb->fence = (pb->fence + slots * 8) & (pb->size - 1);
 }
 
 /**
@@ -153,7 +186,7 @@ static void t20_push_buffer_pop_from(struct push_buffer *pb, unsigned int slots)
  */
 static u32 t20_push_buffer_space(struct push_buffer *pb)
 {
-	return ((pb->fence - pb->cur) & (PUSH_BUFFER_SIZE - 1)) / 8;
+	return ((pb->fence - pb->cur) & (pb->size - 1)) / 8;
 }
 
 static u32 t20_push_buffer_putptr(struct push_buffer *pb)
@@ -296,7 +329,7 @@ static void t20_cdma_timeout_cpu_incr(struct nvhost_cdma *cdma, u32 getptr,
 		*(p++) = NVHOST_OPCODE_NOOP;
 		dev_dbg(&dev->pdev->dev, "%s: NOP at 0x%x\n",
 			__func__, pb->phys + getidx);
-		getidx = (getidx + 8) & (PUSH_BUFFER_SIZE - 1);
+		getidx = (getidx + 8) & (pb->size - 1);
 	}
 	wmb();
 }
@@ -327,7 +360,7 @@ static void t20_cdma_timeout_pb_incr(struct nvhost_cdma *cdma, u32 getptr,
 		syncpt_incrs -= timeout->hwctx->save_incrs;
 
 		getidx += (timeout->hwctx->save_slots * 8);
-		getidx &= (PUSH_BUFFER_SIZE - 1);
+		getidx &= (pb->size - 1);
 
 		dev_dbg(&dev->pdev->dev,
 			"%s: exec CTXSAVE of prev ctx (slots %d, incrs %d)\n",
@@ -352,7 +385,7 @@ static void t20_cdma_timeout_pb_incr(struct nvhost_cdma *cdma, u32 getptr,
 			(incrs * sb->words_per_incr));
 
 		syncpt_incrs -= incrs;
-		getidx = (getidx + 8) & (PUSH_BUFFER_SIZE - 1);
+		getidx = (getidx + 8) & (pb->size - 1);
 		nr_slots--;
 	}
 
@@ -363,7 +396,7 @@ static void t20_cdma_timeout_pb_incr(struct nvhost_cdma *cdma, u32 getptr,
 		*(p++) = NVHOST_OPCODE_NOOP;
 		dev_dbg(&dev->pdev->dev, "%s: NOP at 0x%x\n",
 			__func__, pb->phys + getidx);
-		getidx = (getidx + 8) & (PUSH_BUFFER_SIZE - 1);
+		getidx = (getidx + 8) & (pb->size - 1);
 	}
 	wmb();
 }
@@ -405,7 +438,7 @@ static void t20_cdma_timeout_clear_ctxsave(struct nvhost_cdma *cdma,
 			*(p++) = nvhost_opcode_gather(count);
 			*(p++) = sb->phys;
 
-			getidx = (getidx + 8) & (PUSH_BUFFER_SIZE - 1);
+			getidx = (getidx + 8) & (pb->size - 1);
 			slots_to_clear--;
 		}
 
@@ -416,7 +449,7 @@ static void t20_cdma_timeout_clear_ctxsave(struct nvhost_cdma *cdma,
 			*(p++) = NVHOST_OPCODE_NOOP;
 			dev_dbg(&dev->pdev->dev, "%s: NOP at 0x%x\n",
 				__func__, pb->phys + getidx);
-			getidx = (getidx + 8) & (PUSH_BUFFER_SIZE - 1);
+			getidx = (getidx + 8) & (pb->size - 1);
 		}
 	}
 	wmb();
@@ -542,7 +575,7 @@ void t20_cdma_peek(struct nvhost_cdma *cdma,
 	u32 offset = dmaget - cdma->push_buffer.phys;
 	u32 *p = cdma->push_buffer.mapped;
 
-	offset = ((offset + slot * 8) & (PUSH_BUFFER_SIZE - 1)) >> 2;
+	offset = ((offset + slot * 8) & (cdma->push_buffer.size - 1)) >> 2;
 	out[0] = p[offset];
 	out[1] = p[offset + 1];
 }
@@ -687,10 +720,12 @@ int nvhost_init_t20_cdma_support(struct nvhost_master *host)
 	host->op.cdma.timeout_clear_ctxsave = t20_cdma_timeout_clear_ctxsave;
 
 	host->sync_queue_size = NVHOST_SYNC_QUEUE_SIZE;
+	host->sync_queue_max_size = NVHOST_SYNC_QUEUE_MAX_SIZE;
 
 	host->op.push_buffer.reset = t20_push_buffer_reset;
 	host->op.push_buffer.init = t20_push_buffer_init;
 	host->op.push_buffer.destroy = t20_push_buffer_destroy;
+	host->op.push_buffer.grow = t20_push_buffer_grow;
 	host->op.push_buffer.push_to = t20_push_buffer_push_to;
 	host->op.push_buffer.pop_from = t20_push_buffer_pop_from;
 	host->op.push_buffer.space = t20_push_buffer_space;
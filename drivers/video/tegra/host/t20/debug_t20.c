@@ -196,7 +196,7 @@ static void cdma_peek(struct nvhost_cdma *cdma,
 	u32 offset = dmaget - cdma->push_buffer.phys;
 	u32 *p = cdma->push_buffer.mapped;
 
-	offset = ((offset + slot * 8) & (PUSH_BUFFER_SIZE - 1)) >> 2;
+	offset = ((offset + slot * 8) & (cdma->push_buffer.size - 1)) >> 2;
 	out[0] = p[offset];
 	out[1] = p[offset + 1];
 }
@@ -206,7 +206,7 @@ u32 previous_oppair(struct nvhost_cdma *cdma, u32 cur)
 	u32 pb = cdma->push_buffer.phys;
 	u32 prev = cur-8;
 	if (prev < pb)
-		prev += PUSH_BUFFER_SIZE;
+		prev += cdma->push_buffer.size;
 	return prev;
 }
 
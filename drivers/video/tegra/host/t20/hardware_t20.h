@@ -280,6 +280,10 @@ int nvhost_drain_read_fifo(void __iomem *chan_regs,
  * many command buffers. If it is too large, we waste memory. */
 #define NVHOST_SYNC_QUEUE_SIZE 8192
 
+/* Upper bound the sync queue may grow to when submitters keep finding
+ * it full. */
+#define NVHOST_SYNC_QUEUE_MAX_SIZE (NVHOST_SYNC_QUEUE_SIZE * 4)
+
 /* Number of gathers we allow to be queued up per channel. Must be a
  * power of two. Currently sized such that pushbuffer is 4KB (512*8B). */
 #define NVHOST_GATHER_QUEUE_SIZE 512
@@ -287,6 +291,10 @@ int nvhost_drain_read_fifo(void __iomem *chan_regs,
 /* 8 bytes per slot. (This number does not include the final RESTART.) */
 #define PUSH_BUFFER_SIZE (NVHOST_GATHER_QUEUE_SIZE * 8)
 
+/* Upper bound the push buffer may grow to when submitters keep finding
+ * it full. Must be a power of two. */
+#define PUSH_BUFFER_MAX_SIZE (PUSH_BUFFER_SIZE * 8)
+
 /* 4K page containing GATHERed methods to increment channel syncpts
  * and replaces the original timed out contexts GATHER slots */
 #define SYNCPT_INCR_BUFFER_SIZE_WORDS   (4096 / sizeof(u32))
@@ -95,9 +95,15 @@ static void scale3d_clocks(unsigned long percent)
 	curr = clk_get_rate(scale3d.clk_3d);
 	hz = percent * (curr / 100);
 
-	if (tegra_get_chipid() == TEGRA_CHIPID_TEGRA3)
-		clk_set_rate(scale3d.clk_3d2, 0);
-	clk_set_rate(scale3d.clk_3d, hz);
+	if (tegra_get_chipid() == TEGRA_CHIPID_TEGRA3) {
+		/* both are cbus users, move the bus once */
+		struct tegra_clk_rate rates[] = {
+			{ scale3d.clk_3d2, 0 },
+			{ scale3d.clk_3d, hz },
+		};
+		tegra_clk_set_rates(rates, ARRAY_SIZE(rates));
+	} else
+		clk_set_rate(scale3d.clk_3d, hz);
 }
 
 static void scale3d_clocks_handler(struct work_struct *work)
@@ -123,9 +129,14 @@ static void reset_3d_clocks(void)
 	unsigned long hz;
 
 	hz = clk_round_rate(scale3d.clk_3d, UINT_MAX);
-	clk_set_rate(scale3d.clk_3d, hz);
-	if (tegra_get_chipid() == TEGRA_CHIPID_TEGRA3)
-		clk_set_rate(scale3d.clk_3d2, hz);
+	if (tegra_get_chipid() == TEGRA_CHIPID_TEGRA3) {
+		struct tegra_clk_rate rates[] = {
+			{ scale3d.clk_3d, hz },
+			{ scale3d.clk_3d2, hz },
+		};
+		tegra_clk_set_rates(rates, ARRAY_SIZE(rates));
+	} else
+		clk_set_rate(scale3d.clk_3d, hz);
 }
 
 static int scale3d_is_enabled(void)
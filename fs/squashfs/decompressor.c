@@ -25,11 +25,13 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
+#include <linux/percpu.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "decompressor.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * This file (and decompressor.h) implements a decompressor framework for
@@ -77,9 +79,135 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
+#ifdef CONFIG_SQUASHFS_DECOMP_MULTI_PERCPU
+/*
+ * One decompressor stream per cpu.  Decompression runs with preemption
+ * disabled on the local cpu's stream, so independent blocks read by tasks on
+ * different cpus are decompressed in parallel rather than queueing on one
+ * stream.  squashfs_read_data() waits for the buffers before decompressing,
+ * so nothing sleeps in there.
+ */
+struct squashfs_stream {
+	void	*stream;
+};
+
+static void squashfs_stream_free(struct squashfs_sb_info *msblk,
+	struct squashfs_stream __percpu *percpu)
+{
+	void *strm;
+	int cpu;
+
+	/* alloc_percpu() zeroes, streams not created yet are NULL */
+	for_each_possible_cpu(cpu) {
+		strm = per_cpu_ptr(percpu, cpu)->stream;
+		if (strm)
+			msblk->decompressor->free(strm);
+	}
+	free_percpu(percpu);
+}
+
+
+static void *squashfs_stream_create(struct squashfs_sb_info *msblk,
+	void *buffer, int length)
+{
+	struct squashfs_stream __percpu *percpu;
+	struct squashfs_stream *stream;
+	void *strm;
+	int cpu;
+
+	percpu = alloc_percpu(struct squashfs_stream);
+	if (percpu == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	for_each_possible_cpu(cpu) {
+		strm = msblk->decompressor->init(msblk, buffer, length);
+		if (IS_ERR(strm)) {
+			squashfs_stream_free(msblk, percpu);
+			return strm;
+		}
+		stream = per_cpu_ptr(percpu, cpu);
+		stream->stream = strm;
+	}
+
+	return (__force void *) percpu;
+}
+
+
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk, void *strm)
+{
+	if (msblk->decompressor && strm)
+		squashfs_stream_free(msblk,
+			(struct squashfs_stream __percpu *) strm);
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk,
+	struct buffer_head **bh, int b, int offset, int length,
+	struct squashfs_page_actor *output)
+{
+	struct squashfs_stream __percpu *percpu =
+		(struct squashfs_stream __percpu *) msblk->stream;
+	struct squashfs_stream *stream = get_cpu_ptr(percpu);
+	int res;
+
+	res = msblk->decompressor->decompress(msblk, stream->stream, bh, b,
+		offset, length, output);
+	squashfs_finish_page(output);
+	put_cpu_ptr(stream);
+
+	return res;
+}
+
+
+int squashfs_max_decompressors(void)
+{
+	return num_possible_cpus();
+}
+#else
+/*
+ * A single decompressor stream, serialised by read_data_mutex.
+ */
+static void *squashfs_stream_create(struct squashfs_sb_info *msblk,
+	void *buffer, int length)
+{
+	return msblk->decompressor->init(msblk, buffer, length);
+}
+
+
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk, void *strm)
+{
+	if (msblk->decompressor)
+		msblk->decompressor->free(strm);
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk,
+	struct buffer_head **bh, int b, int offset, int length,
+	struct squashfs_page_actor *output)
+{
+	int res;
+
+	mutex_lock(&msblk->read_data_mutex);
+	res = msblk->decompressor->decompress(msblk, msblk->stream, bh, b,
+		offset, length, output);
+	squashfs_finish_page(output);
+	mutex_unlock(&msblk->read_data_mutex);
+
+	return res;
+}
+
+
+int squashfs_max_decompressors(void)
+{
+	return 1;
+}
+#endif
+
+
 void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	struct squashfs_page_actor actor;
 	void *strm, *buffer = NULL;
 	int length = 0;
 
@@ -91,9 +219,9 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 		if (buffer == NULL)
 			return ERR_PTR(-ENOMEM);
 
-		length = squashfs_read_data(sb, &buffer,
-			sizeof(struct squashfs_super_block), 0, NULL,
-			PAGE_CACHE_SIZE, 1);
+		squashfs_page_actor_init(&actor, &buffer, 1, PAGE_CACHE_SIZE);
+		length = squashfs_read_data(sb,
+			sizeof(struct squashfs_super_block), 0, NULL, &actor);
 
 		if (length < 0) {
 			strm = ERR_PTR(length);
@@ -101,7 +229,7 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	strm = squashfs_stream_create(msblk, buffer, length);
 
 finished:
 	kfree(buffer);
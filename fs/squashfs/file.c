@@ -52,6 +52,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -371,6 +372,109 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/*
+ * Decompress a datablock straight into the page cache pages it covers,
+ * instead of into the read_page cache and copying from there.  Pages of the
+ * block which are already uptodate are decompressed into a scratch page.  If
+ * a page cannot be grabbed someone else is reading it, and -EAGAIN tells the
+ * caller to go through the read_page cache so that the block is only
+ * decompressed once.  On success target_page is unlocked, otherwise it is
+ * left locked for the caller.
+ */
+static int squashfs_readpage_block(struct page *target_page, u64 block,
+	int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int i, n, pages, avail, res = -ENOMEM;
+	struct squashfs_page_actor actor;
+	struct page **page;
+	void *scratch = NULL, *pageaddr;
+
+	if (end_index > file_end)
+		end_index = file_end;
+	pages = end_index - start_index + 1;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		return res;
+
+	for (i = 0, n = start_index; n <= end_index; i++, n++) {
+		if (n == target_page->index) {
+			page[i] = target_page;
+			continue;
+		}
+
+		page[i] = grab_cache_page_nowait(target_page->mapping, n);
+		if (page[i] == NULL) {
+			res = -EAGAIN;
+			goto release_pages;
+		}
+
+		if (PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = NULL;
+
+			if (scratch == NULL) {
+				scratch = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
+				if (scratch == NULL)
+					goto release_pages;
+			}
+		}
+	}
+
+	squashfs_page_actor_init_pages(&actor, page, scratch, pages,
+		msblk->block_size);
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, &actor);
+	if (res < 0) {
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+		goto release_pages;
+	}
+
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL)
+			continue;
+
+		/* zero the tail of the last page, and anything not written */
+		avail = res - i * PAGE_CACHE_SIZE;
+		if (avail < PAGE_CACHE_SIZE) {
+			avail = max(avail, 0);
+			pageaddr = kmap_atomic(page[i], KM_USER0);
+			memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
+			kunmap_atomic(pageaddr, KM_USER0);
+		}
+
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+
+	kfree(scratch);
+	kfree(page);
+	return 0;
+
+release_pages:
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL || page[i] == target_page)
+			continue;
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+
+	kfree(scratch);
+	kfree(page);
+	return res;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -410,8 +514,15 @@ static int squashfs_readpage(struct file *file, struct page *page)
 			sparse = 1;
 		} else {
 			/*
-			 * Read and decompress datablock.
+			 * Read and decompress datablock, straight into the
+			 * page cache if all its pages can be had.
 			 */
+			int res = squashfs_readpage_block(page, block, bsize);
+			if (res == 0)
+				return 0;
+			if (res != -EAGAIN)
+				goto error_out;
+
 			buffer = squashfs_get_datablock(inode->i_sb,
 								block, bsize);
 			if (buffer->error) {
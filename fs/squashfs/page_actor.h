@@ -0,0 +1,98 @@
+#ifndef PAGE_ACTOR_H
+#define PAGE_ACTOR_H
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * page_actor.h
+ */
+
+#include <linux/highmem.h>
+
+/*
+ * Destination of squashfs_read_data().  Either a list of PAGE_CACHE_SIZE
+ * kernel buffers (the caches and tables), or page cache pages, which are
+ * mapped one at a time while they are being filled so that a datablock can
+ * be decompressed straight into the page cache.  A NULL page (one that could
+ * not be grabbed, or which is already uptodate) is decompressed into the
+ * scratch buffer and the data thrown away.
+ */
+struct squashfs_page_actor {
+	void		**buffer;
+	struct page	**page;
+	void		*scratch;
+	void		*pageaddr;
+	int		pages;
+	int		length;
+	int		next_page;
+};
+
+static inline void squashfs_page_actor_init(struct squashfs_page_actor *actor,
+	void **buffer, int pages, int length)
+{
+	actor->buffer = buffer;
+	actor->page = NULL;
+	actor->scratch = NULL;
+	actor->pageaddr = NULL;
+	actor->pages = pages;
+	actor->length = length;
+	actor->next_page = 0;
+}
+
+static inline void squashfs_page_actor_init_pages(
+	struct squashfs_page_actor *actor, struct page **page, void *scratch,
+	int pages, int length)
+{
+	squashfs_page_actor_init(actor, NULL, pages, length);
+	actor->page = page;
+	actor->scratch = scratch;
+}
+
+/*
+ * Return the next output buffer.  Page cache pages are mapped atomically,
+ * so the caller must not sleep until squashfs_finish_page().
+ */
+static inline void *squashfs_next_page(struct squashfs_page_actor *actor)
+{
+	struct page *page;
+
+	if (actor->next_page == actor->pages)
+		return NULL;
+
+	if (actor->buffer)
+		return actor->buffer[actor->next_page++];
+
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr, KM_USER0);
+		actor->pageaddr = NULL;
+	}
+
+	page = actor->page[actor->next_page++];
+	if (page == NULL)
+		return actor->scratch;
+
+	actor->pageaddr = kmap_atomic(page, KM_USER0);
+	return actor->pageaddr;
+}
+
+static inline void squashfs_finish_page(struct squashfs_page_actor *actor)
+{
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr, KM_USER0);
+		actor->pageaddr = NULL;
+	}
+}
+#endif
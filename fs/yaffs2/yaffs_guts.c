@@ -146,6 +146,8 @@ u8 *yaffs_get_temp_buffer(struct yaffs_dev * dev, int line_no)
 {
 	int i, j;
 
+	spin_lock(&dev->shared_lock);
+
 	dev->temp_in_use++;
 	if (dev->temp_in_use > dev->max_temp)
 		dev->max_temp = dev->temp_in_use;
@@ -160,10 +162,14 @@ u8 *yaffs_get_temp_buffer(struct yaffs_dev * dev, int line_no)
 					    dev->temp_buffer[j].line;
 			}
 
+			spin_unlock(&dev->shared_lock);
 			return dev->temp_buffer[i].buffer;
 		}
 	}
 
+	dev->unmanaged_buffer_allocs++;
+	spin_unlock(&dev->shared_lock);
+
 	yaffs_trace(YAFFS_TRACE_BUFFERS,
 		"Out of temp buffers at line %d, other held by lines:",
 		line_no);
@@ -175,8 +181,7 @@ u8 *yaffs_get_temp_buffer(struct yaffs_dev * dev, int line_no)
 	 * This is not good.
 	 */
 
-	dev->unmanaged_buffer_allocs++;
-	return kmalloc(dev->data_bytes_per_chunk, GFP_NOFS);
+	return kmalloc(dev->param.total_bytes_per_chunk, GFP_NOFS);
 
 }
 
@@ -184,22 +189,28 @@ void yaffs_release_temp_buffer(struct yaffs_dev *dev, u8 * buffer, int line_no)
 {
 	int i;
 
+	spin_lock(&dev->shared_lock);
+
 	dev->temp_in_use--;
 
 	for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++) {
 		if (dev->temp_buffer[i].buffer == buffer) {
 			dev->temp_buffer[i].line = 0;
+			spin_unlock(&dev->shared_lock);
 			return;
 		}
 	}
 
+	if (buffer)
+		dev->unmanaged_buffer_deallocs++;
+	spin_unlock(&dev->shared_lock);
+
 	if (buffer) {
 		/* assume it is an unmanaged one. */
 		yaffs_trace(YAFFS_TRACE_BUFFERS,
 		  "Releasing unmanaged temp buffer in line %d",
 		   line_no);
 		kfree(buffer);
-		dev->unmanaged_buffer_deallocs++;
 	}
 
 }
@@ -255,6 +266,7 @@ static void yaffs_handle_chunk_update(struct yaffs_dev *dev, int nand_chunk,
 void yaffs_handle_chunk_error(struct yaffs_dev *dev,
 			      struct yaffs_block_info *bi)
 {
+	spin_lock(&dev->shared_lock);
 	if (!bi->gc_prioritise) {
 		bi->gc_prioritise = 1;
 		dev->has_pending_prioritised_gc = 1;
@@ -266,6 +278,7 @@ void yaffs_handle_chunk_error(struct yaffs_dev *dev,
 
 		}
 	}
+	spin_unlock(&dev->shared_lock);
 }
 
 static void yaffs_handle_chunk_wr_error(struct yaffs_dev *dev, int nand_chunk,
@@ -1587,6 +1600,7 @@ static void yaffs_use_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
 {
 
 	if (dev->param.n_caches > 0) {
+		spin_lock(&dev->shared_lock);
 		if (dev->cache_last_use < 0 || dev->cache_last_use > 100000000) {
 			/* Reset the cache usages */
 			int i;
@@ -1602,6 +1616,7 @@ static void yaffs_use_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
 
 		if (is_write)
 			cache->dirty = 1;
+		spin_unlock(&dev->shared_lock);
 	}
 }
 
@@ -2439,7 +2454,8 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 
 
 
-static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
+static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block,
+			  int max_copies)
 {
 	int old_chunk;
 	int new_chunk;
@@ -2448,7 +2464,6 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	int i;
 	int is_checkpt_block;
 	int matching_chunk;
-	int max_copies;
 
 	int chunks_before = yaffs_get_erased_chunks(dev);
 	int chunks_after;
@@ -2486,7 +2501,8 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 
 		yaffs_verify_blk(dev, bi, block);
 
-		max_copies = (whole_block) ? dev->param.chunks_per_block : 5;
+		if (whole_block)
+			max_copies = dev->param.chunks_per_block;
 		old_chunk = block * dev->param.chunks_per_block + dev->gc_chunk;
 
 		for ( /* init already done */ ;
@@ -2883,7 +2899,8 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
  * The idea is to help clear out space in a more spread-out manner.
  * Dunno if it really does anything useful.
  */
-static int yaffs_check_gc(struct yaffs_dev *dev, int background)
+static int yaffs_check_gc(struct yaffs_dev *dev, int background,
+			  int max_copies)
 {
 	int aggressive = 0;
 	int gc_ok = YAFFS_OK;
@@ -2891,8 +2908,12 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 	int min_erased;
 	int erased_chunks;
 	int checkpt_block_adjust;
+	unsigned gc_control = YAFFS_GC_CONTROL_ENABLE;
 
-	if (dev->param.gc_control && (dev->param.gc_control(dev) & 1) == 0)
+	if (dev->param.gc_control)
+		gc_control = dev->param.gc_control(dev);
+
+	if (!(gc_control & YAFFS_GC_CONTROL_ENABLE))
 		return YAFFS_OK;
 
 	if (dev->gc_disable) {
@@ -2922,6 +2943,20 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 			    && erased_chunks > (dev->n_free_chunks / 4))
 				break;
 
+			/*
+			 * Leave passive gc to the background thread while it
+			 * keeps up.  If a busy writer outruns it, still do a
+			 * bounded passive pass here rather than letting the
+			 * device drop into aggressive gc.
+			 */
+			if (!background &&
+			    (gc_control & YAFFS_GC_CONTROL_BACKGROUND)) {
+				if (dev->param.gc_wake_fn)
+					dev->param.gc_wake_fn(dev);
+				if (erased_chunks > dev->n_free_chunks / 8)
+					break;
+			}
+
 			if (dev->gc_skip > 20)
 				dev->gc_skip = 20;
 			if (erased_chunks < dev->n_free_chunks / 2 ||
@@ -2953,12 +2988,15 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 			dev->all_gcs++;
 			if (!aggressive)
 				dev->passive_gc_count++;
+			if (!background)
+				dev->fg_gcs++;
 
 			yaffs_trace(YAFFS_TRACE_GC,
 				"yaffs: GC n_erased_blocks %d aggressive %d",
 				dev->n_erased_blocks, aggressive);
 
-			gc_ok = yaffs_gc_block(dev, dev->gc_block, aggressive);
+			gc_ok = yaffs_gc_block(dev, dev->gc_block, aggressive,
+					       max_copies);
 		}
 
 		if (dev->n_erased_blocks < (dev->param.n_reserved_blocks)
@@ -2977,15 +3015,21 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 /*
  * yaffs_bg_gc()
  * Garbage collects. Intended to be called from a background thread.
+ * Each call copies at most max_copies chunks off the block being
+ * collected, so the caller can hold its lock for a bounded time and
+ * collect incrementally.
  * Returns non-zero if at least half the free chunks are erased.
  */
-int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency)
+int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency, int max_copies)
 {
-	int erased_chunks = dev->n_erased_blocks * dev->param.chunks_per_block;
+	int erased_chunks;
+
+	yaffs_trace(YAFFS_TRACE_BACKGROUND, "Background gc %u, %d copies",
+		urgency, max_copies);
 
-	yaffs_trace(YAFFS_TRACE_BACKGROUND, "Background gc %u", urgency);
+	yaffs_check_gc(dev, 1, max_copies);
 
-	yaffs_check_gc(dev, 1);
+	erased_chunks = dev->n_erased_blocks * dev->param.chunks_per_block;
 	return erased_chunks > dev->n_free_chunks / 2;
 }
 
@@ -3089,7 +3133,7 @@ static int yaffs_wr_data_obj(struct yaffs_obj *in, int inode_chunk,
 
 	struct yaffs_dev *dev = in->my_dev;
 
-	yaffs_check_gc(dev, 0);
+	yaffs_check_gc(dev, 0, YAFFS_GC_PASSIVE_COPIES);
 
 	/* Get the previous chunk at this location in the file if it exists.
 	 * If it does not exist then put a zero into the tree. This creates
@@ -3270,8 +3314,18 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 
 	dev = in->my_dev;
 
-	if (in->lazy_loaded && in->hdr_chunk > 0) {
-		in->lazy_loaded = 0;
+	if (!in->lazy_loaded || in->hdr_chunk <= 0) {
+		smp_rmb();	/* Pairs with the smp_wmb() below */
+		return;
+	}
+
+	/*
+	 * Lookups and readdir run under a shared lock, so two of them may
+	 * find the same object still lazy.  Only one loads it, and the flag
+	 * is cleared once the details are in place.
+	 */
+	mutex_lock(&dev->load_lock);
+	if (in->lazy_loaded) {
 		chunk_data = yaffs_get_temp_buffer(dev, __LINE__);
 
 		result =
@@ -3291,7 +3345,11 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 		}
 
 		yaffs_release_temp_buffer(dev, chunk_data, __LINE__);
+
+		smp_wmb();
+		in->lazy_loaded = 0;
 	}
+	mutex_unlock(&dev->load_lock);
 }
 
 static void yaffs_load_name_from_oh(struct yaffs_dev *dev, YCHAR * name,
@@ -3396,7 +3454,7 @@ int yaffs_update_oh(struct yaffs_obj *in, const YCHAR * name, int force,
 	if (!in->fake || in == dev->root_dir ||
 	    force || xmod) {
 
-		yaffs_check_gc(dev, 0);
+		yaffs_check_gc(dev, 0, YAFFS_GC_PASSIVE_COPIES);
 		yaffs_check_obj_details_loaded(in);
 
 		buffer = yaffs_get_temp_buffer(in->my_dev, __LINE__);
@@ -3568,48 +3626,29 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 
 		cache = yaffs_find_chunk_cache(in, chunk);
 
-		/* If the chunk is already in the cache or it is less than a whole chunk
-		 * or we're using inband tags then use the cache (if there is caching)
-		 * else bypass the cache.
+		/* If the chunk is in the cache copy it from there. Otherwise
+		 * read a whole chunk directly into the supplied buffer, and
+		 * anything else (part chunks, inband tags) via a temp buffer.
+		 *
+		 * Reads do not load chunks into the cache: they can run in
+		 * parallel under a shared lock, and grabbing a cache entry may
+		 * mean flushing another object's dirty data to flash.
 		 */
-		if (cache || n_copy != dev->data_bytes_per_chunk
-		    || dev->param.inband_tags) {
-			if (dev->param.n_caches > 0) {
-
-				/* If we can't find the data in the cache, then load it up. */
-
-				if (!cache) {
-					cache =
-					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
-					yaffs_rd_data_obj(in, chunk,
-							  cache->data);
-					cache->n_bytes = 0;
-				}
-
-				yaffs_use_cache(dev, cache, 0);
+		if (cache) {
+			yaffs_use_cache(dev, cache, 0);
+			memcpy(buffer, &cache->data[start], n_copy);
+		} else if (n_copy != dev->data_bytes_per_chunk
+			   || dev->param.inband_tags) {
+			/* Read into the local buffer then copy.. */
 
-				cache->locked = 1;
+			u8 *local_buffer =
+			    yaffs_get_temp_buffer(dev, __LINE__);
+			yaffs_rd_data_obj(in, chunk, local_buffer);
 
-				memcpy(buffer, &cache->data[start], n_copy);
-
-				cache->locked = 0;
-			} else {
-				/* Read into the local buffer then copy.. */
-
-				u8 *local_buffer =
-				    yaffs_get_temp_buffer(dev, __LINE__);
-				yaffs_rd_data_obj(in, chunk, local_buffer);
-
-				memcpy(buffer, &local_buffer[start], n_copy);
-
-				yaffs_release_temp_buffer(dev, local_buffer,
-							  __LINE__);
-			}
+			memcpy(buffer, &local_buffer[start], n_copy);
 
+			yaffs_release_temp_buffer(dev, local_buffer,
+						  __LINE__);
 		} else {
 
 			/* A full chunk. Read directly into the supplied buffer. */
@@ -3887,7 +3926,7 @@ int yaffs_resize_file(struct yaffs_obj *in, loff_t new_size)
 	yaffs_flush_file_cache(in);
 	yaffs_invalidate_whole_cache(in);
 
-	yaffs_check_gc(dev, 0);
+	yaffs_check_gc(dev, 0, YAFFS_GC_PASSIVE_COPIES);
 
 	if (in->variant_type != YAFFS_OBJECT_TYPE_FILE)
 		return YAFFS_FAIL;
@@ -4916,6 +4955,7 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->passive_gc_count = 0;
 	dev->oldest_dirty_gc_count = 0;
 	dev->bg_gcs = 0;
+	dev->fg_gcs = 0;
 	dev->gc_block_finder = 0;
 	dev->buffered_block = -1;
 	dev->doing_buffered_block_rewrite = 0;
@@ -4935,6 +4975,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->oldest_dirty_block = 0;
 
 	/* Initialise temporary buffers and caches. */
+	spin_lock_init(&dev->shared_lock);
+	mutex_init(&dev->load_lock);
 	if (!yaffs_init_tmp_buffers(dev))
 		init_failed = 1;
 
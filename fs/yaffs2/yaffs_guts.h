@@ -87,6 +87,16 @@
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
+/* Chunks a passive gc pass copies when called from a foreground write */
+#define YAFFS_GC_PASSIVE_COPIES		5
+
+/* gc_control flags */
+#define YAFFS_GC_CONTROL_ENABLE		0x1	/* gc may run at all */
+#define YAFFS_GC_CONTROL_BACKGROUND	0x2	/* background gc is running, the
+						 * foreground only gcs when it
+						 * has to
+						 */
+
 /* We limit the number attempts at sucessfully saving a chunk of data.
  * Small-page devices have 32 pages per block; large-page devices have 64.
  * Default to something in the order of 5 to 10 blocks worth of chunks.
@@ -559,9 +569,12 @@ struct yaffs_param {
 	/* Callback to mark the superblock dirty */
 	void (*sb_dirty_fn) (struct yaffs_dev * dev);
 
-	/*  Callback to control garbage collection. */
+	/*  Callback to control garbage collection, returns YAFFS_GC_CONTROL_xxx */
 	unsigned (*gc_control) (struct yaffs_dev * dev);
 
+	/* Callback to kick the background gc when erased space runs low */
+	void (*gc_wake_fn) (struct yaffs_dev * dev);
+
 	/* Debug control flags. Don't use unless you know what you're doing */
 	int use_header_file_size;	/* Flag to determine if we should use file sizes from the header */
 	int disable_lazy_load;	/* Disable lazy loading on this device */
@@ -695,6 +708,14 @@ struct yaffs_dev {
 	int n_unlinked_files;	/* Count of unlinked files. */
 	int n_bg_deletions;	/* Count of background deletions. */
 
+	/*
+	 * Readers may run in parallel under a shared os lock.  This protects
+	 * the little state they modify: temp buffers, cache LRU and chunk
+	 * error flags.
+	 */
+	spinlock_t shared_lock;
+	struct mutex load_lock;	/* Lazy loading of object headers */
+
 	/* Temporary buffer management */
 	struct yaffs_buffer temp_buffer[YAFFS_N_TEMP_BUFFERS];
 	int max_temp;
@@ -724,6 +745,7 @@ struct yaffs_dev {
 	u32 oldest_dirty_gc_count;
 	u32 n_gc_blocks;
 	u32 bg_gcs;
+	u32 fg_gcs;		/* gc passes a foreground operation waited for */
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
 	u32 n_ecc_fixed;
@@ -856,7 +878,7 @@ void yaffs_handle_defered_free(struct yaffs_obj *obj);
 
 void yaffs_update_dirty_dirs(struct yaffs_dev *dev);
 
-int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency);
+int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency, int max_copies);
 
 /* Debug dump  */
 int yaffs_dump_obj(struct yaffs_obj *obj);
@@ -24,14 +24,12 @@ struct yaffs_linux_context {
 	struct super_block *super;
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
-	struct mutex gross_lock;	/* Gross locking mutex*/
-	u8 *spare_buffer;	/* For mtdif2 use. Don't know the size of the buffer
-				 * at compile time so we have to allocate it.
-				 */
+	unsigned long last_active;	/* jiffies of last foreground access */
+	struct rw_semaphore gross_lock;	/* Gross lock, shared for reads */
 	struct list_head search_contexts;
+	spinlock_t search_lock;	/* Guards search_contexts for shared readdir */
 	void (*put_super_fn) (struct super_block * sb);
 
-	struct task_struct *readdir_process;
 	unsigned mount_id;
 };
 
@@ -96,6 +96,10 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_bg_gc_idle_ms = 200;
+unsigned int yaffs_bg_gc_chunks = 32;
+unsigned int yaffs_bg_gc_soft_pct = 50;
+unsigned int yaffs_bg_gc_hard_pct = 25;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -103,6 +107,46 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_bg_gc_idle_ms, uint, 0644);
+module_param(yaffs_bg_gc_chunks, uint, 0644);
+
+/*
+ * The hard threshold must not be above the soft one, otherwise the
+ * background gc would go straight from idle to urgent.
+ */
+static int yaffs_bg_gc_pct_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned int soft = yaffs_bg_gc_soft_pct;
+	unsigned int hard = yaffs_bg_gc_hard_pct;
+	unsigned int pct;
+	int ret;
+
+	ret = kstrtouint(val, 0, &pct);
+	if (ret)
+		return ret;
+	if (pct > 100)
+		return -EINVAL;
+
+	if (kp->arg == &yaffs_bg_gc_soft_pct)
+		soft = pct;
+	else
+		hard = pct;
+	if (hard > soft)
+		return -EINVAL;
+
+	*(unsigned int *)kp->arg = pct;
+	return 0;
+}
+
+static struct kernel_param_ops yaffs_bg_gc_pct_ops = {
+	.set = yaffs_bg_gc_pct_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(yaffs_bg_gc_soft_pct, &yaffs_bg_gc_pct_ops,
+		&yaffs_bg_gc_soft_pct, 0644);
+module_param_cb(yaffs_bg_gc_hard_pct, &yaffs_bg_gc_pct_ops,
+		&yaffs_bg_gc_hard_pct, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -115,22 +159,76 @@ module_param(yaffs_bg_enable, uint, 0644);
 		} while(0)
 
 
+/*
+ * While the background thread runs it does the passive gc, and writes only
+ * collect when they are about to run out of erased blocks.
+ */
 static unsigned yaffs_gc_control_callback(struct yaffs_dev *dev)
 {
-	return yaffs_gc_control;
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	unsigned control = yaffs_gc_control & YAFFS_GC_CONTROL_ENABLE;
+
+	if (context->bg_running && context->bg_thread && yaffs_bg_enable)
+		control |= YAFFS_GC_CONTROL_BACKGROUND;
+
+	return control;
 }
 
+static void yaffs_gc_wake_callback(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+
+	if (context->bg_thread)
+		wake_up_process(context->bg_thread);
+}
+
+/* Note foreground activity, the background gc waits for it to stop. */
+static inline void yaffs_mark_active(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+
+	if (current != context->bg_thread)
+		context->last_active = jiffies;
+}
+
+/*
+ * The gross lock is taken exclusively by anything that modifies the device:
+ * writes, namespace operations, GC, checkpointing.  Operations that only
+ * read (page reads, lookup, readdir, symlinks, statfs) take it shared and
+ * run in parallel.  The little state they touch in yaffs_guts is under
+ * dev->shared_lock, lazy loading of object headers under dev->load_lock.
+ *
+ * GC and the block allocator stay under the exclusive lock: moving a chunk
+ * rewrites the tnodes of whichever object owns it, so GC cannot run under
+ * per-object locks without taking them out of order.  The background
+ * thread instead collects in small passes and drops the lock in between.
+ */
 static void yaffs_gross_lock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
-	mutex_lock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	down_write(&(yaffs_dev_to_lc(dev)->gross_lock));
+	yaffs_mark_active(dev);
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked %p", current);
 }
 
 static void yaffs_gross_unlock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
-	mutex_unlock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	up_write(&(yaffs_dev_to_lc(dev)->gross_lock));
+}
+
+static void yaffs_gross_lock_shared(struct yaffs_dev *dev)
+{
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking shared %p", current);
+	down_read(&(yaffs_dev_to_lc(dev)->gross_lock));
+	yaffs_mark_active(dev);
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked shared %p", current);
+}
+
+static void yaffs_gross_unlock_shared(struct yaffs_dev *dev)
+{
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking shared %p", current);
+	up_read(&(yaffs_dev_to_lc(dev)->gross_lock));
 }
 
 static void yaffs_fill_inode_from_obj(struct inode *inode,
@@ -372,8 +470,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry,
 
 	struct yaffs_dev *dev = yaffs_inode_to_obj(dir)->my_dev;
 
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_lookup for %d:%s",
@@ -384,8 +481,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry,
 	obj = yaffs_get_equivalent_obj(obj);	/* in case it was a hardlink */
 
 	/* Can't hold gross lock when calling yaffs_get_inode() */
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (obj) {
 		yaffs_trace(YAFFS_TRACE_OS,
@@ -727,7 +823,9 @@ static struct yaffs_search_context *yaffs_new_search(struct yaffs_obj *dir)
 			    list_entry(dir->variant.dir_variant.children.next,
 				       struct yaffs_obj, siblings);
 		INIT_LIST_HEAD(&sc->others);
+		spin_lock(&(yaffs_dev_to_lc(dev)->search_lock));
 		list_add(&sc->others, &(yaffs_dev_to_lc(dev)->search_contexts));
+		spin_unlock(&(yaffs_dev_to_lc(dev)->search_lock));
 	}
 	return sc;
 }
@@ -738,7 +836,9 @@ static struct yaffs_search_context *yaffs_new_search(struct yaffs_obj *dir)
 static void yaffs_search_end(struct yaffs_search_context *sc)
 {
 	if (sc) {
+		spin_lock(&(yaffs_dev_to_lc(sc->dev)->search_lock));
 		list_del(&sc->others);
+		spin_unlock(&(yaffs_dev_to_lc(sc->dev)->search_lock));
 		kfree(sc);
 	}
 }
@@ -784,6 +884,7 @@ static void yaffs_remove_obj_callback(struct yaffs_obj *obj)
 	 * If any are currently on the object being removed, then advance
 	 * the search context to the next object to prevent a hanging pointer.
 	 */
+	spin_lock(&(yaffs_dev_to_lc(obj->my_dev)->search_lock));
 	list_for_each(i, search_contexts) {
 		if (i) {
 			sc = list_entry(i, struct yaffs_search_context, others);
@@ -791,6 +892,7 @@ static void yaffs_remove_obj_callback(struct yaffs_obj *obj)
 				yaffs_search_advance(sc);
 		}
 	}
+	spin_unlock(&(yaffs_dev_to_lc(obj->my_dev)->search_lock));
 
 }
 
@@ -809,9 +911,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
-
-	yaffs_dev_to_lc(dev)->readdir_process = current;
+	yaffs_gross_lock_shared(dev);
 
 	offset = f->f_pos;
 
@@ -828,12 +928,12 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry . ino %d",
 			(int)inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_gross_unlock_shared(dev);
 		if (filldir(dirent, ".", 1, offset, inode->i_ino, DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_gross_lock_shared(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_gross_lock_shared(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -841,14 +941,14 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry .. ino %d",
 			(int)f->f_dentry->d_parent->d_inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_gross_unlock_shared(dev);
 		if (filldir(dirent, "..", 2, offset,
 			    f->f_dentry->d_parent->d_inode->i_ino,
 			    DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_gross_lock_shared(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_gross_lock_shared(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -875,17 +975,17 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 				"yaffs_readdir: %s inode %d",
 				name, yaffs_get_obj_inode(l));
 
-			yaffs_gross_unlock(dev);
+			yaffs_gross_unlock_shared(dev);
 
 			if (filldir(dirent,
 				    name,
 				    strlen(name),
 				    offset, this_inode, this_type) < 0) {
-				yaffs_gross_lock(dev);
+				yaffs_gross_lock_shared(dev);
 				goto out;
 			}
 
-			yaffs_gross_lock(dev);
+			yaffs_gross_lock_shared(dev);
 
 			offset++;
 			f->f_pos++;
@@ -895,8 +995,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 out:
 	yaffs_search_end(sc);
-	yaffs_dev_to_lc(dev)->readdir_process = NULL;
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	return ret_val;
 }
@@ -1020,11 +1119,11 @@ static int yaffs_readlink(struct dentry *dentry, char __user * buffer,
 
 	struct yaffs_dev *dev = yaffs_dentry_to_obj(dentry)->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	alias = yaffs_get_symlink_alias(yaffs_dentry_to_obj(dentry));
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (!alias)
 		return -ENOMEM;
@@ -1040,10 +1139,10 @@ static void *yaffs_follow_link(struct dentry *dentry, struct nameidata *nd)
 	void *ret;
 	struct yaffs_dev *dev = yaffs_dentry_to_obj(dentry)->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	alias = yaffs_get_symlink_alias(yaffs_dentry_to_obj(dentry));
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (!alias) {
 		ret = ERR_PTR(-ENOMEM);
@@ -1148,12 +1247,12 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	ret = yaffs_file_rd(obj, pg_buf,
 			    pg->index << PAGE_CACHE_SHIFT, PAGE_CACHE_SIZE);
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	if (ret >= 0)
 		ret = 0;
@@ -1290,11 +1389,11 @@ static ssize_t yaffs_hold_space(struct file *f)
 
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	n_free_chunks = yaffs_get_n_free_chunks(dev);
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 
 	return (n_free_chunks > 20) ? 1 : 0;
 }
@@ -1461,7 +1560,7 @@ static int yaffs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_statfs");
 
-	yaffs_gross_lock(dev);
+	yaffs_gross_lock_shared(dev);
 
 	buf->f_type = YAFFS_MAGIC;
 	buf->f_bsize = sb->s_blocksize;
@@ -1513,7 +1612,7 @@ static int yaffs_statfs(struct dentry *dentry, struct kstatfs *buf)
 	buf->f_ffree = 0;
 	buf->f_bavail = buf->f_bfree;
 
-	yaffs_gross_unlock(dev);
+	yaffs_gross_unlock_shared(dev);
 	return 0;
 }
 
@@ -1559,9 +1658,11 @@ static unsigned yaffs_bg_gc_urgency(struct yaffs_dev *dev)
 		return 0;
 	else if (scattered < (dev->param.chunks_per_block * 2))
 		return 0;
-	else if (erased_chunks > dev->n_free_chunks / 2)
+	else if (erased_chunks >
+		 dev->n_free_chunks * yaffs_bg_gc_soft_pct / 100)
 		return 0;
-	else if (erased_chunks > dev->n_free_chunks / 4)
+	else if (erased_chunks >
+		 dev->n_free_chunks * yaffs_bg_gc_hard_pct / 100)
 		return 1;
 	else
 		return 2;
@@ -1622,9 +1723,12 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long next_dir_update = now;
 	unsigned long next_gc = now;
 	unsigned long expires;
+	unsigned long idle_at;
 	unsigned int urgency;
+	unsigned int all_gcs;
+	int progress;
+	int idle;
 
-	int gc_result;
 	struct timer_list timer;
 
 	yaffs_trace(YAFFS_TRACE_BACKGROUND,
@@ -1651,12 +1755,31 @@ static int yaffs_bg_thread_fn(void *data)
 
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
+				/*
+				 * Collect in small passes, dropping the lock
+				 * in between.  Back to back while nobody else
+				 * uses the device, paced while it is busy,
+				 * and backed off when a pass frees nothing.
+				 */
+				idle_at = context->last_active +
+				    msecs_to_jiffies(yaffs_bg_gc_idle_ms);
+				idle = !time_before(now, idle_at);
 				urgency = yaffs_bg_gc_urgency(dev);
-				gc_result = yaffs_bg_gc(dev, urgency);
-				if (urgency > 1)
+				progress = 0;
+				if (idle || urgency > 0) {
+					all_gcs = dev->all_gcs;
+					yaffs_bg_gc(dev, urgency,
+						yaffs_bg_gc_chunks ?
+						yaffs_bg_gc_chunks : 1);
+					progress = (dev->all_gcs != all_gcs);
+					urgency = yaffs_bg_gc_urgency(dev);
+				}
+				if (urgency > 0 && idle && progress)
+					next_gc = now;
+				else if (urgency > 1)
 					next_gc = now + HZ / 20 + 1;
 				else if (urgency > 0)
-					next_gc = now + HZ / 10 + 1;
+					next_gc = now + HZ / 5 + 1;
 				else
 					next_gc = now + HZ * 2;
 			} else	{
@@ -1979,11 +2102,6 @@ static void yaffs_put_super(struct super_block *sb)
 	list_del_init(&(yaffs_dev_to_lc(dev)->context_list));
 	mutex_unlock(&yaffs_context_lock);
 
-	if (yaffs_dev_to_lc(dev)->spare_buffer) {
-		kfree(yaffs_dev_to_lc(dev)->spare_buffer);
-		yaffs_dev_to_lc(dev)->spare_buffer = NULL;
-	}
-
 	kfree(dev);
 }
 
@@ -2261,8 +2379,6 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 		param->read_chunk_tags_fn = nandmtd2_read_chunk_tags;
 		param->bad_block_fn = nandmtd2_mark_block_bad;
 		param->query_block_fn = nandmtd2_query_block;
-		yaffs_dev_to_lc(dev)->spare_buffer = 
-		                kmalloc(mtd->oobsize, GFP_NOFS);
 		param->is_yaffs2 = 1;
 		param->total_bytes_per_chunk = mtd->writesize;
 		param->chunks_per_block = mtd->erasesize / mtd->writesize;
@@ -2286,6 +2402,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	param->sb_dirty_fn = yaffs_touch_super;
 	param->gc_control = yaffs_gc_control_callback;
+	param->gc_wake_fn = yaffs_gc_wake_callback;
 
 	yaffs_dev_to_lc(dev)->super = sb;
 
@@ -2317,9 +2434,11 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	/* Directory search handling... */
 	INIT_LIST_HEAD(&(yaffs_dev_to_lc(dev)->search_contexts));
+	spin_lock_init(&(yaffs_dev_to_lc(dev)->search_lock));
 	param->remove_obj_fn = yaffs_remove_obj_callback;
 
-	mutex_init(&(yaffs_dev_to_lc(dev)->gross_lock));
+	init_rwsem(&(yaffs_dev_to_lc(dev)->gross_lock));
+	yaffs_dev_to_lc(dev)->last_active = jiffies;
 
 	yaffs_gross_lock(dev);
 
@@ -2472,6 +2591,7 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf += sprintf(buf, "fg_gcs................ %u\n", dev->fg_gcs);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
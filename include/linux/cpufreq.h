@@ -360,6 +360,18 @@ extern struct cpufreq_governor cpufreq_gov_interactive;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_interactive)
 #endif
 
+/*
+ * Utilization hook for the scheduler-driven governor, called from the
+ * fair class with the rq lock held. util is scaled to SCHED_LOAD_SCALE.
+ */
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+void cpufreq_sched_update(int cpu, unsigned long util);
+#else
+static inline void cpufreq_sched_update(int cpu, unsigned long util)
+{
+}
+#endif
+
 
 /*********************************************************************
  *                     FREQUENCY TABLE HELPERS                       *
@@ -58,6 +58,12 @@ struct mmc_ext_csd {
 	bool			enhanced_area_en;	/* enable bit */
 	unsigned long long	enhanced_area_offset;	/* Units: Byte */
 	unsigned int		enhanced_area_size;	/* Units: KB */
+	unsigned int		cache_size;		/* Units: KB */
+	bool			cache_ctrl;		/* cache enabled */
+	u8			rel_param;
+	u8			max_packed_writes;
+	u8			max_packed_reads;
+	u8			data_sector_size;	/* 0: 512 bytes */
 };
 
 struct sd_scr {
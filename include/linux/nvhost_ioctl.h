@@ -164,6 +164,23 @@ struct nvhost_ctrl_module_regrdwr_args {
 	__u32 write;
 };
 
+struct nvhost_ctrl_sync_fence_info {
+	__u32 id;
+	__u32 thresh;
+};
+
+struct nvhost_ctrl_sync_fence_create_args {
+	__u32 num_pts;
+	struct nvhost_ctrl_sync_fence_info *pts;
+	__s32 fence_fd;
+};
+
+struct nvhost_ctrl_sync_fence_merge_args {
+	__s32 fd1;
+	__s32 fd2;
+	__s32 fence_fd;
+};
+
 #define NVHOST_IOCTL_CTRL_SYNCPT_READ		\
 	_IOWR(NVHOST_IOCTL_MAGIC, 1, struct nvhost_ctrl_syncpt_read_args)
 #define NVHOST_IOCTL_CTRL_SYNCPT_INCR		\
@@ -179,8 +196,13 @@ struct nvhost_ctrl_module_regrdwr_args {
 #define NVHOST_IOCTL_CTRL_SYNCPT_WAITEX		\
 	_IOWR(NVHOST_IOCTL_MAGIC, 6, struct nvhost_ctrl_syncpt_waitex_args)
 
+#define NVHOST_IOCTL_CTRL_SYNC_FENCE_CREATE	\
+	_IOWR(NVHOST_IOCTL_MAGIC, 7, struct nvhost_ctrl_sync_fence_create_args)
+#define NVHOST_IOCTL_CTRL_SYNC_FENCE_MERGE	\
+	_IOWR(NVHOST_IOCTL_MAGIC, 8, struct nvhost_ctrl_sync_fence_merge_args)
+
 #define NVHOST_IOCTL_CTRL_LAST			\
-	_IOC_NR(NVHOST_IOCTL_CTRL_SYNCPT_WAITEX)
+	_IOC_NR(NVHOST_IOCTL_CTRL_SYNC_FENCE_MERGE)
 #define NVHOST_IOCTL_CTRL_MAX_ARG_SIZE	\
 	sizeof(struct nvhost_ctrl_module_regrdwr_args)
 
@@ -1152,6 +1152,14 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+#ifdef CONFIG_SCHED_UTIL
+	/* running fraction of this task, scaled to SCHED_LOAD_SCALE */
+	u64			util_last;
+	u64			util_exec;
+	unsigned long		util_avg;
+	unsigned long		util_contrib;	/* share in rq->util_runnable */
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
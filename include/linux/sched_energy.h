@@ -0,0 +1,50 @@
+#ifndef _LINUX_SCHED_ENERGY_H
+#define _LINUX_SCHED_ENERGY_H
+
+/*
+ * Platform energy model for task placement.
+ *
+ * Capacities are scaled so that SCHED_LOAD_SCALE is the fastest operating
+ * point of the system, power is the busy power of one cpu at that
+ * operating point in mW. Operating points are sorted by capacity.
+ */
+struct sched_energy_opp {
+	unsigned long cap;
+	unsigned long power;
+};
+
+struct sched_energy_cluster {
+	const char *name;
+	int nr_opp;
+	struct sched_energy_opp *opp;
+	unsigned long cap_max;		/* thermal/EDP limit, may change */
+};
+
+struct sched_energy_model {
+	/*
+	 * Cluster cpu runs on now, and capacity at its current operating
+	 * point. Called with preemption off, with or without a rq lock held
+	 * and for any cpu, so they must not sleep or take locks.
+	 */
+	struct sched_energy_cluster *(*cpu_cluster)(int cpu);
+	unsigned long (*cpu_cap)(int cpu);
+	/*
+	 * A task on cpu needs more than its cluster can give. Called with
+	 * the rq lock held and interrupts off, so it must not wake anything.
+	 */
+	void (*overutilized)(int cpu, unsigned long demand);
+};
+
+#ifdef CONFIG_SCHED_ENERGY
+void sched_energy_register(const struct sched_energy_model *em);
+unsigned long sched_cpu_util(int cpu);
+unsigned long sched_energy_cost(struct sched_energy_cluster *cl,
+				unsigned long max_demand,
+				unsigned long sum_demand);
+#else
+static inline void sched_energy_register(const struct sched_energy_model *em)
+{
+}
+#endif
+
+#endif /* _LINUX_SCHED_ENERGY_H */
@@ -66,14 +66,30 @@ struct tegra_overlay_flip_args {
 	__u32 flags;
 };
 
+/*
+ * Timestamps of a flip that has reached the screen, looked up by the
+ * post_syncpt_val returned from TEGRA_OVERLAY_IOCTL_FLIP.  Times are
+ * CLOCK_MONOTONIC nanoseconds: when the flip was queued to the display,
+ * when its window state was programmed, and the vblank it was latched in.
+ * Only the most recent flips are kept; older ones return -ENOENT.
+ */
+struct tegra_overlay_flip_times {
+	__u32 post_syncpt_val;
+	__s32 err;
+	__s64 queued_ns;
+	__s64 programmed_ns;
+	__s64 latched_ns;
+};
+
 #define TEGRA_OVERLAY_IOCTL_MAGIC		'O'
 
 #define TEGRA_OVERLAY_IOCTL_OPEN_WINDOW		_IOWR(TEGRA_OVERLAY_IOCTL_MAGIC, 0x40, __u32)
 #define TEGRA_OVERLAY_IOCTL_CLOSE_WINDOW	_IOW(TEGRA_OVERLAY_IOCTL_MAGIC, 0x41, __u32)
 #define TEGRA_OVERLAY_IOCTL_FLIP		_IOW(TEGRA_OVERLAY_IOCTL_MAGIC, 0x42, struct tegra_overlay_flip_args)
 #define TEGRA_OVERLAY_IOCTL_SET_NVMAP_FD	_IOW(TEGRA_OVERLAY_IOCTL_MAGIC, 0x43, __u32)
+#define TEGRA_OVERLAY_IOCTL_GET_FLIP_TIMES	_IOWR(TEGRA_OVERLAY_IOCTL_MAGIC, 0x44, struct tegra_overlay_flip_times)
 
 #define TEGRA_OVERLAY_IOCTL_MIN_NR		_IOC_NR(TEGRA_OVERLAY_IOCTL_OPEN_WINDOW)
-#define TEGRA_OVERLAY_IOCTL_MAX_NR		_IOC_NR(TEGRA_OVERLAY_IOCTL_SET_NVMAP_FD)
+#define TEGRA_OVERLAY_IOCTL_MAX_NR		_IOC_NR(TEGRA_OVERLAY_IOCTL_GET_FLIP_TIMES)
 
 #endif
@@ -287,6 +287,45 @@ TRACE_EVENT(nvhost_ioctl_ctrl_syncpt_wait,
 	  __entry->id, __entry->threshold, __entry->timeout)
 );
 
+TRACE_EVENT(nvhost_ioctl_ctrl_sync_fence_create,
+	TP_PROTO(u32 num_pts, u32 id, u32 threshold),
+
+	TP_ARGS(num_pts, id, threshold),
+
+	TP_STRUCT__entry(
+		__field(u32, num_pts)
+		__field(u32, id)
+		__field(u32, threshold)
+	),
+
+	TP_fast_assign(
+		__entry->num_pts = num_pts;
+		__entry->id = id;
+		__entry->threshold = threshold;
+	),
+
+	TP_printk("num_pts=%u, id=%u, threshold=%u",
+	  __entry->num_pts, __entry->id, __entry->threshold)
+);
+
+TRACE_EVENT(nvhost_ioctl_ctrl_sync_fence_merge,
+	TP_PROTO(int fd1, int fd2),
+
+	TP_ARGS(fd1, fd2),
+
+	TP_STRUCT__entry(
+		__field(int, fd1)
+		__field(int, fd2)
+	),
+
+	TP_fast_assign(
+		__entry->fd1 = fd1;
+		__entry->fd2 = fd2;
+	),
+
+	TP_printk("fd1=%d, fd2=%d", __entry->fd1, __entry->fd2)
+);
+
 TRACE_EVENT(nvhost_channel_submitted,
 	TP_PROTO(const char *name, u32 syncpt_base, u32 syncpt_max),
 
@@ -0,0 +1,86 @@
+/*
+ * include/trace/events/tegra_hotplug.h
+ *
+ * Tegra3 CPU auto-hotplug event logging to ftrace.
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tegra_hotplug
+
+#if !defined(_TRACE_TEGRA_HOTPLUG_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_TEGRA_HOTPLUG_H
+
+#include <linux/tracepoint.h>
+
+/* one evaluation of the hotplug work, cpu is nr_cpu_ids if nothing to do */
+TRACE_EVENT(tegra_hotplug_decision,
+	TP_PROTO(int state, unsigned int nr_run_avg, int nr_run,
+		 int speed, unsigned int cpu, bool up),
+	TP_ARGS(state, nr_run_avg, nr_run, speed, cpu, up),
+
+	TP_STRUCT__entry(
+		__field(int, state)
+		__field(unsigned int, nr_run_avg)
+		__field(int, nr_run)
+		__field(int, speed)
+		__field(unsigned int, cpu)
+		__field(bool, up)
+	),
+
+	TP_fast_assign(
+		__entry->state = state;
+		__entry->nr_run_avg = nr_run_avg;
+		__entry->nr_run = nr_run;
+		__entry->speed = speed;
+		__entry->cpu = cpu;
+		__entry->up = up;
+	),
+
+	TP_printk("state=%d nr_run_avg=%u.%02u nr_run=%d speed=%d cpu=%u %s",
+		  __entry->state, __entry->nr_run_avg / 100,
+		  __entry->nr_run_avg % 100, __entry->nr_run, __entry->speed,
+		  __entry->cpu, __entry->up ? "up" : "down")
+);
+
+/* cpu is CONFIG_NR_CPUS for the LP cluster */
+TRACE_EVENT(tegra_hotplug_done,
+	TP_PROTO(unsigned int cpu, bool up, u32 latency_us),
+	TP_ARGS(cpu, up, latency_us),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, cpu)
+		__field(bool, up)
+		__field(u32, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->up = up;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk("cpu=%u %s latency=%uus",
+		  __entry->cpu, __entry->up ? "up" : "down",
+		  __entry->latency_us)
+);
+
+#endif /* _TRACE_TEGRA_HOTPLUG_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -72,6 +72,7 @@
 #include <linux/ftrace.h>
 #include <linux/slab.h>
 #include <linux/cpuacct.h>
+#include <linux/cpufreq.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -471,6 +472,13 @@ struct rq {
 	struct cfs_rq cfs;
 	struct rt_rq rt;
 
+#ifdef CONFIG_SCHED_UTIL
+	/* cfs utilization for cpufreq and energy aware placement */
+	unsigned long util_runnable;
+	unsigned long util_busy;
+	u64 util_last;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -2611,6 +2619,13 @@ static void __sched_fork(struct task_struct *p)
 	p->se.nr_migrations		= 0;
 	p->se.vruntime			= 0;
 
+#ifdef CONFIG_SCHED_UTIL
+	/* util_avg is inherited so a busy parent's child starts out busy */
+	p->se.util_last			= 0;
+	p->se.util_exec			= 0;
+	p->se.util_contrib		= 0;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
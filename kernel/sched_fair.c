@@ -23,6 +23,7 @@
 #include <linux/latencytop.h>
 #include <linux/sched.h>
 #include <linux/cpumask.h>
+#include <linux/sched_energy.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -1315,6 +1316,160 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+#ifdef CONFIG_SCHED_UTIL
+/*
+ * Utilization tracking for the sched cpufreq governor and energy aware
+ * task placement.
+ *
+ * Each task keeps a running average of the fraction of wall time it
+ * spent executing, and the rq keeps the sum of those averages over its
+ * runnable cfs tasks plus an average of how long it had any cfs work at
+ * all. Both are scaled to SCHED_LOAD_SCALE and refreshed on enqueue,
+ * dequeue and tick, with rq->lock held, and the larger of the two is
+ * the utilization of the cpu. The averages are weighted by elapsed time
+ * against a UTIL_AVG_PERIOD window, in ~usecs so the math stays 32 bit.
+ */
+#define UTIL_AVG_PERIOD		(32 * USEC_PER_MSEC)
+#define UTIL_AVG_MAX_DELTA	(4 * UTIL_AVG_PERIOD)
+
+static unsigned long util_avg_update(unsigned long avg, u64 ran, u64 delta)
+{
+	u32 d = min_t(u64, delta >> 10, UTIL_AVG_MAX_DELTA);
+	u32 r = min_t(u64, ran >> 10, d);
+
+	if (!d)
+		return avg;
+
+	return (avg * UTIL_AVG_PERIOD + (r << SCHED_LOAD_SHIFT)) /
+		(UTIL_AVG_PERIOD + d);
+}
+
+/* account the time since the last update with the current busy state */
+static void update_rq_util(struct rq *rq)
+{
+	u64 now = rq->clock_task;
+	s64 delta = now - rq->util_last;
+
+	if (delta <= 0) {
+		rq->util_last = now;
+		return;
+	}
+
+	rq->util_busy = util_avg_update(rq->util_busy,
+			rq->cfs.nr_running ? delta : 0, delta);
+	rq->util_last = now;
+}
+
+static inline unsigned long rq_util(struct rq *rq)
+{
+	return max_t(unsigned long, rq->util_busy,
+		     min_t(unsigned long, rq->util_runnable, SCHED_LOAD_SCALE));
+}
+
+#ifdef CONFIG_SCHED_ENERGY
+static const struct sched_energy_model *sched_em;
+
+/* % of a cluster's capacity a task or cpu may use before it is too small */
+static unsigned int sched_energy_margin = 80;
+
+void sched_energy_register(const struct sched_energy_model *em)
+{
+	rcu_assign_pointer(sched_em, em);
+}
+
+unsigned long sched_cpu_util(int cpu)
+{
+	return rq_util(cpu_rq(cpu));
+}
+
+/*
+ * Busy energy of a cluster whose cpus together need sum_demand and the
+ * busiest max_demand: the cluster runs at the lowest operating point that
+ * fits max_demand and each cpu is busy demand/cap of the time there. Idle
+ * cpus are power gated and counted as free.
+ */
+unsigned long sched_energy_cost(struct sched_energy_cluster *cl,
+				unsigned long max_demand,
+				unsigned long sum_demand)
+{
+	struct sched_energy_opp *opp;
+	int i;
+
+	for (i = 0; i < cl->nr_opp - 1; i++)
+		if (cl->opp[i].cap >= max_demand)
+			break;
+	opp = &cl->opp[i];
+
+	return opp->power * sum_demand / opp->cap;
+}
+
+/* frequency invariant demand: utilization times the capacity it ran at */
+static inline unsigned long
+energy_demand(const struct sched_energy_model *em, int cpu,
+	      unsigned long util)
+{
+	return (util * em->cpu_cap(cpu)) >> SCHED_LOAD_SHIFT;
+}
+
+static void energy_check_task(struct rq *rq, struct task_struct *p)
+{
+	const struct sched_energy_model *em = rcu_dereference_sched(sched_em);
+	struct sched_energy_cluster *cl;
+	unsigned long demand;
+	int cpu = cpu_of(rq);
+
+	if (!em)
+		return;
+
+	cl = em->cpu_cluster(cpu);
+	demand = energy_demand(em, cpu, p->se.util_avg);
+	if (demand * 100 > cl->cap_max * sched_energy_margin)
+		em->overutilized(cpu, demand);
+}
+#else
+static inline void energy_check_task(struct rq *rq, struct task_struct *p)
+{
+}
+#endif
+
+static void update_task_util(struct rq *rq, struct task_struct *p,
+			     bool runnable)
+{
+	struct sched_entity *se = &p->se;
+	u64 now = rq->clock_task;
+	s64 delta = now - se->util_last;
+
+	/* first run after fork, or clocks of two rqs out of step */
+	if (!se->util_last || delta <= 0) {
+		se->util_last = now;
+		se->util_exec = se->sum_exec_runtime;
+	} else {
+		se->util_avg = util_avg_update(se->util_avg,
+				se->sum_exec_runtime - se->util_exec, delta);
+		se->util_last = now;
+		se->util_exec = se->sum_exec_runtime;
+	}
+
+	rq->util_runnable -= se->util_contrib;
+	se->util_contrib = runnable ? se->util_avg : 0;
+	rq->util_runnable += se->util_contrib;
+
+	if (runnable)
+		energy_check_task(rq, p);
+
+	cpufreq_sched_update(cpu_of(rq), rq_util(rq));
+}
+#else
+static inline void update_rq_util(struct rq *rq)
+{
+}
+
+static inline void update_task_util(struct rq *rq, struct task_struct *p,
+				    bool runnable)
+{
+}
+#endif
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -1326,6 +1481,8 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	update_rq_util(rq);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -1341,6 +1498,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	update_task_util(rq, p, true);
 	hrtick_update(rq);
 }
 
@@ -1354,6 +1512,8 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	update_rq_util(rq);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, flags);
@@ -1371,6 +1531,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	update_task_util(rq, p, false);
 	hrtick_update(rq);
 }
 
@@ -1649,6 +1810,62 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	return target;
 }
 
+#ifdef CONFIG_SCHED_ENERGY
+/*
+ * Wake a task up on the cpu where it adds the least busy energy. When
+ * the task would take some cpu past sched_energy_margin of its cluster's
+ * capacity, spreading is what helps and the usual wakeup balancing
+ * decides instead: -1 is returned.
+ */
+static int energy_aware_cpu(struct task_struct *p, int prev_cpu)
+{
+	const struct sched_energy_model *em = rcu_dereference_sched(sched_em);
+	struct sched_energy_cluster *cl;
+	unsigned long task_demand, d, delta, best_delta = ULONG_MAX;
+	unsigned long max_old, sum_old, max_new;
+	int cpu, i, best_cpu = -1;
+
+	if (!em)
+		return -1;
+
+	task_demand = energy_demand(em, prev_cpu, p->se.util_avg);
+
+	for_each_cpu_and(cpu, cpu_online_mask, &p->cpus_allowed) {
+		cl = em->cpu_cluster(cpu);
+		max_old = sum_old = max_new = 0;
+
+		for_each_cpu(i, cpu_online_mask) {
+			if (em->cpu_cluster(i) != cl)
+				continue;
+			d = energy_demand(em, i, sched_cpu_util(i));
+			max_old = max(max_old, d);
+			sum_old += d;
+			if (i == cpu)
+				d += task_demand;
+			max_new = max(max_new, d);
+		}
+
+		if (max_new * 100 > cl->cap_max * sched_energy_margin)
+			return -1;
+
+		delta = sched_energy_cost(cl, max_new, sum_old + task_demand) -
+			sched_energy_cost(cl, max_old, sum_old);
+		if ((delta < best_delta) ||
+		    ((delta == best_delta) && (cpu == prev_cpu))) {
+			best_delta = delta;
+			best_cpu = cpu;
+		}
+	}
+
+	return best_cpu;
+}
+#else
+static inline int energy_aware_cpu(struct task_struct *p, int prev_cpu)
+{
+	return -1;
+}
+#endif
+
 /*
  * sched_balance_self: balance the current task (running on cpu) in domains
  * that have the 'flag' flag set. In practice, this is SD_BALANCE_FORK and
@@ -1672,6 +1889,10 @@ select_task_rq_fair(struct rq *rq, struct task_struct *p, int sd_flag, int wake_
 	int sync = wake_flags & WF_SYNC;
 
 	if (sd_flag & SD_BALANCE_WAKE) {
+		new_cpu = energy_aware_cpu(p, prev_cpu);
+		if (new_cpu >= 0)
+			return new_cpu;
+
 		if (cpumask_test_cpu(cpu, &p->cpus_allowed))
 			want_affine = 1;
 		new_cpu = prev_cpu;
@@ -4069,10 +4290,14 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &curr->se;
 
+	update_rq_util(rq);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_task_util(rq, curr, true);
 }
 
 /*
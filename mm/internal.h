@@ -251,6 +251,25 @@ static inline void mminit_validate_memmodel_limits(unsigned long *start_pfn,
 #define ZONE_RECLAIM_SUCCESS	1
 #endif
 
+#ifdef CONFIG_READAHEAD_PROFILE
+extern int ra_profile_capturing;
+extern void __ra_profile_record(struct address_space *mapping,
+		struct file *filp, pgoff_t offset, unsigned long nr_pages);
+
+/* note a range readahead read from disk, while a profile is captured */
+static inline void ra_profile_record(struct address_space *mapping,
+		struct file *filp, pgoff_t offset, unsigned long nr_pages)
+{
+	if (unlikely(ra_profile_capturing))
+		__ra_profile_record(mapping, filp, offset, nr_pages);
+}
+#else
+static inline void ra_profile_record(struct address_space *mapping,
+		struct file *filp, pgoff_t offset, unsigned long nr_pages)
+{
+}
+#endif
+
 extern int hwpoison_filter(struct page *p);
 
 extern u32 hwpoison_filter_dev_major;
@@ -18,6 +18,8 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#include "internal.h"
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -158,6 +160,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	LIST_HEAD(page_pool);
 	int page_idx;
 	int ret = 0;
+	pgoff_t first = 0, last = 0;	/* pages read from disk */
 	loff_t isize = i_size_read(inode);
 
 	if (isize == 0)
@@ -187,6 +190,9 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
+		if (!ret)
+			first = page_offset;
+		last = page_offset;
 		ret++;
 	}
 
@@ -195,8 +201,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		ra_profile_record(mapping, filp, first, last - first + 1);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
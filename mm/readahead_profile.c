@@ -0,0 +1,696 @@
+/*
+ * mm/readahead_profile.c - record the file ranges read during boot and
+ * read them ahead on the next one.
+ *
+ * While a capture runs, every range readahead reads from disk is noted
+ * against its file.  When the capture stops the ranges are sorted and
+ * merged per file, and /proc/readahead/profile returns them as a compact
+ * binary profile.  Writing a profile back to that file early in a later
+ * boot starts a kernel thread which, file by file in the order they were
+ * first read, submits all of a file's ranges as one plugged batch of
+ * asynchronous readahead.
+ *
+ * See Documentation/vm/readahead-profile.txt.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/proc_fs.h>
+#include <linux/uaccess.h>
+#include <linux/blkdev.h>
+#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
+#include <linux/path.h>
+#include <linux/dcache.h>
+#include <linux/file.h>
+
+#include "internal.h"
+
+#define RA_PROFILE_MAGIC	0x46505241	/* "ARPF" */
+#define RA_PROFILE_VERSION	1
+
+#define RA_PROFILE_MAX_FILES	4096
+#define RA_PROFILE_MAX_RANGES	32768
+#define RA_PROFILE_HASH_BITS	13		/* 2 * RA_PROFILE_MAX_FILES */
+#define RA_PROFILE_MAX_SIZE	(4 << 20)	/* largest profile accepted */
+
+/*
+ * The profile, little endian and packed:
+ *
+ *	struct ra_profile_header
+ *	for each file, in the order the files were first read:
+ *		struct ra_profile_file_rec
+ *		path_len bytes of absolute path, not terminated
+ *		nr_ranges struct ra_profile_range_rec, sorted, not overlapping
+ */
+struct ra_profile_header {
+	__le32	magic;
+	__le16	version;
+	__le16	reserved;
+	__le32	nr_files;
+	__le32	nr_ranges;
+} __attribute__((packed));
+
+struct ra_profile_file_rec {
+	__le64	ino;		/* to tell whether the file is still the same */
+	__le64	size;
+	__le32	nr_ranges;
+	__le16	path_len;
+} __attribute__((packed));
+
+struct ra_profile_range_rec {
+	__le32	start;		/* in pages */
+	__le32	nr_pages;
+} __attribute__((packed));
+
+/* capture state */
+struct ra_profile_file {
+	struct path	path;
+	struct inode	*inode;
+	loff_t		size;
+	char		*name;
+};
+
+struct ra_profile_range {
+	u32		file;
+	u32		start;
+	u32		nr_pages;
+};
+
+int ra_profile_capturing;
+
+static DEFINE_SPINLOCK(ra_profile_lock);	/* the capture tables */
+static DEFINE_MUTEX(ra_profile_mutex);		/* everything else */
+
+static struct ra_profile_file *ra_files;
+static struct ra_profile_range *ra_ranges;
+static unsigned int *ra_hash;			/* file index + 1 */
+static unsigned int ra_nr_files;
+static unsigned int ra_nr_ranges;
+static unsigned long ra_dropped;
+
+/* the profile of the last capture */
+static void *ra_export;
+static size_t ra_export_size;
+
+/* a profile being written, and its replay */
+static int ra_loading;
+static void *ra_load;
+static size_t ra_load_size;
+static size_t ra_load_alloc;
+static struct task_struct *ra_replay_task;
+static unsigned int ra_replay_files;
+static unsigned int ra_replay_stale;
+static unsigned long ra_replay_pages;
+
+static unsigned int ra_capture_secs;
+static void ra_profile_stop_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ra_profile_stop_work, ra_profile_stop_work_fn);
+
+/*
+ * Called by readahead for each range it read pages of while capturing.
+ */
+void __ra_profile_record(struct address_space *mapping, struct file *filp,
+		pgoff_t offset, unsigned long nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct ra_profile_file *f;
+	struct ra_profile_range *r;
+	unsigned long h;
+	unsigned int i, file;
+	u32 end;
+
+	if (!filp || !S_ISREG(inode->i_mode) || current == ra_replay_task)
+		return;
+	if (offset + nr_pages > (u32)~0)
+		return;
+
+	spin_lock(&ra_profile_lock);
+	if (!ra_profile_capturing)
+		goto out;
+
+	h = hash_ptr(inode, RA_PROFILE_HASH_BITS);
+	while ((i = ra_hash[h]) && ra_files[i - 1].inode != inode)
+		h = (h + 1) & ((1 << RA_PROFILE_HASH_BITS) - 1);
+
+	if (!i) {
+		if (ra_nr_files == RA_PROFILE_MAX_FILES) {
+			ra_dropped++;
+			goto out;
+		}
+		f = &ra_files[ra_nr_files++];
+		f->path = filp->f_path;
+		path_get(&f->path);
+		f->inode = inode;
+		f->name = NULL;
+		i = ra_nr_files;
+		ra_hash[h] = i;
+	}
+	file = i - 1;
+	ra_files[file].size = i_size_read(inode);
+
+	/* grow the last range while a file is read sequentially */
+	if (ra_nr_ranges) {
+		r = &ra_ranges[ra_nr_ranges - 1];
+		if (r->file == file && offset >= r->start &&
+		    offset <= r->start + r->nr_pages) {
+			end = max_t(u32, r->start + r->nr_pages,
+					offset + nr_pages);
+			r->nr_pages = end - r->start;
+			goto out;
+		}
+	}
+
+	if (ra_nr_ranges == RA_PROFILE_MAX_RANGES) {
+		ra_dropped++;
+		goto out;
+	}
+	r = &ra_ranges[ra_nr_ranges++];
+	r->file = file;
+	r->start = offset;
+	r->nr_pages = nr_pages;
+out:
+	spin_unlock(&ra_profile_lock);
+}
+
+static void ra_profile_free_tables(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ra_nr_files; i++) {
+		path_put(&ra_files[i].path);
+		kfree(ra_files[i].name);
+	}
+	vfree(ra_files);
+	vfree(ra_ranges);
+	vfree(ra_hash);
+	ra_files = NULL;
+	ra_ranges = NULL;
+	ra_hash = NULL;
+	ra_nr_files = 0;
+	ra_nr_ranges = 0;
+}
+
+static int ra_profile_start(void)
+{
+	if (ra_profile_capturing)
+		return -EBUSY;
+
+	ra_files = vzalloc(RA_PROFILE_MAX_FILES * sizeof(*ra_files));
+	ra_ranges = vmalloc(RA_PROFILE_MAX_RANGES * sizeof(*ra_ranges));
+	ra_hash = vzalloc((1 << RA_PROFILE_HASH_BITS) * sizeof(*ra_hash));
+	if (!ra_files || !ra_ranges || !ra_hash) {
+		ra_profile_free_tables();
+		return -ENOMEM;
+	}
+	ra_dropped = 0;
+
+	vfree(ra_export);
+	ra_export = NULL;
+	ra_export_size = 0;
+
+	spin_lock(&ra_profile_lock);
+	ra_profile_capturing = 1;
+	spin_unlock(&ra_profile_lock);
+
+	return 0;
+}
+
+static int ra_range_cmp(const void *a, const void *b)
+{
+	const struct ra_profile_range *ra = a, *rb = b;
+
+	if (ra->file != rb->file)
+		return ra->file < rb->file ? -1 : 1;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+/* sort the ranges by file and offset, and merge those that overlap */
+static void ra_profile_merge_ranges(void)
+{
+	struct ra_profile_range *r, *out;
+	unsigned int i;
+	u32 end;
+
+	if (!ra_nr_ranges)
+		return;
+
+	sort(ra_ranges, ra_nr_ranges, sizeof(*ra_ranges), ra_range_cmp, NULL);
+
+	out = ra_ranges;
+	for (i = 1; i < ra_nr_ranges; i++) {
+		r = &ra_ranges[i];
+		if (r->file == out->file &&
+		    r->start <= out->start + out->nr_pages) {
+			end = max(out->start + out->nr_pages,
+					r->start + r->nr_pages);
+			out->nr_pages = end - out->start;
+		} else {
+			*++out = *r;
+		}
+	}
+	ra_nr_ranges = out - ra_ranges + 1;
+}
+
+/* build ra_export from the sorted ranges */
+static int ra_profile_export(void)
+{
+	struct ra_profile_header *hdr;
+	struct ra_profile_file_rec *frec;
+	struct ra_profile_range_rec *rrec;
+	struct ra_profile_file *f;
+	size_t size = sizeof(*hdr);
+	unsigned int nr_files = 0, nr_ranges = 0;
+	unsigned int i, r, n, len;
+	char *buf, *p, *name;
+
+	name = __getname();
+	if (!name)
+		return -ENOMEM;
+
+	/* resolve the paths of the files that are still there */
+	for (i = 0, r = 0; i < ra_nr_files; i++, r += n) {
+		for (n = 0; r + n < ra_nr_ranges &&
+				ra_ranges[r + n].file == i; n++)
+			;
+		f = &ra_files[i];
+		if (!n || d_unlinked(f->path.dentry))
+			continue;
+		p = d_path(&f->path, name, PATH_MAX);
+		if (IS_ERR(p))
+			continue;
+		f->name = kstrdup(p, GFP_KERNEL);
+		if (!f->name)
+			continue;
+		size += sizeof(*frec) + strlen(f->name) + n * sizeof(*rrec);
+	}
+	__putname(name);
+
+	buf = vmalloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	p = buf + sizeof(*hdr);
+	for (i = 0, r = 0; i < ra_nr_files; i++, r += n) {
+		for (n = 0; r + n < ra_nr_ranges &&
+				ra_ranges[r + n].file == i; n++)
+			;
+		f = &ra_files[i];
+		if (!f->name)
+			continue;
+
+		len = strlen(f->name);
+		frec = (struct ra_profile_file_rec *)p;
+		frec->ino = cpu_to_le64(f->inode->i_ino);
+		frec->size = cpu_to_le64(f->size);
+		frec->nr_ranges = cpu_to_le32(n);
+		frec->path_len = cpu_to_le16(len);
+		p += sizeof(*frec);
+		memcpy(p, f->name, len);
+		p += len;
+
+		rrec = (struct ra_profile_range_rec *)p;
+		for (len = 0; len < n; len++, rrec++) {
+			rrec->start = cpu_to_le32(ra_ranges[r + len].start);
+			rrec->nr_pages = cpu_to_le32(ra_ranges[r + len].nr_pages);
+		}
+		p = (char *)rrec;
+
+		nr_files++;
+		nr_ranges += n;
+	}
+
+	hdr = (struct ra_profile_header *)buf;
+	hdr->magic = cpu_to_le32(RA_PROFILE_MAGIC);
+	hdr->version = cpu_to_le16(RA_PROFILE_VERSION);
+	hdr->reserved = 0;
+	hdr->nr_files = cpu_to_le32(nr_files);
+	hdr->nr_ranges = cpu_to_le32(nr_ranges);
+
+	ra_export = buf;
+	ra_export_size = p - buf;
+
+	printk(KERN_INFO "readahead profile: %u files, %u ranges, "
+			"%lu not recorded\n", nr_files, nr_ranges, ra_dropped);
+	return 0;
+}
+
+static int ra_profile_stop(void)
+{
+	int ret;
+
+	if (!ra_profile_capturing)
+		return -EINVAL;
+
+	/* after this, nothing touches the tables but us */
+	spin_lock(&ra_profile_lock);
+	ra_profile_capturing = 0;
+	spin_unlock(&ra_profile_lock);
+
+	ra_profile_merge_ranges();
+	ret = ra_profile_export();
+	ra_profile_free_tables();
+
+	return ret;
+}
+
+static void ra_profile_stop_work_fn(struct work_struct *work)
+{
+	mutex_lock(&ra_profile_mutex);
+	ra_profile_stop();
+	mutex_unlock(&ra_profile_mutex);
+}
+
+/* read the recorded ranges of one file, if it did not change */
+static void ra_profile_replay_file(const char *path,
+		const struct ra_profile_file_rec *frec,
+		const struct ra_profile_range_rec *rrec)
+{
+	struct file *filp;
+	struct inode *inode;
+	struct blk_plug plug;
+	unsigned long nr;
+	pgoff_t start;
+	unsigned int i;
+
+	filp = filp_open(path, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(filp)) {
+		ra_replay_stale++;
+		return;
+	}
+
+	inode = filp->f_mapping->host;
+	if (inode->i_ino != le64_to_cpu(frec->ino) ||
+	    i_size_read(inode) != le64_to_cpu(frec->size)) {
+		ra_replay_stale++;
+		goto out;
+	}
+
+	blk_start_plug(&plug);
+	for (i = 0; i < le32_to_cpu(frec->nr_ranges); i++, rrec++) {
+		start = le32_to_cpu(rrec->start);
+		nr = le32_to_cpu(rrec->nr_pages);
+
+		/* do not push out what is running to read ahead */
+		nr = max_sane_readahead(nr);
+		if (!nr)
+			break;
+		if (force_page_cache_readahead(filp->f_mapping, filp,
+				start, nr) < 0)
+			break;
+		ra_replay_pages += nr;
+	}
+	blk_finish_plug(&plug);
+	ra_replay_files++;
+out:
+	fput(filp);
+}
+
+static int ra_profile_replay_fn(void *data)
+{
+	const struct ra_profile_header *hdr = ra_load;
+	const struct ra_profile_file_rec *frec;
+	const struct ra_profile_range_rec *rrec;
+	const char *p, *end = ra_load + ra_load_size;
+	unsigned int i, nr_files, len, n;
+	char *path;
+
+	ra_replay_task = current;
+
+	path = __getname();
+	if (!path)
+		goto done;
+
+	if (ra_load_size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != RA_PROFILE_MAGIC ||
+	    le16_to_cpu(hdr->version) != RA_PROFILE_VERSION) {
+		printk(KERN_ERR "readahead profile: bad profile\n");
+		goto done;
+	}
+
+	nr_files = le32_to_cpu(hdr->nr_files);
+	p = ra_load + sizeof(*hdr);
+	for (i = 0; i < nr_files; i++) {
+		frec = (const struct ra_profile_file_rec *)p;
+		if (end - p < sizeof(*frec))
+			break;
+		len = le16_to_cpu(frec->path_len);
+		n = le32_to_cpu(frec->nr_ranges);
+		p += sizeof(*frec);
+		if (len >= PATH_MAX || end - p < len ||
+		    (end - p - len) / sizeof(*rrec) < n)
+			break;
+
+		memcpy(path, p, len);
+		path[len] = '\0';
+		p += len;
+		rrec = (const struct ra_profile_range_rec *)p;
+		p += n * sizeof(*rrec);
+
+		ra_profile_replay_file(path, frec, rrec);
+	}
+	if (i < nr_files)
+		printk(KERN_ERR "readahead profile: truncated profile\n");
+
+	printk(KERN_INFO "readahead profile: read ahead %lu pages of %u "
+			"files, %u files changed or missing\n",
+			ra_replay_pages, ra_replay_files, ra_replay_stale);
+done:
+	if (path)
+		__putname(path);
+
+	mutex_lock(&ra_profile_mutex);
+	vfree(ra_load);
+	ra_load = NULL;
+	ra_replay_task = NULL;
+	mutex_unlock(&ra_profile_mutex);
+	return 0;
+}
+
+/*
+ * /proc/readahead/profile: read the profile of the last capture, or write
+ * a profile to read it ahead.
+ */
+static int ra_profile_open(struct inode *inode, struct file *file)
+{
+	int ret = 0;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return 0;
+
+	mutex_lock(&ra_profile_mutex);
+	if (ra_loading || ra_replay_task) {
+		ret = -EBUSY;
+	} else {
+		ra_loading = 1;
+		ra_load = NULL;
+		ra_load_size = 0;
+		ra_load_alloc = 0;
+	}
+	mutex_unlock(&ra_profile_mutex);
+
+	return ret;
+}
+
+static ssize_t ra_profile_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&ra_profile_mutex);
+	ret = simple_read_from_buffer(buf, count, ppos, ra_export,
+			ra_export_size);
+	mutex_unlock(&ra_profile_mutex);
+
+	return ret;
+}
+
+static ssize_t ra_profile_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	size_t end, alloc;
+	void *load;
+	ssize_t ret = count;
+
+	/* checked before the sum, a huge *ppos must not wrap into range */
+	if (*ppos < 0 || *ppos > RA_PROFILE_MAX_SIZE ||
+	    count > RA_PROFILE_MAX_SIZE - *ppos)
+		return -EFBIG;
+	end = *ppos + count;
+
+	mutex_lock(&ra_profile_mutex);
+
+	if (end > ra_load_alloc) {
+		alloc = max_t(size_t, ra_load_alloc * 2, PAGE_ALIGN(end));
+		alloc = min_t(size_t, alloc, RA_PROFILE_MAX_SIZE);
+		load = vmalloc(alloc);
+		if (!load) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		if (ra_load)
+			memcpy(load, ra_load, ra_load_size);
+		vfree(ra_load);
+		ra_load = load;
+		ra_load_alloc = alloc;
+	}
+
+	/* a write past the end must not leave stale bytes in between */
+	if (*ppos > ra_load_size)
+		memset(ra_load + ra_load_size, 0, *ppos - ra_load_size);
+	if (copy_from_user(ra_load + *ppos, buf, count)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	if (end > ra_load_size)
+		ra_load_size = end;
+	*ppos = end;
+out:
+	mutex_unlock(&ra_profile_mutex);
+	return ret;
+}
+
+static int ra_profile_release(struct inode *inode, struct file *file)
+{
+	struct task_struct *task;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return 0;
+
+	mutex_lock(&ra_profile_mutex);
+	ra_loading = 0;
+	if (ra_load_size) {
+		ra_replay_files = 0;
+		ra_replay_stale = 0;
+		ra_replay_pages = 0;
+		task = kthread_run(ra_profile_replay_fn, NULL, "ra_replay");
+		if (IS_ERR(task)) {
+			vfree(ra_load);
+			ra_load = NULL;
+		} else {
+			ra_replay_task = task;
+		}
+	} else {
+		vfree(ra_load);
+		ra_load = NULL;
+	}
+	mutex_unlock(&ra_profile_mutex);
+
+	return 0;
+}
+
+static const struct file_operations ra_profile_fops = {
+	.open		= ra_profile_open,
+	.read		= ra_profile_read,
+	.write		= ra_profile_write,
+	.release	= ra_profile_release,
+	.llseek		= default_llseek,
+};
+
+/*
+ * /proc/readahead/control: "start [seconds]" and "stop" a capture, and
+ * its state when read.
+ */
+static ssize_t ra_control_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	char tmp[256];
+	int len;
+
+	mutex_lock(&ra_profile_mutex);
+	spin_lock(&ra_profile_lock);
+	len = scnprintf(tmp, sizeof(tmp),
+			"capturing %d\nfiles %u\nranges %u\ndropped %lu\n"
+			"profile_bytes %zu\nreplaying %d\n"
+			"replayed_files %u\nreplayed_pages %lu\n"
+			"stale_files %u\n",
+			ra_profile_capturing, ra_nr_files, ra_nr_ranges,
+			ra_dropped, ra_export_size, ra_replay_task != NULL,
+			ra_replay_files, ra_replay_pages, ra_replay_stale);
+	spin_unlock(&ra_profile_lock);
+	mutex_unlock(&ra_profile_mutex);
+
+	return simple_read_from_buffer(buf, count, ppos, tmp, len);
+}
+
+static ssize_t ra_control_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	char tmp[32];
+	unsigned int secs = 0;
+	int ret;
+
+	if (count >= sizeof(tmp))
+		return -EINVAL;
+	if (copy_from_user(tmp, buf, count))
+		return -EFAULT;
+	tmp[count] = '\0';
+
+	/*
+	 * A timed stop is only ever pending for the capture that is running,
+	 * so only "stop" cancels it, and it must do so before taking the
+	 * mutex the work needs. A capture that just ended here or in the
+	 * work leaves nothing behind that could stop the next one.
+	 */
+	if (!strncmp(tmp, "stop", 4))
+		cancel_delayed_work_sync(&ra_profile_stop_work);
+
+	mutex_lock(&ra_profile_mutex);
+	if (!strncmp(tmp, "start", 5)) {
+		sscanf(tmp + 5, "%u", &secs);
+		ret = ra_profile_start();
+		if (!ret && secs)
+			schedule_delayed_work(&ra_profile_stop_work, secs * HZ);
+	} else if (!strncmp(tmp, "stop", 4)) {
+		ret = ra_profile_stop();
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&ra_profile_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations ra_control_fops = {
+	.read		= ra_control_read,
+	.write		= ra_control_write,
+	.llseek		= default_llseek,
+};
+
+/* ra_profile_capture=<seconds> captures from early boot on */
+static int __init ra_profile_capture_setup(char *str)
+{
+	ra_capture_secs = simple_strtoul(str, NULL, 0);
+	return 1;
+}
+__setup("ra_profile_capture=", ra_profile_capture_setup);
+
+static int __init ra_profile_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	dir = proc_mkdir("readahead", NULL);
+	if (!dir)
+		return -ENOMEM;
+	proc_create("control", S_IRUSR | S_IWUSR, dir, &ra_control_fops);
+	proc_create("profile", S_IRUSR | S_IWUSR, dir, &ra_profile_fops);
+
+	if (ra_capture_secs) {
+		mutex_lock(&ra_profile_mutex);
+		if (!ra_profile_start())
+			schedule_delayed_work(&ra_profile_stop_work,
+					ra_capture_secs * HZ);
+		mutex_unlock(&ra_profile_mutex);
+	}
+	return 0;
+}
+fs_initcall(ra_profile_init);
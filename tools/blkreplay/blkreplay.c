@@ -0,0 +1,418 @@
+/*
+ * blkreplay.c -- replay blktrace captures against a block device
+ *
+ * Copyright (C) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o blkreplay blkreplay.c -lpthread */
+
+/*
+ * Reads the per-cpu files written by blktrace (sda.blktrace.0, ...), takes
+ * every queued read, write and discard in time order and issues them again
+ * with O_DIRECT at the original pace, from a pool of threads so that the
+ * original queue depth can build up. Afterwards the latency of each type
+ * is printed, so runs under different I/O schedulers can be compared.
+ *
+ * Writes and discards destroy the data on the device and are only replayed
+ * with -w.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/fs.h>
+
+#include "../../include/linux/blktrace_api.h"
+
+enum { T_READ, T_WRITE, T_DISCARD, T_NR };
+
+static const char *type_name[T_NR] = { "read", "write", "discard" };
+
+struct event {
+	uint64_t time_ns;	/* from the start of the trace */
+	uint64_t sector;
+	uint32_t bytes;
+	int type;
+	int sync;
+
+	/* filled in by the replay */
+	uint64_t lat_us;
+	uint64_t late_us;	/* issued this much after its time */
+	int error;
+};
+
+static struct event *events;
+static size_t nr_events, max_events;
+static uint32_t max_bytes;
+
+static int dev_fd = -1, dev_sync_fd = -1;
+static int allow_writes;
+static double speed = 1.0;	/* 0: as fast as the device goes */
+static int depth = 8;
+
+/* work handed from the dispatcher to the workers */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t have_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t have_idle = PTHREAD_COND_INITIALIZER;
+static size_t next_event;	/* next one for a worker */
+static size_t released;		/* events whose time has come */
+static int idle_workers;
+static int done;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static void add_event(const struct blk_io_trace *t)
+{
+	unsigned int cat = t->action >> BLK_TC_SHIFT;
+	struct event *e;
+
+	if ((t->action & 0xffff) != __BLK_TA_QUEUE || !t->bytes)
+		return;
+
+	if (nr_events == max_events) {
+		max_events = max_events ? max_events * 2 : 4096;
+		events = realloc(events, max_events * sizeof(*events));
+		if (!events) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	e = &events[nr_events++];
+	memset(e, 0, sizeof(*e));
+	e->time_ns = t->time;
+	e->sector = t->sector;
+	e->bytes = t->bytes;
+	e->sync = !!(cat & BLK_TC_SYNC);
+	if (cat & BLK_TC_DISCARD)
+		e->type = T_DISCARD;
+	else if (cat & BLK_TC_WRITE)
+		e->type = T_WRITE;
+	else
+		e->type = T_READ;
+
+	if (e->type != T_DISCARD && e->bytes > max_bytes)
+		max_bytes = e->bytes;
+}
+
+static void load_trace(const char *path)
+{
+	struct blk_io_trace t;
+	char pdu[4096];
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fread(&t, sizeof(t), 1, f) == 1) {
+		if ((t.magic & 0xffffff00) != BLK_IO_TRACE_MAGIC) {
+			fprintf(stderr, "%s: bad magic %#x, traces must be "
+				"replayed with the byte order they were "
+				"captured in\n", path, t.magic);
+			exit(1);
+		}
+		if (t.pdu_len > sizeof(pdu) ||
+		    (t.pdu_len && fread(pdu, t.pdu_len, 1, f) != 1))
+			break;
+		add_event(&t);
+	}
+
+	fclose(f);
+}
+
+static int cmp_time(const void *a, const void *b)
+{
+	const struct event *ea = a, *eb = b;
+
+	if (ea->time_ns != eb->time_ns)
+		return ea->time_ns < eb->time_ns ? -1 : 1;
+	return 0;
+}
+
+static void do_io(struct event *e, void *buf)
+{
+	off_t off = (off_t)e->sector << 9;
+	uint64_t range[2];
+	ssize_t ret = 0;
+
+	switch (e->type) {
+	case T_READ:
+		ret = pread(dev_fd, buf, e->bytes, off);
+		break;
+	case T_WRITE:
+		ret = pwrite(e->sync ? dev_sync_fd : dev_fd, buf, e->bytes, off);
+		break;
+	case T_DISCARD:
+		range[0] = off;
+		range[1] = e->bytes;
+		ret = ioctl(dev_fd, BLKDISCARD, range) ? -1 : (ssize_t)e->bytes;
+		break;
+	}
+
+	if (ret != (ssize_t)e->bytes)
+		e->error = ret < 0 ? errno : EIO;
+}
+
+static void *worker(void *arg)
+{
+	void *buf;
+	struct event *e;
+	uint64_t start, t0 = *(uint64_t *)arg;
+
+	if (posix_memalign(&buf, 4096, max_bytes ? max_bytes : 4096)) {
+		perror("posix_memalign");
+		exit(1);
+	}
+	memset(buf, 0x5a, max_bytes);
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (next_event == released && !done) {
+			idle_workers++;
+			pthread_cond_signal(&have_idle);
+			pthread_cond_wait(&have_work, &lock);
+			idle_workers--;
+		}
+		if (next_event == released && done)
+			break;
+
+		e = &events[next_event++];
+		pthread_mutex_unlock(&lock);
+
+		start = now_ns();
+		if (speed > 0 && start > t0 + e->time_ns / speed)
+			e->late_us = (start - t0 - e->time_ns / speed) / 1000;
+		do_io(e, buf);
+		e->lat_us = (now_ns() - start) / 1000;
+
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+
+	free(buf);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(uint64_t elapsed_ns)
+{
+	uint64_t *lat, total, late, bytes;
+	size_t i, n, errors;
+	int type;
+
+	lat = malloc(nr_events * sizeof(*lat));
+	if (!lat) {
+		perror("malloc");
+		exit(1);
+	}
+
+	printf("%zu events in %.3f s, %d threads, speed %g\n\n",
+	       nr_events, elapsed_ns / 1e9, depth, speed);
+	printf("%-8s %8s %9s %9s %9s %9s %9s %9s %7s\n", "type", "count",
+	       "MB", "avg(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)",
+	       "errors");
+
+	for (type = 0; type < T_NR; type++) {
+		n = 0;
+		total = late = bytes = 0;
+		errors = 0;
+		for (i = 0; i < nr_events; i++) {
+			if (events[i].type != type)
+				continue;
+			if (type != T_READ && !allow_writes)
+				continue;
+			lat[n++] = events[i].lat_us;
+			total += events[i].lat_us;
+			late += events[i].late_us;
+			bytes += events[i].bytes;
+			errors += !!events[i].error;
+		}
+		if (!n)
+			continue;
+
+		qsort(lat, n, sizeof(*lat), cmp_u64);
+		printf("%-8s %8zu %9.1f %9llu %9llu %9llu %9llu %9llu %7zu\n",
+		       type_name[type], n, bytes / 1048576.0,
+		       (unsigned long long)(total / n),
+		       (unsigned long long)lat[n / 2],
+		       (unsigned long long)lat[n * 9 / 10],
+		       (unsigned long long)lat[n * 99 / 100],
+		       (unsigned long long)lat[n - 1], errors);
+		if (speed > 0)
+			printf("%-8s issued late by %llu us on average\n", "",
+			       (unsigned long long)(late / n));
+	}
+
+	free(lat);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-w] [-s speed] [-q threads] device trace...\n"
+		"  -w         also replay writes and discards (destroys data)\n"
+		"  -s speed   time scale, 2 replays twice as fast, 0 ignores\n"
+		"             the trace timing (default 1)\n"
+		"  -q threads I/O threads, the most I/O in flight (default 8)\n"
+		"trace files are the per-cpu <dev>.blktrace.<cpu> files\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *threads;
+	uint64_t t0, end;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ws:q:")) != -1) {
+		switch (opt) {
+		case 'w':
+			allow_writes = 1;
+			break;
+		case 's':
+			speed = atof(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind < 2 || depth < 1 || speed < 0)
+		usage(argv[0]);
+
+	for (i = optind + 1; i < (size_t)argc; i++)
+		load_trace(argv[i]);
+	if (!nr_events) {
+		fprintf(stderr, "no queued I/O in the traces\n");
+		return 1;
+	}
+
+	/* per-cpu files each are in order, together they are not */
+	qsort(events, nr_events, sizeof(*events), cmp_time);
+	for (i = 1; i < nr_events; i++)
+		events[i].time_ns -= events[0].time_ns;
+	events[0].time_ns = 0;
+
+	if (!allow_writes) {
+		size_t n = 0;
+
+		for (i = 0; i < nr_events; i++)
+			if (events[i].type == T_READ)
+				events[n++] = events[i];
+		fprintf(stderr, "skipping %zu writes and discards, use -w "
+			"to replay them\n", nr_events - n);
+		nr_events = n;
+		if (!nr_events)
+			return 1;
+	}
+
+	dev_fd = open(argv[optind], (allow_writes ? O_RDWR : O_RDONLY) |
+		      O_DIRECT);
+	if (dev_fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (allow_writes) {
+		dev_sync_fd = open(argv[optind], O_RDWR | O_DIRECT | O_DSYNC);
+		if (dev_sync_fd < 0) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	threads = calloc(depth, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < (size_t)depth; i++)
+		pthread_create(&threads[i], NULL, worker, &t0);
+
+	/*
+	 * Release each event at its time. When all threads are busy the
+	 * event waits, as it would have in the queue, and counts as late.
+	 */
+	for (i = 0; i < nr_events; i++) {
+		if (speed > 0)
+			sleep_until_ns(t0 + events[i].time_ns / speed);
+
+		pthread_mutex_lock(&lock);
+		while (!idle_workers && next_event < released)
+			pthread_cond_wait(&have_idle, &lock);
+		released++;
+		pthread_cond_signal(&have_work);
+		pthread_mutex_unlock(&lock);
+	}
+
+	pthread_mutex_lock(&lock);
+	done = 1;
+	pthread_cond_broadcast(&have_work);
+	pthread_mutex_unlock(&lock);
+
+	for (i = 0; i < (size_t)depth; i++)
+		pthread_join(threads[i], NULL);
+	end = now_ns();
+
+	report(end - t0);
+
+	close(dev_fd);
+	if (dev_sync_fd >= 0)
+		close(dev_sync_fd);
+	free(threads);
+	free(events);
+
+	return 0;
+}